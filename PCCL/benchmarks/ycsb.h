@@ -31,17 +31,21 @@ public:
     YCSBType type;
     void init(uint64_t thd_id, Workload *h_wl);
     void reset();
-    RC run_txn();
+    using TxnManager::run_txn;
+    RC run_txn(DataBase *state);
 #if ISEOV
     #if PRE_EX
-    RC simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    RC simulate_txn(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
     #else
-    RC simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    RC simulate_txn(RWSet &readSet, RWSet &writeSet);
     #endif
 #if RE_EXECUTE
-    RC validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    RC validate_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+    #if PARTIAL_RE_EXECUTE
+    RC re_execute_txn(Overlay &mergeSet);
+    #endif
 #else
-    RC validate_and_commit(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    RC validate_and_commit(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 private:
@@ -5,6 +5,7 @@
 #include "ycsb.h"
 #include "message.h"
 #include "global.h"
+#include "overlay.h"
 
 uint64_t YCSBQueryGenerator::the_n = 0;
 double YCSBQueryGenerator::denom = 0;
@@ -46,6 +47,7 @@ void YCSBQuery::release_requests()
     for (uint64_t i = 0; i < requests.size(); i++)
     {
         DEBUG_M("YCSBQuery::release() ycsb_request free\n");
+        requests[i]->release();
         mem_allocator.free(requests[i], sizeof(ycsb_request));
     }
 }
@@ -64,220 +66,326 @@ void YCSBQuery::release()
 }
 
 #if ISEOV
-#if PRE_EX
-uint64_t YCSBQuery::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+/*
+A txn runs its requests in order. Every request reads all the columns of its
+record, a scan those of scan_len records, and an update then writes one of
+them. A column already written by an
+earlier request of the txn is read from the txn itself, so it is not part of
+the read set.
+
+An increment reads nothing: it adds its value to one column as a delta write
+(see RWSet::add), so txns incrementing a same counter do not conflict.
+*/
+static inline bool is_write(ycsb_request *req)
 {
-    int result = 1;
-    switch (this->requests[0]->type)
-    {
-    case YCSB_READ:
+    return req->type == YCSB_UPDATE || req->type == YCSB_INCREMENT;
+}
+
+// Whether attr_key is updated or incremented by one of the first n requests.
+static inline bool written_before(Array<ycsb_request *> &requests, uint64_t n, uint64_t attr_key)
+{
+    for (uint64_t i = 0; i < n; i++)
     {
-        uint64_t elem_key = this->requests[0]->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp;
-            if(speculateSet.find(elem_key * g_ycsb_column + j) == speculateSet.end())
-            {
-                temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-                //DEBUG_V1("test_ycsb:YCSB_READ_simulate_getfromdb:readSet[%ld] = %d\n", elem_key * g_ycsb_column + j, stoi(temp));
-            }
-            else
-            {
-                temp = std::to_string(speculateSet[elem_key * g_ycsb_column + j]);
-                //DEBUG_V1("test_ycsb:YCSB_READ_simulate_getfromspeculateSet:readSet[%ld] = %d\n", elem_key * g_ycsb_column + j, stoi(temp));
-            }
-            
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            readSet[elem_key * g_ycsb_column + j] = attr_value;
-            //DEBUG_V1("test_ycsb:YCSB_READ_simulate:readSet[%ld] = %ld\n", elem_key * g_ycsb_column + j, attr_value);
+        if (is_write(requests[i]) && requests[i]->key * g_ycsb_column + requests[i]->column == attr_key)
+        {
+            return true;
         }
-        break;
     }
-    case YCSB_UPDATE:
+    return false;
+}
+
+/*
+Columns read by a request: the columns of its record, or of the scan_len
+records of a scan, column j of the first record first. A scan is read with
+one DataBase::Scan, so a store that keeps its keys in order reads the range
+in one pass.
+*/
+class RequestColumns
+{
+public:
+    uint64_t size;
+    uint64_t *values;
+    uint64_t *versions;
+
+    void read(ycsb_request *req)
     {
-        uint64_t elem_key = this->requests[0]->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp;
-            if(speculateSet.find(elem_key * g_ycsb_column + j) == speculateSet.end())
-            {
-                temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            }
-            else
-            {
-                temp = std::to_string(speculateSet[elem_key * g_ycsb_column + j]);
-            }
-            
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            readSet[elem_key * g_ycsb_column + j] = attr_value;
-            //DEBUG_V1("test_ycsb:YCSB_READ_simulate:readSet[%ld] = %ld\n", elem_key * g_ycsb_column + j, attr_value);
+        if (req->type != YCSB_SCAN)
+        {
+            size = g_ycsb_column;
+            values = rowValues;
+            versions = rowVersions;
+            db->GetRow(req->key, g_ycsb_column, values, versions, 0);
+            return;
         }
-        
-        writeSet[elem_key * g_ycsb_column + this->requests[0]->column] = this->requests[0]->value;
-        speculateSet[elem_key * g_ycsb_column + this->requests[0]->column] = this->requests[0]->value;
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:writeSet[%ld] = %ld\n", elem_key * g_ycsb_column + this->requests[0]->column, this->requests[0]->value);
-        break;
-    }
-    default:
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:err type = %d\n", this->requests[0]->type);
-        assert(0);
-        break;
+        size = req->scan_len * g_ycsb_column;
+        scanValues.resize(size);
+        scanVersions.resize(size);
+        values = scanValues.data();
+        versions = scanVersions.data();
+        db->Scan(req->key * g_ycsb_column, size, values, versions, 0);
     }
 
-    return result;
-}
+private:
+    uint64_t rowValues[YCSB_MAX_COLUMN];
+    uint64_t rowVersions[YCSB_MAX_COLUMN];
+    std::vector<uint64_t> scanValues;
+    std::vector<uint64_t> scanVersions;
+};
+
+// Bytes an update writes (see ValueBuf), NULL when it writes req->value.
+static inline ValueBuf *request_bytes(ycsb_request *req)
+{
+#if LARGER_TXN
+    return req->payload;
 #else
-uint64_t YCSBQuery::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+    return NULL;
+#endif
+}
+
+// Integer value an update writes: req->value, or the digest of its bytes.
+static inline uint64_t request_value(ycsb_request *req)
+{
+    ValueBuf *bytes = request_bytes(req);
+    return bytes == NULL ? req->value : bytes->digest;
+}
+
+// Record the write of an update or increment request in writes.
+static inline void write_request(RWSet &writes, ycsb_request *req)
 {
-    int result = 1;
-    switch (this->requests[0]->type)
+    uint64_t attr_key = req->key * g_ycsb_column + req->column;
+    if (req->type == YCSB_INCREMENT)
     {
-    case YCSB_READ:
+        writes.add(attr_key, req->value);
+        return;
+    }
+    ValueBuf *bytes = request_bytes(req);
+    if (bytes != NULL)
     {
-        uint64_t elem_key = this->requests[0]->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            readSet[elem_key * g_ycsb_column + j] = attr_value;
-            //DEBUG_V1("test_ycsb:YCSB_READ_simulate:readSet[%ld] = %ld\n", elem_key * g_ycsb_column + j, attr_value);
-        }
-        break;
+        writes.put(attr_key, bytes);
     }
-    case YCSB_UPDATE:
+    else
     {
-        uint64_t elem_key = this->requests[0]->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            readSet[elem_key * g_ycsb_column + j] = attr_value;
-            //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:readSet[%ld] = %ld\n", elem_key * g_ycsb_column + j, attr_value);
-        }
+        writes[attr_key] = req->value;
+    }
+}
 
-        
-        writeSet[elem_key * g_ycsb_column + this->requests[0]->column] = this->requests[0]->value;
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:writeSet[%ld] = %ld\n", elem_key * g_ycsb_column + this->requests[0]->column, this->requests[0]->value);
-        break;
+#if PRE_EX || RE_EXECUTE
+// Write update or increment request i into overlay. A txn commits its
+// writes to a key as one version, so a key it already wrote keeps its
+// version.
+static inline void overlay_update(Overlay &overlay, Array<ycsb_request *> &requests, uint64_t i)
+{
+    ycsb_request *req = requests[i];
+    uint64_t attr_key = req->key * g_ycsb_column + req->column;
+    if (written_before(requests, i, attr_key))
+    {
+        OverlayEntry &entry = overlay[attr_key];
+        if (req->type == YCSB_INCREMENT)
+        {
+            entry.value += req->value;
+            entry.buf = ValueRef();
+        }
+        else
+        {
+            entry.value = request_value(req);
+            entry.buf = ValueRef(request_bytes(req));
+        }
+        return;
     }
-    default:
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:err type = %d\n", this->requests[0]->type);
-        assert(0);
-        break;
+    uint64_t version;
+    uint64_t value = state_get(overlay, attr_key, 0, version);
+    if (req->type == YCSB_INCREMENT)
+    {
+        overlay_put(overlay, attr_key, value + req->value, version);
+        return;
     }
-
-    return result;
+    overlay_put(overlay, attr_key, request_value(req), version, request_bytes(req));
 }
 #endif
-#if !RE_EXECUTE
-uint64_t YCSBQuery::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+
+#if PRE_EX
+uint64_t YCSBQuery::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
-    int result = 0;
-    ycsb_request *req =this->requests[0];
-    switch (req->type)
-    {
-    case YCSB_READ:
+    RequestColumns cols;
+    for (uint64_t i = 0; i < this->requests.size(); i++)
     {
-        uint64_t elem_key = req->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            if((readSet[elem_key * g_ycsb_column + j]) != attr_value){
-                //DEBUG_V1("test_ycsb:YCSB_READ:conflict::key = %ld, old value = %ld, now value = %ld\n", elem_key * g_ycsb_column + j, readSet[elem_key * g_ycsb_column + j], attr_value);
-                return 0;
+        ycsb_request *req = this->requests[i];
+        assert(req->type == YCSB_READ || req->type == YCSB_UPDATE || req->type == YCSB_SCAN || req->type == YCSB_INCREMENT);
+        if (req->type == YCSB_INCREMENT)
+        {
+            write_request(writeSet, req);
+            overlay_update(speculateSet, this->requests, i);
+            continue;
+        }
+        cols.read(req);
+        for(uint64_t j = 0; j < cols.size; j++){
+            uint64_t attr_key = req->key * g_ycsb_column + j;
+            auto spec = speculateSet.find(attr_key);
+            if (spec != speculateSet.end())
+            {
+                cols.values[j] = spec->second.value;
+                cols.versions[j] = spec->second.version;
+            }
+            if (written_before(this->requests, i, attr_key))
+            {
+                continue;
             }
+            readSet[attr_key] = read_stamp(cols.values[j], cols.versions[j]);
+            //DEBUG_V1("test_ycsb:YCSB_READ_simulate:readSet[%ld] = %ld\n", attr_key, readSet[attr_key]);
+        }
+        if (req->type == YCSB_UPDATE)
+        {
+            write_request(writeSet, req);
+            overlay_update(speculateSet, this->requests, i);
+            //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:writeSet[%ld] = %ld\n", attr_key, req->value);
         }
-        //DEBUG_V1("test_ycsb:YCSB_READ:ok\n");
-
-        result = 1;
-        break;
     }
-    case YCSB_UPDATE:
+    return 1;
+}
+#else
+uint64_t YCSBQuery::simulate(RWSet &readSet, RWSet &writeSet)
+{
+    RequestColumns cols;
+    for (uint64_t i = 0; i < this->requests.size(); i++)
     {
-        uint64_t elem_key = req->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            if((readSet[elem_key * g_ycsb_column + j]) != attr_value){
-                //DEBUG_V1("test_ycsb:YCSB_UPDATE:conflict::key = %ld, old value = %ld, now value = %ld\n", elem_key * g_ycsb_column + j, readSet[elem_key * g_ycsb_column + j], attr_value);
-                return 0;
+        ycsb_request *req = this->requests[i];
+        assert(req->type == YCSB_READ || req->type == YCSB_UPDATE || req->type == YCSB_SCAN || req->type == YCSB_INCREMENT);
+        if (req->type == YCSB_INCREMENT)
+        {
+            write_request(writeSet, req);
+            continue;
+        }
+        cols.read(req);
+        for(uint64_t j = 0; j < cols.size; j++){
+            uint64_t attr_key = req->key * g_ycsb_column + j;
+            if (written_before(this->requests, i, attr_key))
+            {
+                continue;
             }
+            readSet[attr_key] = read_stamp(cols.values[j], cols.versions[j]);
+            //DEBUG_V1("test_ycsb:YCSB_READ_simulate:readSet[%ld] = %ld\n", attr_key, readSet[attr_key]);
+        }
+        if (req->type == YCSB_UPDATE)
+        {
+            write_request(writeSet, req);
+            //DEBUG_V1("test_ycsb:YCSB_UPDATE_simulate:writeSet[%ld] = %ld\n", req->key * g_ycsb_column + req->column, req->value);
         }
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE:ok\n");
-
-        db->Put(std::to_string(req->key * g_ycsb_column + req->column), std::to_string(req->value));
-        result = 1;
-        break;
-    }
-    default:
-        assert(0);
-        break;
     }
-
-    return result;
+    return 1;
 }
-#else
-uint64_t YCSBQuery::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+#endif
+#if !RE_EXECUTE
+uint64_t YCSBQuery::v_and_c(RWSet &readSet, RWSet &writeSet)
 {
-   // DEBUG_V1("test_v6:enter SmartContract::v_and_merge\n");
-    int result = 0;
-    ycsb_request *req =this->requests[0];
-    switch (req->type)
-    {
-    case YCSB_READ:
+    // Check every read before applying any write.
+    RequestColumns cols;
+    for (uint64_t i = 0; i < this->requests.size(); i++)
     {
-        uint64_t elem_key = req->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp;
-            if (mergeSet.find(elem_key * g_ycsb_column + j) == mergeSet.end())
+        ycsb_request *req = this->requests[i];
+        if (req->type == YCSB_INCREMENT)
+        {
+            continue;
+        }
+        cols.read(req);
+        for(uint64_t j = 0; j < cols.size; j++){
+            uint64_t attr_key = req->key * g_ycsb_column + j;
+            if (written_before(this->requests, i, attr_key))
             {
-                temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
+                continue;
             }
-            else {
-                temp = std::to_string(mergeSet[elem_key * g_ycsb_column + j]);
-            }
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            if((readSet[elem_key * g_ycsb_column + j]) != attr_value){
-                //DEBUG("test_v5:TransferMoneySmartContract::get_old_source = %ld, now source = %ld\n", readSet[this->source_id], source);
+            const RWEntry *read = readSet.find(attr_key);
+            if(read == nullptr || read->second != read_stamp(cols.values[j], cols.versions[j])){
+                //DEBUG_V1("test_ycsb:conflict::key = %ld\n", attr_key);
                 return 0;
             }
         }
+    }
+    //DEBUG_V1("test_ycsb:v_and_c:ok\n");
 
-        result = 1;
-        break;
+    RWSet writes;
+    for (uint64_t i = 0; i < this->requests.size(); i++)
+    {
+        ycsb_request *req = this->requests[i];
+        if (is_write(req))
+        {
+            write_request(writes, req);
+        }
     }
-    case YCSB_UPDATE:
+    // Increments are added to the committed values.
+    for (RWEntry &item : writes)
+    {
+        if (item.delta)
+        {
+            item.second += db->Get(item.first, 0);
+            item.delta = false;
+        }
+    }
+    db->ApplyWriteSet(writes);
+    return 1;
+}
+#else
+uint64_t YCSBQuery::v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
+{
+   // DEBUG_V1("test_v6:enter SmartContract::v_and_merge\n");
+    RequestColumns cols;
+    for (uint64_t i = 0; i < this->requests.size(); i++)
     {
-        uint64_t elem_key = req->key;
-        for(uint64_t j = 0; j < g_ycsb_column; j++){
-            string temp;
-            if (mergeSet.find(elem_key * g_ycsb_column + j) == mergeSet.end())
+        ycsb_request *req = this->requests[i];
+        if (req->type == YCSB_INCREMENT)
+        {
+            continue;
+        }
+        cols.read(req);
+        for(uint64_t j = 0; j < cols.size; j++){
+            uint64_t attr_key = req->key * g_ycsb_column + j;
+            if (written_before(this->requests, i, attr_key))
             {
-                temp = db->Get(std::to_string(elem_key * g_ycsb_column + j));
-            }
-            else {
-                temp = std::to_string(mergeSet[elem_key * g_ycsb_column + j]);
+                continue;
             }
-            uint64_t attr_value = temp.empty() ? 0 : stoi(temp);
-            //DEBUG_V1("test_ycsb:YCSB_UPDATE:read::key = %ld, db_value = %ld, readSet_value = %ld\n", elem_key * g_ycsb_column + j, readSet[elem_key * g_ycsb_column + j], attr_value);
-            if((readSet[elem_key * g_ycsb_column + j]) != attr_value){
-                //DEBUG_V1("test_ycsb:YCSB_UPDATE:conflict::key = %ld, old value = %ld, now value = %ld\n", elem_key * g_ycsb_column + j, readSet[elem_key * g_ycsb_column + j], attr_value);
+            auto merged = mergeSet.find(attr_key);
+            uint64_t attr_stamp = merged == mergeSet.end() ? read_stamp(cols.values[j], cols.versions[j])
+                                                           : read_stamp(merged->second.value, merged->second.version);
+            const RWEntry *read = readSet.find(attr_key);
+            if(read == nullptr || read->second != attr_stamp){
+                //DEBUG_V1("test_ycsb:conflict::key = %ld, now value = %ld\n", attr_key, attr_stamp);
                 return 0;
             }
         }
-
-        //DEBUG_V1("test_ycsb:YCSB_UPDATE:write::key = %ld, writeSet_value = %ld\n", req->key * g_ycsb_column + req->column, req->value);
-        mergeSet[req->key * g_ycsb_column + req->column] = req->value;
-
-        //db->Put(std::to_string(req->key * g_ycsb_column + req->column), std::to_string(req->value));
-        result = 1;
-        break;
     }
-    default:
-        assert(0);
-        break;
+
+    for (uint64_t i = 0; i < this->requests.size(); i++)
+    {
+        ycsb_request *req = this->requests[i];
+        if (is_write(req))
+        {
+            overlay_update(mergeSet, this->requests, i);
+        }
     }
+    return 1;
+}
 
-    return result;
+#if PARTIAL_RE_EXECUTE
+/*
+Execute the requests against the database overlaid by mergeSet.
+Reads and scans have no effect, updates and increments are written into
+mergeSet.
+*/
+uint64_t YCSBQuery::re_execute(Overlay &mergeSet)
+{
+    for (uint64_t i = 0; i < this->requests.size(); i++)
+    {
+        ycsb_request *req = this->requests[i];
+        assert(req->type == YCSB_READ || req->type == YCSB_UPDATE || req->type == YCSB_SCAN || req->type == YCSB_INCREMENT);
+        if (is_write(req))
+        {
+            overlay_update(mergeSet, this->requests, i);
+        }
+    }
+    return 1;
 }
 #endif
 #endif
+#endif
 
 
 // The following algorithm comes from the paper:
@@ -312,6 +420,21 @@ uint64_t YCSBQueryGenerator::zipf(uint64_t n, double theta)
     return 1 + (uint64_t)(n * pow(eta * u - eta + 1, alpha));
 }
 
+#if LARGER_TXN
+/*
+The record written by an update: its key and value, filled up to
+YCSB_PAYLOAD_SIZE bytes. Built once by the client and shared from then on.
+*/
+static ValueBuf *make_payload(ycsb_request *req)
+{
+    static_assert(YCSB_PAYLOAD_SIZE >= 2 * sizeof(uint64_t), "YCSB_PAYLOAD_SIZE holds a key and a value");
+    std::string record(YCSB_PAYLOAD_SIZE, (char)('a' + req->value % 26));
+    memcpy(&record[0], &req->key, sizeof(uint64_t));
+    memcpy(&record[sizeof(uint64_t)], &req->value, sizeof(uint64_t));
+    return value_alloc(record.data(), record.size());
+}
+#endif
+
 BaseQuery *YCSBQueryGenerator::gen_requests_zipf()
 {
     YCSBQuery *query = (YCSBQuery *)mem_allocator.alloc(sizeof(YCSBQuery));
@@ -353,13 +476,28 @@ BaseQuery *YCSBQueryGenerator::gen_requests_zipf()
         req->key = row_id;
         req->value = mrand->next() % 10000;
         req->column = (uint64_t)rand() % g_ycsb_column;
+        req->scan_len = 0;
+#if LARGER_TXN
+        req->payload = make_payload(req);
+#endif
         //DEBUG_V1("test_ycsb:req->key = %ld, req->value = %ld \n, req->column = %ld", row_id, req->value, req->column);
 
-        if(((uint64_t)rand() % 100) > g_ycsb_write_ratio)
+        if (g_ycsb_scan_ratio > 0 && ((uint64_t)rand() % 100) < g_ycsb_scan_ratio)
+        {
+            // As in YCSB workload E, the length is uniform and the scan
+            // stops at the last record.
+            req->type = YCSB_SCAN;
+            req->scan_len = min(1 + (uint64_t)rand() % g_ycsb_max_scan_len, table_size - row_id);
+        }
+        else if(((uint64_t)rand() % 100) > g_ycsb_write_ratio)
         {
             req->type = YCSB_READ;
             //DEBUG_V1("test_ycsb:YCSB_READ:req->key = %ld, req->value = %ld , req->column = %ld\n", row_id, req->value, req->column);
         }
+        else if (g_ycsb_increment_ratio > 0 && ((uint64_t)rand() % 100) < g_ycsb_increment_ratio)
+        {
+            req->type = YCSB_INCREMENT;
+        }
         else
         {
             req->type = YCSB_UPDATE;
@@ -10,32 +10,55 @@ class Message;
 class YCSBQueryMessage;
 class YCSBClientQueryMessage;
 
+// Upper bound on g_ycsb_column, rows are read into a buffer of this size.
+#ifndef YCSB_MAX_COLUMN
+#define YCSB_MAX_COLUMN 64
+#endif
+
 // Each YCSBQuery contains several ycsb_requests,
 // to a single table
 class ycsb_request
 {
 public:
     ycsb_request() {}
-    ycsb_request(const ycsb_request &req) : key(req.key), value(req.value), column(req.column), type(req.type) {}
+#if LARGER_TXN
+    ycsb_request(const ycsb_request &req) : key(req.key), value(req.value), column(req.column), scan_len(req.scan_len), type(req.type), payload(value_ref(req.payload)) {}
+#else
+    ycsb_request(const ycsb_request &req) : key(req.key), value(req.value), column(req.column), scan_len(req.scan_len), type(req.type) {}
+#endif
     //ycsb_request(const ycsb_request &req) : key(req.key), value(req.value) {}
     void copy(ycsb_request *req)
     {
         this->key = req->key;
         this->value = req->value;
         this->column = req->column;
+        this->scan_len = req->scan_len;
         this->type = req->type;
 #if LARGER_TXN
-        strncpy(this->payload, req->payload, 1556);
+        ValueBuf *old = this->payload;
+        this->payload = value_ref(req->payload);
+        value_unref(old);
+#endif
+    }
+
+    // Drop the reference to the payload, before the request is freed.
+    void release()
+    {
+#if LARGER_TXN
+        value_unref(payload);
+        payload = NULL;
 #endif
     }
 
     uint64_t key;
     uint64_t value;
     uint64_t column;
+    uint64_t scan_len; // YCSB_SCAN: records read, from key on
     YCSBType type;
 #if LARGER_TXN
-    char payload[1556];
-    // 156, 356, 756, 1556
+    // YCSB_PAYLOAD_SIZE bytes, written as the value by an update. Shared
+    // by the copies of the request and sent after it in messages.
+    ValueBuf *payload;
 #endif
 };
 
@@ -50,24 +73,15 @@ public:
     {
         this->key = req->key;
         this->value = req->value;
-#if LARGER_TXN
-        strncpy(this->payload, req->payload, 1556);
-#endif
     }
     void copy(ycsb_request *req)
     {
         this->key = req->key;
         this->value = req->value;
-#if LARGER_TXN
-        strncpy(this->payload, req->payload, 1556);
-#endif
     }
+    // The payload of a write is the one of its request.
     uint64_t key;
     uint64_t value;
-#if LARGER_TXN
-    char payload[1556];
-    // 156, 356, 756, 1556
-#endif
 };
 #endif
 // test_add
@@ -117,14 +131,17 @@ public:
 
 #if ISEOV
     #if PRE_EX
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
     #else
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet);
     #endif
 #if RE_EXECUTE
-    uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+    #if PARTIAL_RE_EXECUTE
+    uint64_t re_execute(Overlay &mergeSet);
+    #endif
 #else
-    uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t v_and_c(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 };
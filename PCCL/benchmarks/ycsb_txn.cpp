@@ -19,7 +19,7 @@ void YCSBTxnManager::reset()
     TxnManager::reset();
 }
 
-RC YCSBTxnManager::run_txn()
+RC YCSBTxnManager::run_txn(DataBase *state)
 {
     uint64_t starttime = get_sys_clock();
 
@@ -28,7 +28,28 @@ RC YCSBTxnManager::run_txn()
     for (uint i = 0; i < ycsb_query->requests.size(); i++)
     {
         yreq = ycsb_query->requests[i];
-        db->Put(std::to_string(yreq->key), std::to_string(yreq->value));
+        if (yreq->type == YCSB_SCAN)
+        {
+            std::vector<uint64_t> values(yreq->scan_len * g_ycsb_column), versions(values.size());
+            state->Scan(yreq->key * g_ycsb_column, values.size(), values.data(), versions.data(), 0);
+            continue;
+        }
+        // Column j of record k is key k * g_ycsb_column + j, as in the
+        // read/write sets.
+        uint64_t attr_key = yreq->key * g_ycsb_column + yreq->column;
+        if (yreq->type == YCSB_INCREMENT)
+        {
+            state->Put(attr_key, state->Get(attr_key, 0) + yreq->value);
+            continue;
+        }
+#if LARGER_TXN
+        if (yreq->payload != NULL)
+        {
+            state->PutValue(attr_key, yreq->payload);
+            continue;
+        }
+#endif
+        state->Put(attr_key, yreq->value);
     }
 
     uint64_t curr_time = get_sys_clock();
@@ -41,7 +62,7 @@ RC YCSBTxnManager::run_txn()
 
 #if ISEOV
 #if PRE_EX
-RC YCSBTxnManager::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+RC YCSBTxnManager::simulate_txn(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
     if(((YCSBQuery *)this->query)->simulate(readSet, writeSet, speculateSet) == 1){
         return RCOK;
@@ -61,7 +82,7 @@ RC YCSBTxnManager::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,ui
     return NONE;
 }
 #else
-RC YCSBTxnManager::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+RC YCSBTxnManager::simulate_txn(RWSet &readSet, RWSet &writeSet)
 {
     if(((YCSBQuery *)this->query)->simulate(readSet, writeSet) == 1){
         return RCOK;
@@ -83,7 +104,7 @@ RC YCSBTxnManager::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,ui
 #endif
 
 #if RE_EXECUTE
-RC YCSBTxnManager::validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+RC YCSBTxnManager::validate_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
 #if CHECK_CONFILICT
     if(((YCSBQuery *)this->query)->v_and_merge(readSet, writeSet, mergeSet) == 1){
@@ -96,9 +117,19 @@ RC YCSBTxnManager::validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uint6
 #endif
 }
 
+#if PARTIAL_RE_EXECUTE
+RC YCSBTxnManager::re_execute_txn(Overlay &mergeSet)
+{
+    if(((YCSBQuery *)this->query)->re_execute(mergeSet) == 1){
+        return RCOK;
+    }
+    return NONE;
+}
+#endif
+
 
 #else
-RC YCSBTxnManager::validate_and_commit(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+RC YCSBTxnManager::validate_and_commit(RWSet &readSet, RWSet &writeSet)
 {
     if(((YCSBQuery *)this->query)->v_and_c(readSet, writeSet) == 1){
         return RCOK;
@@ -1,5 +1,6 @@
 #include "global.h"
 #include "ycsb.h"
+#include "ycsb_query.h"
 #include "wl.h"
 #include "thread.h"
 #include "mem_alloc.h"
@@ -11,6 +12,7 @@ int YCSBWorkload::next_tid;
 RC YCSBWorkload::init()
 {
   Workload::init();
+  assert(g_ycsb_column <= YCSB_MAX_COLUMN);
   next_tid = 0;
   return RCOK;
 }
@@ -28,6 +28,25 @@ void BChainStruct::add_commit_proof(Message *msg) {
 	delete_msg_buffer(buf);
 }
 
+/* Record the Merkle root of the state after this block. */
+void BChainStruct::set_state_root(const string &root)
+{
+	assert(root.size() == sizeof(state_root));
+	memcpy(state_root, root.data(), sizeof(state_root));
+	has_root = true;
+}
+
+/* Get the Merkle root of the state after this block, if recorded. */
+bool BChainStruct::get_state_root(string &root)
+{
+	if (!has_root)
+	{
+		return false;
+	}
+	root.assign(state_root, sizeof(state_root));
+	return true;
+}
+
 /* Release the contents of the block. */
 void BChainStruct::release_data() {
 	Message::release_message(this->batch_info);
@@ -86,6 +105,40 @@ void BChain::remove_block(uint64_t tid)
 	}	
 }
 
+/* Record the state root of a block, if it is still in the chain. */
+void BChain::set_state_root(uint64_t tid, const string &root)
+{
+	chainLock.lock();
+	   for (uint64_t i = bchain_map.size(); i > 0; i--)
+	   {
+	   	if (bchain_map[i - 1]->get_txn_id() == tid)
+	   	{
+	   		bchain_map[i - 1]->set_state_root(root);
+	   		break;
+	   	}
+	   }
+	chainLock.unlock();
+}
+
+/* Get the state root of a block, false if unknown. */
+bool BChain::get_state_root(uint64_t tid, string &root)
+{
+	bool found = false;
+
+	chainLock.lock();
+	   for (uint64_t i = bchain_map.size(); i > 0; i--)
+	   {
+	   	if (bchain_map[i - 1]->get_txn_id() == tid)
+	   	{
+	   		found = bchain_map[i - 1]->get_state_root(root);
+	   		break;
+	   	}
+	   }
+	chainLock.unlock();
+
+	return found;
+}
+
 /*****************************************/
 
 BChain *BlockChain;
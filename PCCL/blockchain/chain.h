@@ -6,19 +6,25 @@
  * Each block is identified using the identifier for the last transaction in 
  * its batch. Further, each block consists of the signed BatchRequests msg from
  * the primary replica, which also includes the client request. Each block also
- * includes the signed Commit messages from other replicas.
+ * includes the signed Commit messages from other replicas. With MERKLE_STATE,
+ * a block also records the Merkle root of the state after its batch, once
+ * the tree has computed it.
  */
 class BChainStruct
 {
 	uint64_t txn_id;
 	BatchRequests *batch_info;	// BatchRequests msg from primary.
 	vector<Message *> commit_proof; // Signed commit messages.
+	char state_root[32];		// Merkle root of the state, if has_root.
+	bool has_root;
 
 public:
 	void set_txn_id(uint64_t tid);
 	uint64_t get_txn_id();
 	void add_batch(BatchRequests *bmsg);
 	void add_commit_proof(Message *proof);
+	void set_state_root(const string &root);
+	bool get_state_root(string &root);
 	void release_data();
 };
 
@@ -31,6 +37,8 @@ class BChain
 public:
 	void add_block(TxnManager *txn);
 	void remove_block(uint64_t tid);
+	void set_state_root(uint64_t tid, const string &root);
+	bool get_state_root(uint64_t tid, string &root);
 
 };	
 
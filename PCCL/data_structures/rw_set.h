@@ -0,0 +1,283 @@
+#ifndef _RW_SET_H_
+#define _RW_SET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unordered_map>
+#include "value_buf.h"
+
+// Number of entries stored inline before a RWSet spills to the heap.
+// Banking txns touch at most 2 keys and a YCSB request YCSB_COLUMN keys.
+#ifndef RWSET_INLINE_CNT
+#define RWSET_INLINE_CNT 16
+#endif
+
+struct RWEntry
+{
+    uint64_t first;  // key
+    uint64_t second; // value, the digest of buf if the value is bytes
+    ValueBuf *buf;   // bytes of the value, NULL for an integer value
+    bool delta;      // second is an increment added to the key at commit
+};
+
+/*
+  Read/write set of a transaction: key/value pairs kept sorted by key in one
+  contiguous array. Small sets live in an inline buffer, larger ones spill to
+  the heap. clear() keeps the allocated capacity so a set can be reused from
+  one batch to the next without touching the allocator.
+
+  A write of bytes (see ValueBuf) holds a reference to the buffer, dropped
+  when the entry is overwritten or the set cleared. Read sets only record
+  integers: values, digests or versions.
+
+  A write can also be a delta: an increment added to whatever the key holds
+  when the write commits. A txn that only increments a key does not read it,
+  so two such txns do not conflict and commit in either order.
+*/
+class RWSet
+{
+public:
+    typedef RWEntry *iterator;
+    typedef const RWEntry *const_iterator;
+
+    RWSet() : data(inline_buf), cnt(0), cap(RWSET_INLINE_CNT) {}
+    RWSet(const RWSet &other) : data(inline_buf), cnt(0), cap(RWSET_INLINE_CNT) { assign(other); }
+    RWSet(RWSet &&other) noexcept : data(inline_buf), cnt(0), cap(RWSET_INLINE_CNT) { steal(other); }
+    ~RWSet() { reset(); }
+
+    RWSet &operator=(const RWSet &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            assign(other);
+        }
+        return *this;
+    }
+    RWSet &operator=(RWSet &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            steal(other);
+        }
+        return *this;
+    }
+
+    uint64_t size() const { return cnt; }
+    bool empty() const { return cnt == 0; }
+    void clear()
+    {
+        release();
+        cnt = 0;
+    }
+
+    // Drop the heap buffer, if any, and go back to the inline storage.
+    void reset()
+    {
+        release();
+        if (data != inline_buf)
+        {
+            free(data);
+        }
+        data = inline_buf;
+        cnt = 0;
+        cap = RWSET_INLINE_CNT;
+    }
+
+    void reserve(uint64_t n)
+    {
+        if (n > cap)
+        {
+            grow(n);
+        }
+    }
+
+    iterator begin() { return data; }
+    iterator end() { return data + cnt; }
+    const_iterator begin() const { return data; }
+    const_iterator end() const { return data + cnt; }
+
+    // Index of key, or of the first larger key if key is absent.
+    uint64_t lower_bound(uint64_t key) const
+    {
+        uint64_t lo = 0, hi = cnt;
+        while (lo < hi)
+        {
+            uint64_t mid = (lo + hi) >> 1;
+            if (data[mid].first < key)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    RWEntry *find(uint64_t key)
+    {
+        uint64_t pos = lower_bound(key);
+        return (pos < cnt && data[pos].first == key) ? &data[pos] : nullptr;
+    }
+    const RWEntry *find(uint64_t key) const
+    {
+        uint64_t pos = lower_bound(key);
+        return (pos < cnt && data[pos].first == key) ? &data[pos] : nullptr;
+    }
+    uint64_t count(uint64_t key) const { return find(key) != nullptr; }
+
+    // Same semantics as std::map: a missing key is inserted with value 0.
+    // The integer is about to be set, so the bytes of the key are dropped.
+    uint64_t &operator[](uint64_t key)
+    {
+        RWEntry &entry = at(key, NULL);
+        entry.delta = false;
+        return entry.second;
+    }
+
+    // Add delta to key. A key missing from the set becomes a delta write; a
+    // key already set stays a plain write of its value plus delta.
+    void add(uint64_t key, uint64_t delta)
+    {
+        RWEntry *entry = find(key);
+        if (entry != nullptr)
+        {
+            ValueBuf *old = entry->buf;
+            entry->buf = NULL;
+            value_unref(old);
+            entry->second += delta;
+            return;
+        }
+        RWEntry &added = at(key, NULL);
+        added.second = delta;
+        added.delta = true;
+    }
+
+    // Set key to the bytes of buf, whose digest is the integer value.
+    void put(uint64_t key, ValueBuf *buf)
+    {
+        RWEntry &entry = at(key, buf);
+        entry.second = buf->digest;
+        entry.delta = false;
+    }
+
+    // Append a pair whose key is larger than every key in the set, which is
+    // the case when deserializing a set that was sent in order. The set
+    // takes its own reference to buf.
+    void push_back(uint64_t key, uint64_t value, ValueBuf *buf = NULL, bool delta = false)
+    {
+        if (cnt > 0 && data[cnt - 1].first >= key)
+        {
+            RWEntry &entry = at(key, buf);
+            entry.second = value;
+            entry.delta = delta;
+            return;
+        }
+        if (cnt == cap)
+        {
+            grow(cap * 2);
+        }
+        data[cnt].first = key;
+        data[cnt].second = value;
+        data[cnt].buf = value_ref(buf);
+        data[cnt].delta = delta;
+        cnt++;
+    }
+
+private:
+    // The entry of key, inserted with value 0 if missing, holding buf.
+    RWEntry &at(uint64_t key, ValueBuf *buf)
+    {
+        uint64_t pos = lower_bound(key);
+        if (pos < cnt && data[pos].first == key)
+        {
+            ValueBuf *old = data[pos].buf;
+            data[pos].buf = value_ref(buf);
+            value_unref(old);
+            return data[pos];
+        }
+        if (cnt == cap)
+        {
+            grow(cap * 2);
+        }
+        memmove(&data[pos + 1], &data[pos], (cnt - pos) * sizeof(RWEntry));
+        data[pos].first = key;
+        data[pos].second = 0;
+        data[pos].buf = value_ref(buf);
+        data[pos].delta = false;
+        cnt++;
+        return data[pos];
+    }
+
+    void release()
+    {
+        for (uint64_t i = 0; i < cnt; i++)
+        {
+            value_unref(data[i].buf);
+        }
+    }
+
+    void grow(uint64_t n)
+    {
+        RWEntry *ndata = (RWEntry *)malloc(n * sizeof(RWEntry));
+        assert(ndata != NULL);
+        memcpy(ndata, data, cnt * sizeof(RWEntry));
+        if (data != inline_buf)
+        {
+            free(data);
+        }
+        data = ndata;
+        cap = n;
+    }
+
+    void assign(const RWSet &other)
+    {
+        reserve(other.cnt);
+        memcpy(data, other.data, other.cnt * sizeof(RWEntry));
+        cnt = other.cnt;
+        for (uint64_t i = 0; i < cnt; i++)
+        {
+            value_ref(data[i].buf);
+        }
+    }
+
+    // The references to the bytes move along with the entries.
+    void steal(RWSet &other)
+    {
+        if (other.data == other.inline_buf)
+        {
+            memcpy(data, other.data, other.cnt * sizeof(RWEntry));
+            cnt = other.cnt;
+        }
+        else
+        {
+            data = other.data;
+            cnt = other.cnt;
+            cap = other.cap;
+            other.data = other.inline_buf;
+            other.cap = RWSET_INLINE_CNT;
+        }
+        other.cnt = 0;
+    }
+
+    RWEntry *data;
+    uint64_t cnt;
+    uint64_t cap;
+    RWEntry inline_buf[RWSET_INLINE_CNT];
+};
+
+// A write that is not committed yet, and the version the key takes once it
+// is.
+struct OverlayEntry
+{
+    uint64_t value;
+    uint64_t version;
+    ValueRef buf; // bytes of the value, as in RWEntry
+};
+
+// Writes of a batch overlaid on the state store: speculateSet on the
+// primary, mergeSet on the execute thread.
+typedef std::unordered_map<uint64_t, OverlayEntry> Overlay;
+
+#endif
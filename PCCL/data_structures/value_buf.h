@@ -0,0 +1,121 @@
+#ifndef _VALUE_BUF_H_
+#define _VALUE_BUF_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+  Byte string value of a key. The bytes are never changed once the buffer
+  is built, so the request that carries them, the write set and overlays of
+  its txn and the state store all share the one buffer, freed with its last
+  reference.
+
+  The integer value of a key that holds bytes is the digest of the bytes:
+  reads, read stamps, state digests and Merkle roots handle both kinds of
+  values alike, and only the commit of a write needs the bytes.
+*/
+struct ValueBuf
+{
+    std::atomic<uint32_t> refs;
+    uint32_t len;
+    uint64_t digest;
+    char data[1]; // len bytes
+};
+
+static inline uint64_t value_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// 64 bit digest of len bytes, a word at a time as in MurmurHash3.
+static inline uint64_t value_digest(const char *data, uint32_t len)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    uint32_t pos = 0;
+    for (; pos + sizeof(uint64_t) <= len; pos += sizeof(uint64_t))
+    {
+        uint64_t w;
+        memcpy(&w, data + pos, sizeof(w));
+        h ^= value_rotl(w * c1, 31) * c2;
+        h = value_rotl(h, 27) * 5 + 0x52dce729;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + pos, len - pos);
+    h ^= value_rotl(tail * c1, 31) * c2;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// A buffer holding a copy of len bytes, with one reference.
+static inline ValueBuf *value_alloc(const char *data, uint32_t len)
+{
+    ValueBuf *buf = (ValueBuf *)malloc(sizeof(ValueBuf) + len);
+    assert(buf != NULL);
+    buf->refs.store(1, std::memory_order_relaxed);
+    buf->len = len;
+    buf->digest = value_digest(data, len);
+    memcpy(buf->data, data, len);
+    return buf;
+}
+
+static inline ValueBuf *value_ref(ValueBuf *buf)
+{
+    if (buf != NULL)
+    {
+        buf->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return buf;
+}
+
+static inline void value_unref(ValueBuf *buf)
+{
+    if (buf != NULL && buf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        free(buf);
+    }
+}
+
+// Reference to a ValueBuf, for the containers that copy their entries.
+class ValueRef
+{
+public:
+    ValueRef() : buf(NULL) {}
+    explicit ValueRef(ValueBuf *buf) : buf(value_ref(buf)) {}
+    ValueRef(const ValueRef &other) : buf(value_ref(other.buf)) {}
+    ValueRef(ValueRef &&other) noexcept : buf(other.buf) { other.buf = NULL; }
+    ~ValueRef() { value_unref(buf); }
+
+    ValueRef &operator=(const ValueRef &other)
+    {
+        ValueBuf *old = buf;
+        buf = value_ref(other.buf);
+        value_unref(old);
+        return *this;
+    }
+    ValueRef &operator=(ValueRef &&other) noexcept
+    {
+        if (this != &other)
+        {
+            value_unref(buf);
+            buf = other.buf;
+            other.buf = NULL;
+        }
+        return *this;
+    }
+
+    ValueBuf *get() const { return buf; }
+    explicit operator bool() const { return buf != NULL; }
+
+private:
+    ValueBuf *buf;
+};
+
+#endif
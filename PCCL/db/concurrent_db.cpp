@@ -0,0 +1,365 @@
+#include "database.h"
+#include "../config.h"
+#include "../system/global.h"
+#include <iostream>
+
+ConcurrentDB::ConcurrentDB()
+{
+    _dbInstance = "Concurrent";
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, CL_SIZE, SEQ_STRIPES * sizeof(SeqStripe)) != 0)
+    {
+        std::cerr << "ConcurrentDB: cannot allocate the sequence locks" << std::endl;
+        assert(0);
+    }
+    seqs = (SeqStripe *)ptr;
+    memset(seqs, 0, SEQ_STRIPES * sizeof(SeqStripe));
+    pageCnt = 0;
+    pageEpoch = nullptr;
+    epoch = 1;
+    curSnap = nullptr;
+}
+
+ConcurrentDB::~ConcurrentDB()
+{
+    free(seqs);
+}
+
+int ConcurrentDB::Open(const std::string id)
+{
+    int rc = DenseDB::Open(id);
+    pageCnt = (capacity + PAGE_SLOTS - 1) / PAGE_SLOTS;
+    pageEpoch = new uint64_t[pageCnt]();
+    return rc;
+}
+
+uint64_t &ConcurrentDB::seqOf(uint64_t key)
+{
+    return seqs[key & (SEQ_STRIPES - 1)].seq;
+}
+
+// Lock the stripe of key, returning its even counter.
+uint64_t ConcurrentDB::writeBegin(uint64_t key)
+{
+    uint64_t &seq = seqOf(key);
+    while (true)
+    {
+        uint64_t cur = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+        if ((cur & 1) == 0 &&
+            __atomic_compare_exchange_n(&seq, &cur, cur + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            // The odd sequence has to be visible before any store to the
+            // slot, else a reader may mix two writes.
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            return cur;
+        }
+    }
+}
+
+void ConcurrentDB::writeEnd(uint64_t key, uint64_t seq)
+{
+    __atomic_store_n(&seqOf(key), seq + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t ConcurrentDB::readSlot(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    if (key >= capacity)
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        return DenseDB::Get(key, dflt, version);
+    }
+
+    uint64_t &seq = seqOf(key);
+    Slot *slot = &slots[key];
+    uint64_t value, before;
+    do
+    {
+        before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        while (before & 1)
+        {
+            before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        }
+        value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+        version = __atomic_load_n(&slot->version, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&seq, __ATOMIC_RELAXED) != before);
+
+    return version == 0 ? dflt : value;
+}
+
+uint64_t ConcurrentDB::Get(uint64_t key, uint64_t dflt)
+{
+    uint64_t version;
+    return readSlot(key, dflt, version);
+}
+
+uint64_t ConcurrentDB::Get(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    return readSlot(key, dflt, version);
+}
+
+void ConcurrentDB::Put(uint64_t key, uint64_t value)
+{
+    if (key >= capacity)
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        DenseDB::Put(key, value);
+        return;
+    }
+    preserve(key);
+    uint64_t seq = writeBegin(key);
+    Slot *slot = &slots[key];
+#if STATE_DIGEST
+    digest.update(key, slot->version != 0, slot->value, value);
+#endif
+#if MERKLE_STATE
+    merkle->Touch(key);
+#endif
+    __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->version, slot->version + 1, __ATOMIC_RELAXED);
+    writeEnd(key, seq);
+}
+
+void ConcurrentDB::Put(uint64_t key, uint64_t value, uint64_t version)
+{
+    if (key >= capacity)
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        DenseDB::Put(key, value, version);
+        return;
+    }
+    preserve(key);
+    uint64_t seq = writeBegin(key);
+    Slot *slot = &slots[key];
+#if STATE_DIGEST
+    digest.update(key, slot->version != 0, slot->value, value);
+#endif
+#if MERKLE_STATE
+    merkle->Touch(key);
+#endif
+    __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->version, version, __ATOMIC_RELAXED);
+    writeEnd(key, seq);
+}
+
+std::string ConcurrentDB::Get(const std::string key)
+{
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        return DenseDB::Get(key);
+    }
+    uint64_t version;
+    uint64_t value = readSlot(k, 0, version);
+    return version == 0 ? std::string() : numericString(k, value);
+}
+
+std::string ConcurrentDB::Put(const std::string key, const std::string value)
+{
+    // The key alone tells where it lives, as in Get.
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        return DenseDB::Put(key, value);
+    }
+    std::string oldValue = Get(key);
+    putNumeric(k, value);
+    return oldValue;
+}
+
+/*
+   Before the first write to the page of key since the last snapshot was
+   published, copy the page into that snapshot. The copy is published
+   before the write, so a snapshot reader that sees the write also sees
+   the copy.
+*/
+void ConcurrentDB::preserve(uint64_t key)
+{
+    StateSnapshot *snap = curSnap;
+    if (snap == nullptr)
+    {
+        return;
+    }
+    uint64_t page = key / PAGE_SLOTS;
+    if (__atomic_load_n(&pageEpoch[page], __ATOMIC_ACQUIRE) == epoch)
+    {
+        return;
+    }
+
+    // Other writers of the page wait here until it is copied.
+    std::lock_guard<std::mutex> guard(copyLocks[page % COPY_LOCKS]);
+    if (__atomic_load_n(&pageEpoch[page], __ATOMIC_RELAXED) == epoch)
+    {
+        return;
+    }
+    uint64_t first = page * PAGE_SLOTS;
+    Slot *copy = new Slot[PAGE_SLOTS];
+    memcpy(copy, slots + first, min((uint64_t)PAGE_SLOTS, capacity - first) * sizeof(Slot));
+    __atomic_store_n(&snap->pages[page], copy, __ATOMIC_RELEASE);
+    __atomic_store_n(&pageEpoch[page], epoch, __ATOMIC_RELEASE);
+}
+
+// Stop copying for the last snapshot. Called with snapLock held.
+void ConcurrentDB::dropSnapshot()
+{
+    StateSnapshot *snap = curSnap;
+    curSnap = nullptr;
+    snap->Release();
+}
+
+// A snapshot that nobody acquired is dropped before the batch writes.
+void ConcurrentDB::BeginBatch()
+{
+    std::lock_guard<std::mutex> guard(snapLock);
+    if (curSnap != nullptr && __atomic_load_n(&curSnap->refs, __ATOMIC_ACQUIRE) == 1)
+    {
+        dropSnapshot();
+    }
+}
+
+void ConcurrentDB::PublishSnapshot(uint64_t txn_id)
+{
+    StateSnapshot *snap = new StateSnapshot(this, txn_id);
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        snap->overflow = overflow;
+        snap->strTable = strTable;
+    }
+    Digest(snap->digest);
+    // Pages copied so far belong to the older snapshots.
+    epoch++;
+
+    std::lock_guard<std::mutex> guard(snapLock);
+    StateSnapshot *old = curSnap;
+    curSnap = snap;
+    if (old != nullptr)
+    {
+        if (__atomic_load_n(&old->refs, __ATOMIC_ACQUIRE) > 1)
+        {
+            // Older snapshots read the pages written from now on in snap.
+            __atomic_add_fetch(&snap->refs, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&old->newer, snap, __ATOMIC_RELEASE);
+        }
+        old->Release();
+    }
+}
+
+StateSnapshot *ConcurrentDB::AcquireSnapshot()
+{
+    std::lock_guard<std::mutex> guard(snapLock);
+    if (curSnap != nullptr)
+    {
+        __atomic_add_fetch(&curSnap->refs, 1, __ATOMIC_RELAXED);
+    }
+    return curSnap;
+}
+
+int ConcurrentDB::Close(const std::string id)
+{
+    {
+        std::lock_guard<std::mutex> guard(snapLock);
+        if (curSnap != nullptr)
+        {
+            dropSnapshot();
+        }
+    }
+    delete[] pageEpoch;
+    pageEpoch = nullptr;
+    return DenseDB::Close(id);
+}
+
+StateSnapshot::StateSnapshot(ConcurrentDB *db, uint64_t txn_id)
+{
+    this->db = db;
+    txnId = txn_id;
+    refs = 1;
+    pages = new Slot *[db->pageCnt]();
+    newer = nullptr;
+}
+
+StateSnapshot::~StateSnapshot()
+{
+    for (uint64_t page = 0; page < db->pageCnt; page++)
+    {
+        delete[] pages[page];
+    }
+    delete[] pages;
+}
+
+void StateSnapshot::Release()
+{
+    StateSnapshot *snap = this;
+    while (snap != nullptr && __atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        // A snapshot holds a reference on the next newer one.
+        StateSnapshot *next = snap->newer;
+        delete snap;
+        snap = next;
+    }
+}
+
+/*
+   The copy of a page as seen by this snapshot, NULL if it is still live.
+   A snapshot gets no more copies once a newer one is linked to it, so the
+   link is read before the page: a NULL page is then final and the newer
+   snapshot may be searched.
+*/
+StateSnapshot::Slot *StateSnapshot::resolve(uint64_t page)
+{
+    StateSnapshot *snap = this;
+    while (snap != nullptr)
+    {
+        StateSnapshot *next = __atomic_load_n(&snap->newer, __ATOMIC_ACQUIRE);
+        Slot *copy = __atomic_load_n(&snap->pages[page], __ATOMIC_ACQUIRE);
+        if (copy != nullptr)
+        {
+            return copy;
+        }
+        snap = next;
+    }
+    return nullptr;
+}
+
+uint64_t StateSnapshot::Get(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    if (key >= db->capacity)
+    {
+        auto it = overflow.find(key);
+        version = it == overflow.end() ? 0 : it->second.version;
+        return version == 0 ? dflt : it->second.value;
+    }
+
+    uint64_t page = key / ConcurrentDB::PAGE_SLOTS;
+    while (true)
+    {
+        Slot *copy = resolve(page);
+        if (copy != nullptr)
+        {
+            Slot &slot = copy[key % ConcurrentDB::PAGE_SLOTS];
+            version = slot.version;
+            return version == 0 ? dflt : slot.value;
+        }
+        // The live value holds if the page was not copied meanwhile.
+        uint64_t value = db->readSlot(key, dflt, version);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (resolve(page) == nullptr)
+        {
+            return value;
+        }
+    }
+}
+
+bool StateSnapshot::Save(const std::string &path)
+{
+    ConcurrentDB::SlotReader read = [this](uint64_t first, uint64_t cnt, Slot *buf) -> const Slot * {
+        for (uint64_t i = 0; i < cnt; i++)
+        {
+            buf[i].value = Get(first + i, 0, buf[i].version);
+        }
+        return buf;
+    };
+    // The tree moved on since, the loader rebuilds it.
+    return db->writeSnapshot(path, read, overflow, strTable, STATE_DIGEST ? &digest : nullptr, nullptr);
+}
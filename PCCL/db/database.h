@@ -6,6 +6,41 @@
 #include <unordered_map>
 #include "sqlite3.h"
 #include <vector>
+#include <stdint.h>
+#include <mutex>
+#include <functional>
+#include "rw_set.h"
+#include "state_digest.h"
+#include "merkle_tree.h"
+#include "index_hash.h"
+#include "index_btree.h"
+
+#ifndef MEMORY_DENSE
+#define MEMORY_DENSE 4
+#endif
+#ifndef MEMORY_ROW
+#define MEMORY_ROW 5
+#endif
+#ifndef MEMORY_LOG
+#define MEMORY_LOG 6
+#endif
+#ifndef MEMORY_CONCURRENT
+#define MEMORY_CONCURRENT 7
+#endif
+#ifndef MEMORY_INDEX
+#define MEMORY_INDEX 8
+#endif
+
+// principal index structure. The workload may decide to use a different
+// index structure for specific purposes. (e.g. non-primary key access should use hash)
+#if (INDEX_STRUCT == IDX_BTREE)
+#define INDEX index_btree
+#else // IDX_HASH
+#define INDEX IndexHash
+#endif
+
+class StateSnapshot;
+
 /**
  * class DataBase
  * 
@@ -41,6 +76,260 @@ public:
      */
     virtual std::string Put(const std::string key, const std::string value) = 0;
 
+    /**
+     * Get the integer value associate to the given integer key
+     * @param key represents a key in the database
+     * @param dflt is returned if the key is not present
+     * @return the value associate to the key or dflt
+     */
+    virtual uint64_t Get(uint64_t key, uint64_t dflt)
+    {
+        std::string value = Get(std::to_string(key));
+        return value.empty() ? dflt : std::stoull(value);
+    }
+
+    /**
+     * Put an integer key-value pair in the database.
+     * Unlike the string version, the previous value is not returned.
+     * @param key represents a key in the database
+     * @param value represent the new value that should be associate to the key
+     */
+    virtual void Put(uint64_t key, uint64_t value)
+    {
+        Put(std::to_string(key), std::to_string(value));
+    }
+
+    /**
+     * Get the integer value associate to the given integer key, and the
+     * version of the key. The version of a key is 0 until it is written and
+     * then grows by one with every Put.
+     * @param key represents a key in the database
+     * @param dflt is returned if the key is not present
+     * @param version receives the version, always 0 if the database does
+     *        not keep versions
+     * @return the value associate to the key or dflt
+     */
+    virtual uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version)
+    {
+        version = 0;
+        return Get(key, dflt);
+    }
+
+    /**
+     * Put an integer key-value pair in the database, with a given version.
+     * Used to commit writes whose version was computed on top of the store.
+     * @param key represents a key in the database
+     * @param value represent the new value that should be associate to the key
+     * @param version is the new version of the key, ignored if the database
+     *        does not keep versions
+     */
+    virtual void Put(uint64_t key, uint64_t value, uint64_t version)
+    {
+        Put(key, value);
+    }
+
+    /**
+     * Read all the columns of a row. Column j of row r is the integer
+     * key r * colCnt + j.
+     * @param row represents a row in the database
+     * @param colCnt is the number of columns of the row
+     * @param cols receives the colCnt values, dflt for the missing ones
+     * @param versions receives the versions of the columns, as in Get
+     */
+    virtual void GetRow(uint64_t row, uint64_t colCnt, uint64_t *cols, uint64_t *versions, uint64_t dflt)
+    {
+        for (uint64_t j = 0; j < colCnt; j++)
+        {
+            cols[j] = Get(row * colCnt + j, dflt, versions[j]);
+        }
+    }
+
+    /**
+     * Read the integer keys [start, start + cnt) in key order.
+     * @param start is the first key of the range
+     * @param cnt is the number of keys of the range
+     * @param values receives the cnt values, dflt for the missing keys
+     * @param versions receives the cnt versions, as in Get
+     */
+    virtual void Scan(uint64_t start, uint64_t cnt, uint64_t *values, uint64_t *versions, uint64_t dflt)
+    {
+        for (uint64_t i = 0; i < cnt; i++)
+        {
+            values[i] = Get(start + i, dflt, versions[i]);
+        }
+    }
+
+    /**
+     * Update one column of a row.
+     * @param row represents a row in the database
+     * @param colCnt is the number of columns of the row
+     * @param col is the column to update
+     * @param value represent the new value of the column
+     */
+    virtual void PutColumn(uint64_t row, uint64_t colCnt, uint64_t col, uint64_t value)
+    {
+        Put(row * colCnt + col, value);
+    }
+
+    /**
+     * Apply a set of integer updates in one call, with the same result as
+     * a Put of each pair. The previous values are not read.
+     * @param writes represents the key-value pairs to write
+     */
+    virtual void ApplyWriteSet(const RWSet &writes)
+    {
+        for (const auto &item : writes)
+        {
+            storeValue(item.first, item.buf);
+            Put(item.first, item.second);
+        }
+    }
+
+    /**
+     * Apply the writes of an Overlay in one call, each key taking the
+     * version of its entry.
+     * @param writes represents the writes to commit
+     */
+    virtual void ApplyWriteSet(const Overlay &writes)
+    {
+        for (const auto &item : writes)
+        {
+            storeValue(item.first, item.second.buf.get());
+            Put(item.first, item.second.value, item.second.version);
+        }
+    }
+
+    /**
+     * Put bytes as the value of an integer key (see ValueBuf). The integer
+     * value of the key becomes the digest of the bytes, which the database
+     * shares rather than copies.
+     * @param key represents a key in the database
+     * @param value holds the bytes
+     */
+    virtual void PutValue(uint64_t key, ValueBuf *value)
+    {
+        storeValue(key, value);
+        Put(key, value->digest);
+    }
+
+    /**
+     * Get the bytes of an integer key. The bytes of a key are kept until
+     * it is given other bytes, and only returned while the integer value
+     * of the key is their digest.
+     * @param key represents a key in the database
+     * @return the bytes, empty if the key holds an integer or is not present
+     */
+    ValueRef GetValue(uint64_t key)
+    {
+        ValueStripe &stripe = valueStripes[key % VALUE_STRIPES];
+        ValueRef value;
+        {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            auto it = stripe.values.find(key);
+            if (it == stripe.values.end())
+            {
+                return value;
+            }
+            value = it->second;
+        }
+        if (Get(key, 0) != value.get()->digest)
+        {
+            return ValueRef();
+        }
+        return value;
+    }
+
+    /**
+     * Get the digest of the integer keys of the state (see StateDigest),
+     * kept up to date by every update.
+     * @param digest receives the digest
+     * @return false if the database does not keep a digest
+     */
+    virtual bool Digest(StateDigest &digest)
+    {
+        return false;
+    }
+
+    /**
+     * Hand the keys written since the last call to the Merkle tree of the
+     * state (see MerkleTree), which computes the root of the state after
+     * txn_id in the background. Called by the execute thread between
+     * batches.
+     * @param txn_id is the id of the last executed txn
+     */
+    virtual void CommitStateRoot(uint64_t txn_id) {}
+
+    /**
+     * Get the value of a key with a proof of inclusion against the last
+     * root computed by the Merkle tree. May be called from any thread.
+     * @param key is the integer key to read
+     * @param proof receives the value, its proof and the root
+     * @return false if the database does not keep a tree or the key is
+     *         not covered by it
+     */
+    virtual bool ProveRead(uint64_t key, MerkleProof &proof)
+    {
+        return false;
+    }
+
+    /**
+     * Set the function told of every root computed by the Merkle tree,
+     * from the thread of the tree.
+     * @param listener is called with the txn id and the root
+     */
+    virtual void SetStateRootListener(const MerkleRootListener &listener) {}
+
+    /**
+     * Publish the current state as the snapshot handed out by
+     * AcquireSnapshot. Called by the execute thread between batches.
+     * @param txn_id is the id of the last executed txn
+     */
+    virtual void PublishSnapshot(uint64_t txn_id) {}
+
+    /**
+     * Get the last published snapshot, to be read from any thread while
+     * the execute thread goes on. It must be given back with Release.
+     * @return the snapshot, or NULL if there is none or the database does
+     *         not support snapshots
+     */
+    virtual StateSnapshot *AcquireSnapshot()
+    {
+        return NULL;
+    }
+
+    /**
+     * Save the whole state to a binary snapshot file.
+     * @param path is the file to write, replaced atomically
+     * @return true if the database supports snapshots and the file was written
+     */
+    virtual bool SaveSnapshot(const std::string &path)
+    {
+        return false;
+    }
+
+    /**
+     * Replace the state with the one of a snapshot written by SaveSnapshot,
+     * on a database that was just opened.
+     * @param path is the snapshot file
+     * @return true if the state was loaded, false if there is no usable
+     *         snapshot and the database must be initialized
+     */
+    virtual bool LoadSnapshot(const std::string &path)
+    {
+        return false;
+    }
+
+    /**
+     * Group the updates that follow into a single transaction, up to the
+     * next CommitBatch. The execute thread brackets every batch with them.
+     */
+    virtual void BeginBatch() {}
+
+    /**
+     * Commit the updates made since BeginBatch.
+     */
+    virtual void CommitBatch() {}
+
     /**
      * Select a new active table for the database
      * @param tableName is the name of the table that will be activate
@@ -69,46 +358,510 @@ public:
     {
         return _dbInstance;
     }
+
+protected:
+    /*
+       The bytes of the keys that hold bytes, beside the integer digests
+       the stores keep. They live in memory only.
+    */
+    struct ValueStripe
+    {
+        std::mutex lock;
+        std::unordered_map<uint64_t, ValueRef> values;
+    };
+    static const uint64_t VALUE_STRIPES = 64;
+    ValueStripe valueStripes[VALUE_STRIPES];
+
+    // Keep the bytes of key, if the write has bytes.
+    void storeValue(uint64_t key, ValueBuf *value)
+    {
+        if (value == NULL)
+        {
+            return;
+        }
+        ValueStripe &stripe = valueStripes[key % VALUE_STRIPES];
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        stripe.values[key] = ValueRef(value);
+    }
+
+    /*
+       String form of the value of integer key k, whose integer value is
+       value: the bytes it holds (see PutValue), else the number.
+    */
+    std::string numericString(uint64_t k, uint64_t value)
+    {
+        ValueRef bytes = GetValue(k);
+        if (bytes)
+        {
+            return std::string(bytes.get()->data, bytes.get()->len);
+        }
+        return std::to_string(value);
+    }
+
+    /*
+       Put a string value on integer key k. A value that is not a number is
+       kept as bytes, so that the key still reads it back.
+    */
+    void putNumeric(uint64_t k, const std::string &value)
+    {
+        uint64_t v;
+        if (parseKey(value, v))
+        {
+            Put(k, v);
+            return;
+        }
+        ValueBuf *bytes = value_alloc(value.data(), value.size());
+        PutValue(k, bytes);
+        value_unref(bytes);
+    }
+
+    // Parse a key made only of decimal digits.
+    static bool parseKey(const std::string &key, uint64_t &k)
+    {
+        if (key.empty() || key.size() > 19)
+        {
+            return false;
+        }
+        k = 0;
+        for (char c : key)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            k = k * 10 + (c - '0');
+        }
+        return true;
+    }
 };
 
+/**
+ * class SQLite
+ *
+ * Integer keys and values are stored in a WITHOUT ROWID table with an
+ * INTEGER PRIMARY KEY. Every operation goes through a prepared statement
+ * cached for the active table, under a lock as the statements are shared
+ * by all threads. In SQL_PERSISTENT mode the database uses WAL journaling,
+ * and BeginBatch/CommitBatch make each executed batch one transaction.
+ */
 class SQLite : public DataBase
 {
 private:
-    typedef struct _res_data
-    {
-        std::vector<std::vector<std::string>> results;
-        std::string op;
-        _res_data(const std::string &opType) : op(opType) {}
-    } res_data;
-
-    sqlite3 **db = new sqlite3 *();
+    sqlite3 *conn;
     std::string table;
-    int static callback(void *data, int nCol, char **colValue, char **colNames);
-    int createTable(const std::string tableName);
+    bool inBatch;
+    std::mutex lock;
+
+    // Statements cached for table.
+    sqlite3_stmt *getStmt;
+    sqlite3_stmt *putStmt;
+    sqlite3_stmt *beginStmt;
+    sqlite3_stmt *commitStmt;
+
+    void exec(const std::string &query, const char *op);
+    sqlite3_stmt *prepare(const std::string &query);
+    void prepareStatements();
+    void finalizeStatements();
+    void run(sqlite3_stmt *stmt, const char *op);
+    void upsert(uint64_t key, uint64_t value);
+    void begin();
+    void commit();
 
 public:
+    using DataBase::Get;
+    using DataBase::Put;
     SQLite();
     int Open(const std::string = "db");
     std::string Get(const std::string key);
     std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    void ApplyWriteSet(const RWSet &writes);
+    void ApplyWriteSet(const Overlay &writes);
+    void BeginBatch();
+    void CommitBatch();
     int SelectTable(const std::string tableName);
     int Close(const std::string = "db");
+    #if ISEOV
+    void Init(const std::string value);
+    #endif
 };
 
 
+/**
+ * class InMemoryDB
+ *
+ * Hash table store. With IS_TABLE_DEVIDE the numeric key space is split in
+ * g_table_num partitions of consecutive keys, found from the key without a
+ * lookup. Each partition is split again in stripes holding their own lock,
+ * so readers may run alongside the execute thread.
+ */
 class InMemoryDB : public DataBase
 {
 private:
     using dbTable = std::unordered_map<std::string, std::string>;
 
+    static const uint64_t STRIPE_CNT = 16;
+    struct Stripe
+    {
+        std::mutex lock;
+        dbTable table;
+    };
+    struct Partition
+    {
+        Stripe stripes[STRIPE_CNT];
+    };
+
     std::string activeTable;
     std::unordered_map<std::string, dbTable> *db;
+    std::vector<Partition *> parts; // IS_TABLE_DEVIDE only
+    uint64_t partSize;              // keys per partition
+
+    Stripe &stripeOf(uint64_t key);
+    void storeInt(uint64_t key, uint64_t value);
+    std::string tableName(uint64_t table_id);
 
 public:
+    using DataBase::Get;
+    using DataBase::Put;
     InMemoryDB();
     int Open(const std::string = "db");
     std::string Get(const std::string key);
     std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    void ApplyWriteSet(const RWSet &writes);
+    void ApplyWriteSet(const Overlay &writes);
+    bool SaveSnapshot(const std::string &path);
+    bool LoadSnapshot(const std::string &path);
+    int SelectTable(const std::string tableName);
+    int Close(const std::string = "db");
+    #if ISEOV
+    void Init(const std::string value);
+    #endif
+};
+
+/**
+ * class DenseDB
+ *
+ * In-memory state store for the dense integer key space used by the
+ * benchmarks, i.e. [0, g_account_num * g_ycsb_column). Values live in a
+ * flat, cache-line aligned slot array indexed by the key, so the integer
+ * Get/Put never allocate or parse. Keys outside the array and non-numeric
+ * keys fall back to hash tables, behind a lock, so threads may use distinct
+ * keys at once. A snapshot holds the slot array as is, so
+ * LoadSnapshot maps it in place of the array and pages are only read when
+ * first touched. The digest and the hashes of the Merkle tree are saved
+ * with it, so loading does not read the pages either. With MERKLE_STATE, a
+ * MerkleTree over the slot array gives the root of the state after every
+ * batch and proofs of reads.
+ */
+class DenseDB : public DataBase
+{
+protected:
+    struct Slot
+    {
+        uint64_t value;
+        uint64_t version; // 0 if the key was never written
+    };
+
+    Slot *slots;
+    uint64_t capacity;
+    void *mapBase; // mapping holding slots, anonymous or a snapshot file
+    size_t mapLen;
+    void *leafMap; // snapshot file as loaded, read by a restored tree
+    size_t leafMapLen;
+    std::unordered_map<uint64_t, Slot> overflow;
+    std::unordered_map<std::string, std::string> strTable;
+    std::mutex overflowLock; // guards the lookups and inserts of both tables
+    StateDigest digest; // STATE_DIGEST only
+    MerkleTree *merkle; // MERKLE_STATE only, over the slot array
+
+    Slot *findSlot(uint64_t key);
+    Slot &getSlot(uint64_t key);
+    void rebuildDigest();
+    void rebuildMerkle();
+
+    // Gives slots [first, first + cnt), in place or copied to buf.
+    using SlotReader = std::function<const Slot *(uint64_t first, uint64_t cnt, Slot *buf)>;
+    static const uint64_t SNAP_CHUNK = 4096;
+    bool writeSnapshot(const std::string &path, const SlotReader &read,
+                       const std::unordered_map<uint64_t, Slot> &overflow,
+                       const std::unordered_map<std::string, std::string> &strTable,
+                       const StateDigest *snapDigest, MerkleTree *tree);
+
+public:
+    DenseDB();
+    int Open(const std::string = "db");
+    std::string Get(const std::string key);
+    std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version);
+    void Put(uint64_t key, uint64_t value, uint64_t version);
+    bool Digest(StateDigest &digest);
+    void CommitStateRoot(uint64_t txn_id);
+    bool ProveRead(uint64_t key, MerkleProof &proof);
+    void SetStateRootListener(const MerkleRootListener &listener);
+    bool SaveSnapshot(const std::string &path);
+    bool LoadSnapshot(const std::string &path);
+    int SelectTable(const std::string tableName);
+    int Close(const std::string = "db");
+    #if ISEOV
+    void Init(const std::string value);
+    #endif
+};
+
+/**
+ * class RowDB
+ *
+ * In-memory state store keeping all the columns of a row together in one
+ * fixed-size, cache-line aligned slot: the column values, then the version
+ * of each column. Integer key k is column k % colCnt of row k / colCnt, as
+ * in the YCSB key layout. A whole row is read with one GetRow. A column
+ * has its own version, as a key of the other stores, 0 until it is written
+ * and then bumped by every update, so VERSION_VALIDATE sees the versions
+ * the overlay predicts. Rows outside the array and non-numeric keys fall
+ * back to hash tables.
+ */
+class RowDB : public DataBase
+{
+private:
+    uint64_t *rows;
+    uint64_t rowCnt;
+    uint64_t columns;
+    uint64_t stride; // words per row slot, values then versions
+    std::unordered_map<uint64_t, std::vector<uint64_t>> overflow;
+    std::unordered_map<std::string, std::string> strTable;
+
+    uint64_t *findRow(uint64_t row);
+    uint64_t *getRow(uint64_t row);
+
+public:
+    using DataBase::Get;
+    using DataBase::Put;
+    RowDB();
+    int Open(const std::string = "db");
+    std::string Get(const std::string key);
+    std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version);
+    void Put(uint64_t key, uint64_t value, uint64_t version);
+    void GetRow(uint64_t row, uint64_t colCnt, uint64_t *cols, uint64_t *versions, uint64_t dflt);
+    void PutColumn(uint64_t row, uint64_t colCnt, uint64_t col, uint64_t value);
+    int SelectTable(const std::string tableName);
+    int Close(const std::string = "db");
+    #if ISEOV
+    void Init(const std::string value);
+    #endif
+};
+
+/**
+ * class LogDB
+ *
+ * Durable version of DenseDB. The state is kept in memory as in DenseDB,
+ * and every update is also appended to a write-ahead log. The updates of
+ * a batch (BeginBatch .. CommitBatch) are written and synced as a single
+ * group, updates made outside of a batch are their own group. Every
+ * LOG_SNAPSHOT_PERIOD batches the whole state is written to a compacted
+ * snapshot file and the log restarts empty.
+ *
+ * Open recovers the state from the latest snapshot and replays the log
+ * up to its last complete group. Init only runs on an empty store.
+ */
+class LogDB : public DenseDB
+{
+private:
+    std::string logPath;
+    std::string snapPath;
+    int logFd;
+    std::string logBuf; // records of the group being built
+    bool inBatch;
+    bool recovered;
+    uint64_t batchCnt; // batches committed since the last snapshot
+
+    void flush();
+    size_t applyRecords(const std::string &buf, size_t pos, size_t end);
+    void snapshot();
+    bool loadSnapshot();
+    void replayLog();
+
+public:
+    LogDB();
+    int Open(const std::string = "db");
+    std::string Put(const std::string key, const std::string value);
+    void Put(uint64_t key, uint64_t value);
+    void Put(uint64_t key, uint64_t value, uint64_t version);
+    void BeginBatch();
+    void CommitBatch();
+    // LogDB recovers from its own snapshot and log.
+    bool SaveSnapshot(const std::string &path) { return false; }
+    bool LoadSnapshot(const std::string &path) { return false; }
+    int Close(const std::string = "db");
+    #if ISEOV
+    void Init(const std::string value);
+    #endif
+};
+
+/**
+ * class ConcurrentDB
+ *
+ * DenseDB that many threads may read while the execute thread commits.
+ * Slots are guarded by striped sequence locks: a writer makes the counter
+ * of the stripe odd for the time of the update, and a reader retries until
+ * it reads the same even counter before and after the slot. Readers never
+ * block and writers of distinct stripes do not wait for each other. The
+ * overflow and string tables are guarded by a mutex.
+ *
+ * Each key is updated atomically, not each batch: a reader may see a
+ * batch half committed, which validation of its read set then catches.
+ *
+ * PublishSnapshot gives a consistent image without stopping the writer.
+ * The slot array is split in pages, and the first write to a page after
+ * a snapshot was published copies the page into the snapshot. A snapshot
+ * reads a page from its own copy, else from the copy of the next newer
+ * snapshot, and so on, else from the live array. Pages are only copied
+ * while a snapshot is held by a reader.
+ */
+class ConcurrentDB : public DenseDB
+{
+private:
+    static const uint64_t SEQ_STRIPES = 4096;
+    struct SeqStripe
+    {
+        uint64_t seq;
+        char pad[CL_SIZE - sizeof(uint64_t)];
+    };
+
+    SeqStripe *seqs;
+    std::mutex tableLock;
+
+    static const uint64_t PAGE_SLOTS = 1024;
+    static const uint64_t COPY_LOCKS = 64;
+    uint64_t pageCnt;
+    uint64_t *pageEpoch; // epoch in which each page was last copied
+    uint64_t epoch;      // bumped by every PublishSnapshot
+    std::mutex copyLocks[COPY_LOCKS];
+    StateSnapshot *curSnap; // last published snapshot
+    std::mutex snapLock;    // guards curSnap against AcquireSnapshot
+
+    friend class StateSnapshot;
+
+    uint64_t &seqOf(uint64_t key);
+    uint64_t writeBegin(uint64_t key);
+    void writeEnd(uint64_t key, uint64_t seq);
+    uint64_t readSlot(uint64_t key, uint64_t dflt, uint64_t &version);
+    void preserve(uint64_t key);
+    void dropSnapshot();
+
+public:
+    ConcurrentDB();
+    ~ConcurrentDB();
+    int Open(const std::string = "db");
+    void BeginBatch();
+    void PublishSnapshot(uint64_t txn_id);
+    StateSnapshot *AcquireSnapshot();
+    int Close(const std::string = "db");
+    std::string Get(const std::string key);
+    std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version);
+    void Put(uint64_t key, uint64_t value, uint64_t version);
+};
+
+/**
+ * class StateSnapshot
+ *
+ * Read-only image of a ConcurrentDB as it was after txn TxnId() was
+ * executed. Snapshots are reference counted: AcquireSnapshot takes a
+ * reference and Release gives it back.
+ */
+class StateSnapshot
+{
+public:
+    uint64_t TxnId() const
+    {
+        return txnId;
+    }
+
+    /**
+     * Get the integer value and the version of a key, as in DataBase::Get.
+     */
+    uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version);
+
+    /**
+     * Save the image in the format of DenseDB::SaveSnapshot.
+     */
+    bool Save(const std::string &path);
+
+    void Release();
+
+private:
+    using Slot = ConcurrentDB::Slot;
+    friend class ConcurrentDB;
+
+    ConcurrentDB *db;
+    uint64_t txnId;
+    int64_t refs;
+    Slot **pages;          // page copies, NULL for the pages not copied
+    StateSnapshot *newer;  // next published snapshot, NULL if none yet
+    StateDigest digest;    // STATE_DIGEST only
+    std::unordered_map<uint64_t, Slot> overflow;
+    std::unordered_map<std::string, std::string> strTable;
+
+    StateSnapshot(ConcurrentDB *db, uint64_t txn_id);
+    ~StateSnapshot();
+    Slot *resolve(uint64_t page);
+};
+
+/**
+ * class IndexDB
+ *
+ * In-memory state store whose integer keys are found through the INDEX
+ * structure chosen by INDEX_STRUCT. index_btree keeps the keys in order,
+ * so Scan reads a key range in one pass over the leaves, while IndexHash
+ * looks every key of the range up. The index points every key to a slot
+ * holding its value and version. Slots never move and are only freed by
+ * Close, so readers take no lock. Inserts of new keys are serialized,
+ * updates of existing keys are not. Non-numeric keys fall back to a hash
+ * table guarded by a mutex.
+ *
+ * A reader running alongside a writer of the same key may see the new
+ * value with the old version. Validation of its read set catches it.
+ */
+class IndexDB : public DataBase
+{
+private:
+    struct Slot
+    {
+        uint64_t value;
+        uint64_t version; // 0 if the key was never written
+    };
+
+    static const uint64_t SLOT_CHUNK = 4096;
+
+    INDEX *index;
+    std::vector<Slot *> chunks; // slot arrays, freed by Close
+    uint64_t chunkFree;         // slots left in the last chunk
+    std::mutex insertLock;      // inserts of new keys
+    std::unordered_map<std::string, std::string> strTable;
+    std::mutex tableLock;
+
+    Slot *findSlot(uint64_t key);
+    Slot *getSlot(uint64_t key);
+
+public:
+    IndexDB();
+    int Open(const std::string = "db");
+    std::string Get(const std::string key);
+    std::string Put(const std::string key, const std::string value);
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    uint64_t Get(uint64_t key, uint64_t dflt, uint64_t &version);
+    void Put(uint64_t key, uint64_t value, uint64_t version);
+    void Scan(uint64_t start, uint64_t cnt, uint64_t *values, uint64_t *versions, uint64_t dflt);
     int SelectTable(const std::string tableName);
     int Close(const std::string = "db");
     #if ISEOV
@@ -0,0 +1,106 @@
+#ifndef _DB_UTIL_H_
+#define _DB_UTIL_H_
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+/*
+   File and thread helpers shared by the state stores.
+*/
+
+// Write len bytes, retrying on short writes.
+static inline bool write_all(int fd, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Sync and close a file written as path + ".tmp", then move it to path.
+static inline bool commit_file(int fd, const std::string &path)
+{
+    bool ok = fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    return ok && rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
+/*
+   Map a whole file copy-on-write: pages are read from the file when first
+   touched and updates stay private to the process. Returns NULL if the
+   file cannot be mapped.
+*/
+static inline void *map_file(const std::string &path, size_t &len)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    len = st.st_size;
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return base == MAP_FAILED ? NULL : base;
+}
+
+/*
+   Run fn(begin, end) on cnt items split in ranges over the hardware
+   threads, each thread taking at least min_per_thread items.
+*/
+template <typename F>
+static inline void parallel_for(uint64_t cnt, F fn, uint64_t min_per_thread = 1 << 16)
+{
+    uint64_t thd_cnt = std::thread::hardware_concurrency();
+    if (thd_cnt == 0)
+    {
+        thd_cnt = 1;
+    }
+    if (thd_cnt > cnt / min_per_thread)
+    {
+        thd_cnt = cnt / min_per_thread;
+    }
+    if (thd_cnt <= 1)
+    {
+        fn((uint64_t)0, cnt);
+        return;
+    }
+
+    std::vector<std::thread> thds;
+    uint64_t per_thread = (cnt + thd_cnt - 1) / thd_cnt;
+    for (uint64_t begin = 0; begin < cnt; begin += per_thread)
+    {
+        uint64_t end = begin + per_thread < cnt ? begin + per_thread : cnt;
+        thds.emplace_back(fn, begin, end);
+    }
+    for (auto &thd : thds)
+    {
+        thd.join();
+    }
+}
+
+#endif
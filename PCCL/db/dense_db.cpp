@@ -0,0 +1,477 @@
+#include "database.h"
+#include "../config.h"
+#include "../system/global.h"
+#include "db_util.h"
+#include <unordered_map>
+#include <iostream>
+
+// Snapshot header, followed by the slot array, the overflow slots, the
+// string pairs and the hashes of the Merkle tree.
+struct DenseSnapHeader
+{
+    uint64_t magic;
+    uint64_t capacity;
+    uint64_t slotSize;
+    uint64_t overflowCnt;
+    uint64_t strCnt;
+    uint64_t hasDigest;
+    uint64_t digest[StateDigest::LANES];
+    uint64_t merkleBytes; // 0 if the tree was not saved
+    uint64_t pad[5];      // keeps the slot array cache line aligned
+};
+#define DENSE_SNAP_MAGIC 0x32504e5345534e44ULL // "DNSESNP2"
+
+DenseDB::DenseDB()
+{
+    _dbInstance = "Dense";
+    slots = nullptr;
+    capacity = 0;
+    mapBase = nullptr;
+    mapLen = 0;
+    leafMap = nullptr;
+    leafMapLen = 0;
+    merkle = nullptr;
+}
+
+int DenseDB::Open(const std::string)
+{
+#if BANKING_SMART_CONTRACT
+    capacity = g_account_num + 10;
+#else
+    // YCSB stores column j of row k under key k * g_ycsb_column + j.
+    capacity = max((uint64_t)g_account_num + 10, (uint64_t)g_synth_table_size * g_ycsb_column);
+#endif
+
+    // Anonymous pages are zeroed when first touched, so opening is cheap
+    // even when the state is then loaded from a snapshot.
+    mapLen = capacity * sizeof(Slot);
+    mapBase = mmap(NULL, mapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapBase == MAP_FAILED)
+    {
+        std::cerr << "DenseDB: cannot allocate " << capacity << " slots" << std::endl;
+        mapBase = nullptr;
+        mapLen = 0;
+        assert(0);
+        return 1;
+    }
+    slots = (Slot *)mapBase;
+#if MERKLE_STATE
+    merkle = new MerkleTree(capacity);
+#endif
+
+    std::cout << std::endl
+              << "Dense DB configuration OK, capacity = " << capacity << std::endl;
+
+    return 0;
+}
+
+#if ISEOV
+void DenseDB::Init(const std::string value)
+{
+    uint64_t init_value = std::stoull(value);
+    uint64_t init_num = min(capacity, (uint64_t)g_account_num + 10);
+    parallel_for(init_num, [this, init_value](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++)
+        {
+            slots[i].value = init_value;
+            slots[i].version = 1;
+        }
+    });
+    rebuildDigest();
+    rebuildMerkle();
+
+    std::cout << "DenseDB::Init DONE" << std::endl;
+}
+#endif
+
+DenseDB::Slot *DenseDB::findSlot(uint64_t key)
+{
+    if (key < capacity)
+    {
+        return &slots[key];
+    }
+    // Slots of the table never move, only the lookup needs the lock.
+    std::lock_guard<std::mutex> guard(overflowLock);
+    auto it = overflow.find(key);
+    return it == overflow.end() ? nullptr : &it->second;
+}
+
+DenseDB::Slot &DenseDB::getSlot(uint64_t key)
+{
+    if (key < capacity)
+    {
+        return slots[key];
+    }
+    std::lock_guard<std::mutex> guard(overflowLock);
+    return overflow[key];
+}
+
+uint64_t DenseDB::Get(uint64_t key, uint64_t dflt)
+{
+    Slot *slot = findSlot(key);
+    if (slot == nullptr || slot->version == 0)
+    {
+        return dflt;
+    }
+    return slot->value;
+}
+
+void DenseDB::Put(uint64_t key, uint64_t value)
+{
+    Slot &slot = getSlot(key);
+#if STATE_DIGEST
+    digest.update(key, slot.version != 0, slot.value, value);
+#endif
+#if MERKLE_STATE
+    merkle->Touch(key);
+#endif
+    slot.value = value;
+    slot.version++;
+}
+
+uint64_t DenseDB::Get(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    Slot *slot = findSlot(key);
+    if (slot == nullptr || slot->version == 0)
+    {
+        version = 0;
+        return dflt;
+    }
+    version = slot->version;
+    return slot->value;
+}
+
+void DenseDB::Put(uint64_t key, uint64_t value, uint64_t version)
+{
+    Slot &slot = getSlot(key);
+#if STATE_DIGEST
+    digest.update(key, slot.version != 0, slot.value, value);
+#endif
+#if MERKLE_STATE
+    merkle->Touch(key);
+#endif
+    slot.value = value;
+    slot.version = version;
+}
+
+/*
+   Compute the digest from the whole state, after the state was built
+   without going through Put. Does nothing without STATE_DIGEST.
+*/
+void DenseDB::rebuildDigest()
+{
+#if STATE_DIGEST
+    digest.clear();
+    parallel_for(capacity, [this](uint64_t begin, uint64_t end) {
+        StateDigest part;
+        for (uint64_t key = begin; key < end; key++)
+        {
+            if (slots[key].version != 0)
+            {
+                part.add(key, slots[key].value);
+            }
+        }
+        digest.merge(part);
+    });
+    StateDigest part;
+    for (const auto &item : overflow)
+    {
+        if (item.second.version != 0)
+        {
+            part.add(item.first, item.second.value);
+        }
+    }
+    digest.merge(part);
+#endif
+}
+
+// Hash the whole state into the tree. Does nothing without MERKLE_STATE.
+void DenseDB::rebuildMerkle()
+{
+#if MERKLE_STATE
+    merkle->Build((const uint64_t *)slots);
+#endif
+}
+
+void DenseDB::CommitStateRoot(uint64_t txn_id)
+{
+#if MERKLE_STATE
+    merkle->Commit(txn_id, (const uint64_t *)slots);
+#endif
+}
+
+bool DenseDB::ProveRead(uint64_t key, MerkleProof &proof)
+{
+    return merkle != nullptr && merkle->Prove(key, proof);
+}
+
+void DenseDB::SetStateRootListener(const MerkleRootListener &listener)
+{
+    if (merkle != nullptr)
+    {
+        merkle->SetListener(listener);
+    }
+}
+
+bool DenseDB::Digest(StateDigest &digest)
+{
+#if STATE_DIGEST
+    for (int i = 0; i < StateDigest::LANES; i++)
+    {
+        digest.lanes[i] = __atomic_load_n(&this->digest.lanes[i], __ATOMIC_RELAXED);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string DenseDB::Get(const std::string key)
+{
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(overflowLock);
+        auto it = strTable.find(key);
+        return it == strTable.end() ? std::string() : it->second;
+    }
+
+    Slot *slot = findSlot(k);
+    if (slot == nullptr || slot->version == 0)
+    {
+        return std::string();
+    }
+    return numericString(k, slot->value);
+}
+
+std::string DenseDB::Put(const std::string key, const std::string value)
+{
+    // The key alone tells where it lives, as in Get.
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(overflowLock);
+        std::string oldValue = strTable[key];
+        strTable[key] = value;
+        return oldValue;
+    }
+
+    std::string oldValue = Get(key);
+    putNumeric(k, value);
+    return oldValue;
+}
+
+bool DenseDB::SaveSnapshot(const std::string &path)
+{
+    SlotReader live = [this](uint64_t first, uint64_t cnt, Slot *buf) -> const Slot * {
+        return slots + first;
+    };
+#if MERKLE_STATE
+    // The saved hashes must be those of the slots written.
+    merkle->Sync();
+#endif
+    return writeSnapshot(path, live, overflow, strTable, STATE_DIGEST ? &digest : nullptr, merkle);
+}
+
+/*
+   Write a snapshot whose slot array is given by read, by ranges of at most
+   SNAP_CHUNK slots. snapDigest and tree, if not NULL, are those of the
+   state written.
+*/
+bool DenseDB::writeSnapshot(const std::string &path, const SlotReader &read,
+                            const std::unordered_map<uint64_t, Slot> &overflow,
+                            const std::unordered_map<std::string, std::string> &strTable,
+                            const StateDigest *snapDigest, MerkleTree *tree)
+{
+    int fd = open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "DenseDB: cannot write snapshot " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    DenseSnapHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DENSE_SNAP_MAGIC;
+    hdr.capacity = capacity;
+    hdr.slotSize = sizeof(Slot);
+    hdr.overflowCnt = overflow.size();
+    hdr.strCnt = strTable.size();
+    if (snapDigest != nullptr)
+    {
+        hdr.hasDigest = 1;
+        for (int i = 0; i < StateDigest::LANES; i++)
+        {
+            hdr.digest[i] = __atomic_load_n(&snapDigest->lanes[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    std::string tail;
+    for (const auto &item : overflow)
+    {
+        tail.append((const char *)&item.first, sizeof(uint64_t));
+        tail.append((const char *)&item.second, sizeof(Slot));
+    }
+    for (const auto &item : strTable)
+    {
+        uint32_t len[2] = {(uint32_t)item.first.size(), (uint32_t)item.second.size()};
+        tail.append((const char *)len, sizeof(len));
+        tail.append(item.first);
+        tail.append(item.second);
+    }
+    if (tree != nullptr)
+    {
+        std::string nodes;
+        tree->SaveNodes(nodes);
+        hdr.merkleBytes = nodes.size();
+        tail.append(nodes);
+    }
+
+    bool ok = write_all(fd, &hdr, sizeof(hdr));
+    std::vector<Slot> buf(SNAP_CHUNK);
+    for (uint64_t first = 0; first < capacity && ok; first += SNAP_CHUNK)
+    {
+        uint64_t cnt = min((uint64_t)SNAP_CHUNK, capacity - first);
+        ok = write_all(fd, read(first, cnt, buf.data()), cnt * sizeof(Slot));
+    }
+    ok = ok && write_all(fd, tail.data(), tail.size());
+    ok = commit_file(fd, path) && ok;
+    if (!ok)
+    {
+        std::cerr << "DenseDB: cannot write snapshot " << path << ": " << strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+bool DenseDB::LoadSnapshot(const std::string &path)
+{
+    size_t len = 0;
+    char *base = (char *)map_file(path, len);
+    if (base == nullptr)
+    {
+        return false;
+    }
+
+    DenseSnapHeader *hdr = (DenseSnapHeader *)base;
+    size_t pos = sizeof(DenseSnapHeader) + capacity * sizeof(Slot);
+    if (len < sizeof(DenseSnapHeader) || hdr->magic != DENSE_SNAP_MAGIC ||
+        hdr->capacity != capacity || hdr->slotSize != sizeof(Slot) || len < pos)
+    {
+        std::cerr << "DenseDB: snapshot " << path << " does not match this configuration" << std::endl;
+        munmap(base, len);
+        return false;
+    }
+
+    std::unordered_map<uint64_t, Slot> snapOverflow;
+    std::unordered_map<std::string, std::string> snapStr;
+    bool ok = true;
+    for (uint64_t i = 0; i < hdr->overflowCnt && ok; i++)
+    {
+        ok = pos + sizeof(uint64_t) + sizeof(Slot) <= len;
+        if (ok)
+        {
+            uint64_t key;
+            memcpy(&key, base + pos, sizeof(uint64_t));
+            memcpy(&snapOverflow[key], base + pos + sizeof(uint64_t), sizeof(Slot));
+            pos += sizeof(uint64_t) + sizeof(Slot);
+        }
+    }
+    for (uint64_t i = 0; i < hdr->strCnt && ok; i++)
+    {
+        uint32_t klen[2];
+        ok = pos + sizeof(klen) <= len;
+        if (ok)
+        {
+            memcpy(klen, base + pos, sizeof(klen));
+            pos += sizeof(klen);
+            ok = pos + klen[0] + klen[1] <= len;
+        }
+        if (ok)
+        {
+            snapStr[std::string(base + pos, klen[0])] = std::string(base + pos + klen[0], klen[1]);
+            pos += klen[0] + klen[1];
+        }
+    }
+    size_t nodesPos = pos;
+    ok = ok && nodesPos + hdr->merkleBytes <= len;
+    if (!ok)
+    {
+        std::cerr << "DenseDB: snapshot " << path << " is truncated" << std::endl;
+        munmap(base, len);
+        return false;
+    }
+
+    // The mapped slot array replaces the current one.
+    munmap(mapBase, mapLen);
+    mapBase = base;
+    mapLen = len;
+    slots = (Slot *)(base + sizeof(DenseSnapHeader));
+    overflow.swap(snapOverflow);
+    strTable.swap(snapStr);
+
+    // Both are restored from the snapshot when it has them, as rebuilding
+    // them reads every page.
+#if STATE_DIGEST
+    if (hdr->hasDigest)
+    {
+        memcpy(digest.lanes, hdr->digest, sizeof(digest.lanes));
+    }
+    else
+    {
+        rebuildDigest();
+    }
+#endif
+#if MERKLE_STATE
+    if (leafMap != nullptr)
+    {
+        munmap(leafMap, leafMapLen);
+        leafMap = nullptr;
+    }
+    if (hdr->merkleBytes != 0 && hdr->merkleBytes == merkle->NodeBytes())
+    {
+        // The writes to the slots go to private copies of the pages, so a
+        // second mapping keeps the leaves as saved for the tree.
+        leafMap = map_file(path, leafMapLen);
+    }
+    if (leafMap != nullptr)
+    {
+        merkle->Restore(base + nodesPos, (const uint64_t *)((char *)leafMap + sizeof(DenseSnapHeader)));
+    }
+    else
+    {
+        rebuildMerkle();
+    }
+#endif
+
+    std::cout << "DenseDB: state mapped from " << path << std::endl;
+    return true;
+}
+
+int DenseDB::SelectTable(const std::string tableName)
+{
+    // A single flat table; table names are ignored.
+    return 0;
+}
+
+int DenseDB::Close(const std::string)
+{
+    delete merkle;
+    merkle = nullptr;
+    if (leafMap != nullptr)
+    {
+        munmap(leafMap, leafMapLen);
+    }
+    leafMap = nullptr;
+    leafMapLen = 0;
+    if (mapBase != nullptr)
+    {
+        munmap(mapBase, mapLen);
+    }
+    mapBase = nullptr;
+    mapLen = 0;
+    slots = nullptr;
+    capacity = 0;
+    overflow.clear();
+    strTable.clear();
+    return 0;
+}
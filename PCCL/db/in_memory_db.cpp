@@ -1,18 +1,48 @@
 #include "database.h"
 #include "../config.h"
 #include "../system/global.h"
+#include "db_util.h"
 #include <unordered_map>
 #include <iostream>
 
+/*
+   Snapshot format: IN_MEMORY_SNAP_MAGIC, the table count, then for each
+   table [uint32_t name length][name][uint64_t entry count][uint64_t byte
+   length] followed by its entries, [uint32_t klen][uint32_t vlen][key]
+   [value]. Sections carry their length so they can be loaded in parallel.
+*/
+#define IN_MEMORY_SNAP_MAGIC 0x50414e53594d454dULL // "MEMYSNAP"
+
+template <typename T>
+static inline bool snap_read(const char *base, size_t &pos, size_t end, T &val)
+{
+    if (pos + sizeof(T) > end)
+    {
+        return false;
+    }
+    memcpy(&val, base + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
 InMemoryDB::InMemoryDB()
 {
     _dbInstance = "InMemory";
+    db = nullptr;
+    partSize = 1;
 }
 
 int InMemoryDB::Open(const std::string)
 {
     db = new std::unordered_map<std::string, dbTable>();
     activeTable = "table1";
+#if IS_TABLE_DEVIDE
+    partSize = max((uint64_t)g_account_num / g_table_num, (uint64_t)1);
+    for (uint64_t table_id = 0; table_id < g_table_num; table_id++)
+    {
+        parts.push_back(new Partition());
+    }
+#endif
 
     std::cout << std::endl
               << "In-Memory DB configuration OK" << std::endl;
@@ -20,22 +50,46 @@ int InMemoryDB::Open(const std::string)
     return 0;
 }
 
+std::string InMemoryDB::tableName(uint64_t table_id)
+{
+    return string("table") + to_string(table_id);
+}
+
+// Keys past the last partition belong to it.
+InMemoryDB::Stripe &InMemoryDB::stripeOf(uint64_t key)
+{
+    uint64_t table_id = min(key / partSize, (uint64_t)parts.size() - 1);
+    return parts[table_id]->stripes[key % STRIPE_CNT];
+}
+
 #if ISEOV
     void InMemoryDB::Init(const std::string value)
     {
     #if IS_TABLE_DEVIDE
-        for (uint64_t table_id = 0; table_id < g_table_num; table_id ++)
-        {
-            string table = string("table") + to_string(table_id);
-            uint64_t acc_num_single_table = g_account_num / g_table_num;
-            for(uint64_t i = 0; i < acc_num_single_table + 10; i++){
-                (*db)[table][std::to_string(i + table_id * acc_num_single_table)] = value;
+        // One thread per partition, before any reader runs.
+        uint64_t part_cnt = parts.size();
+        parallel_for(part_cnt, [&](uint64_t begin, uint64_t end) {
+            for (uint64_t table_id = begin; table_id < end; table_id++)
+            {
+                uint64_t first = table_id * partSize;
+                uint64_t last = table_id + 1 == part_cnt ? (uint64_t)g_account_num + 10 : first + partSize;
+                Partition *part = parts[table_id];
+                for (uint64_t s = 0; s < STRIPE_CNT; s++)
+                {
+                    part->stripes[s].table.reserve((last - first) / STRIPE_CNT + 1);
+                }
+                for (uint64_t i = first; i < last; i++)
+                {
+                    part->stripes[i % STRIPE_CNT].table[std::to_string(i)] = value;
+                }
             }
-        }
+        }, 1);
 
     #else
+        dbTable &table = (*db)[activeTable];
+        table.reserve(g_account_num + 10);
         for(uint64_t i = 0; i < g_account_num + 10; i++){
-            (*db)[activeTable][std::to_string(i)] = value;
+            table[std::to_string(i)] = value;
         }
     #endif
 
@@ -46,23 +100,11 @@ int InMemoryDB::Open(const std::string)
 
 std::string InMemoryDB::Get(const std::string key)
 {
-// #if ISEOV
-//     if((*db)[activeTable][key].empty()){
-//         (*db)[activeTable][key] = "10000";
-//         //return "10000";
-//     }
-//     return (*db)[activeTable][key];
-// #else
-//     return (*db)[activeTable][key];
-// #endif
 #if IS_TABLE_DEVIDE
-    //DEBUG_V1("test_table: Get(const std::string key), key = %s\n", key);
-    //cout << "test_table: Get(const std::string key), key = " << key << endl;
-    uint64_t key_int = stoi(key);
-    uint64_t table_id = key_int / (g_account_num / g_table_num);
-    string table = string("table") + to_string(table_id);
-    return (*db)[table][key];
-
+    Stripe &stripe = stripeOf(strtoull(key.c_str(), NULL, 10));
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    auto it = stripe.table.find(key);
+    return it == stripe.table.end() ? std::string() : it->second;
 #else
     return (*db)[activeTable][key];
 #endif
@@ -71,11 +113,11 @@ std::string InMemoryDB::Get(const std::string key)
 std::string InMemoryDB::Put(const std::string key, const std::string value)
 {
 #if IS_TABLE_DEVIDE
-    std::string oldValue = Get(key);
-    uint64_t key_int = stoi(key);
-    uint64_t table_id = key_int / (g_account_num / g_table_num);
-    string table = string("table") + to_string(table_id);
-    (*db)[table][key] = value;
+    Stripe &stripe = stripeOf(strtoull(key.c_str(), NULL, 10));
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    std::string &slot = stripe.table[key];
+    std::string oldValue = slot;
+    slot = value;
     return oldValue;
 #else
     std::string oldValue = Get(key);
@@ -84,6 +126,250 @@ std::string InMemoryDB::Put(const std::string key, const std::string value)
 #endif
 }
 
+uint64_t InMemoryDB::Get(uint64_t key, uint64_t dflt)
+{
+#if IS_TABLE_DEVIDE
+    Stripe &stripe = stripeOf(key);
+    std::string value;
+    {
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        auto it = stripe.table.find(std::to_string(key));
+        if (it != stripe.table.end())
+        {
+            value = it->second;
+        }
+    }
+#else
+    std::string value = Get(std::to_string(key));
+#endif
+    return value.empty() ? dflt : std::stoull(value);
+}
+
+void InMemoryDB::Put(uint64_t key, uint64_t value)
+{
+    storeInt(key, value);
+}
+
+void InMemoryDB::storeInt(uint64_t key, uint64_t value)
+{
+#if IS_TABLE_DEVIDE
+    Stripe &stripe = stripeOf(key);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    stripe.table[std::to_string(key)] = std::to_string(value);
+#else
+    (*db)[activeTable][std::to_string(key)] = std::to_string(value);
+#endif
+}
+
+void InMemoryDB::ApplyWriteSet(const RWSet &writes)
+{
+#if !IS_TABLE_DEVIDE
+    dbTable &table = (*db)[activeTable];
+    table.reserve(table.size() + writes.size());
+#endif
+    for (const auto &item : writes)
+    {
+        storeValue(item.first, item.buf);
+        storeInt(item.first, item.second);
+    }
+}
+
+// Versions are not kept, only the values are written.
+void InMemoryDB::ApplyWriteSet(const Overlay &writes)
+{
+#if !IS_TABLE_DEVIDE
+    dbTable &table = (*db)[activeTable];
+    table.reserve(table.size() + writes.size());
+#endif
+    for (const auto &item : writes)
+    {
+        storeValue(item.first, item.second.buf.get());
+        storeInt(item.first, item.second.value);
+    }
+}
+
+// Append the entries of table to buf.
+static void snap_table(std::string &buf, const std::unordered_map<std::string, std::string> &table)
+{
+    for (const auto &item : table)
+    {
+        uint32_t len[2] = {(uint32_t)item.first.size(), (uint32_t)item.second.size()};
+        buf.append((const char *)len, sizeof(len));
+        buf.append(item.first);
+        buf.append(item.second);
+    }
+}
+
+static bool snap_section(int fd, const std::string &name, uint64_t cnt, const std::string &buf)
+{
+    uint32_t nameLen = name.size();
+    uint64_t section[2] = {cnt, buf.size()};
+    return write_all(fd, &nameLen, sizeof(nameLen)) &&
+           write_all(fd, name.data(), nameLen) &&
+           write_all(fd, section, sizeof(section)) &&
+           write_all(fd, buf.data(), buf.size());
+}
+
+/*
+   With IS_TABLE_DEVIDE there is one section per partition, named as the
+   table of the original layout.
+*/
+bool InMemoryDB::SaveSnapshot(const std::string &path)
+{
+    int fd = open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "InMemoryDB: cannot write snapshot " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    uint64_t hdr[2] = {IN_MEMORY_SNAP_MAGIC, db->size() + parts.size()};
+    bool ok = write_all(fd, hdr, sizeof(hdr));
+    std::string buf;
+    for (const auto &table : *db)
+    {
+        if (!ok)
+        {
+            break;
+        }
+        buf.clear();
+        snap_table(buf, table.second);
+        ok = snap_section(fd, table.first, table.second.size(), buf);
+    }
+    for (uint64_t table_id = 0; table_id < parts.size() && ok; table_id++)
+    {
+        buf.clear();
+        uint64_t cnt = 0;
+        for (Stripe &stripe : parts[table_id]->stripes)
+        {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            snap_table(buf, stripe.table);
+            cnt += stripe.table.size();
+        }
+        ok = snap_section(fd, tableName(table_id), cnt, buf);
+    }
+    ok = commit_file(fd, path) && ok;
+    if (!ok)
+    {
+        std::cerr << "InMemoryDB: cannot write snapshot " << path << ": " << strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+/*
+   The hash tables are rebuilt from the mapped file, one section per thread,
+   and replace the current state only if the whole file is valid.
+*/
+bool InMemoryDB::LoadSnapshot(const std::string &path)
+{
+    size_t len = 0;
+    const char *base = (const char *)map_file(path, len);
+    if (base == nullptr)
+    {
+        return false;
+    }
+
+    struct Section
+    {
+        dbTable *table;  // either a named table
+        Partition *part; // or a partition
+        uint64_t cnt;
+        size_t begin, end;
+    };
+    auto *snapDb = new std::unordered_map<std::string, dbTable>();
+    vector<Partition *> snapParts(parts.size(), nullptr);
+    vector<Section> sections;
+    size_t pos = 0;
+    uint64_t magic = 0, tableCnt = 0;
+    bool ok = snap_read(base, pos, len, magic) && magic == IN_MEMORY_SNAP_MAGIC &&
+              snap_read(base, pos, len, tableCnt);
+    for (uint64_t i = 0; i < tableCnt && ok; i++)
+    {
+        uint32_t nameLen;
+        Section s = {nullptr, nullptr, 0, 0, 0};
+        ok = snap_read(base, pos, len, nameLen) && pos + nameLen <= len;
+        if (!ok)
+        {
+            break;
+        }
+        std::string name(base + pos, nameLen);
+        pos += nameLen;
+        for (uint64_t table_id = 0; table_id < parts.size() && s.part == nullptr; table_id++)
+        {
+            if (snapParts[table_id] == nullptr && name == tableName(table_id))
+            {
+                s.part = snapParts[table_id] = new Partition();
+            }
+        }
+        if (s.part == nullptr)
+        {
+            s.table = &(*snapDb)[name];
+        }
+        uint64_t bytes;
+        ok = snap_read(base, pos, len, s.cnt) && snap_read(base, pos, len, bytes) && pos + bytes <= len;
+        s.begin = pos;
+        s.end = pos + bytes;
+        pos = s.end;
+        sections.push_back(s);
+    }
+    for (uint64_t table_id = 0; table_id < parts.size() && ok; table_id++)
+    {
+        ok = snapParts[table_id] != nullptr;
+    }
+
+    vector<uint8_t> valid(sections.size(), 0);
+    if (ok)
+    {
+        parallel_for(sections.size(), [&](uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; i++)
+            {
+                Section &s = sections[i];
+                if (s.table != nullptr)
+                {
+                    s.table->reserve(s.cnt);
+                }
+                size_t p = s.begin;
+                uint64_t n = 0;
+                uint32_t klen[2];
+                for (; n < s.cnt && snap_read(base, p, s.end, klen) && p + klen[0] + klen[1] <= s.end; n++)
+                {
+                    std::string key(base + p, klen[0]);
+                    dbTable &table = s.table != nullptr ? *s.table
+                                     : s.part->stripes[strtoull(key.c_str(), NULL, 10) % STRIPE_CNT].table;
+                    table[key] = std::string(base + p + klen[0], klen[1]);
+                    p += klen[0] + klen[1];
+                }
+                valid[i] = n == s.cnt && p == s.end;
+            }
+        }, 1);
+        for (uint8_t v : valid)
+        {
+            ok = ok && v;
+        }
+    }
+    munmap((void *)base, len);
+
+    if (!ok)
+    {
+        std::cerr << "InMemoryDB: snapshot " << path << " is invalid" << std::endl;
+        delete snapDb;
+        for (Partition *part : snapParts)
+        {
+            delete part;
+        }
+        return false;
+    }
+    delete db;
+    db = snapDb;
+    for (uint64_t table_id = 0; table_id < parts.size(); table_id++)
+    {
+        delete parts[table_id];
+        parts[table_id] = snapParts[table_id];
+    }
+    std::cout << "InMemoryDB: state loaded from " << path << std::endl;
+    return true;
+}
+
 int InMemoryDB::SelectTable(const std::string tableName)
 {
     if (tableName == activeTable)
@@ -97,5 +383,11 @@ int InMemoryDB::SelectTable(const std::string tableName)
 int InMemoryDB::Close(const std::string)
 {
     delete db;
+    db = nullptr;
+    for (Partition *part : parts)
+    {
+        delete part;
+    }
+    parts.clear();
     return 0;
 }
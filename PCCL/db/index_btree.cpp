@@ -0,0 +1,427 @@
+#include "index_btree.h"
+#include <new>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+// Give the writer holding a node the time to finish after some restarts.
+static inline void backoff(uint64_t &restarts)
+{
+    if (++restarts % 16 == 0)
+    {
+        std::this_thread::yield();
+    }
+}
+
+index_btree::index_btree()
+{
+    root.store(newNode<Leaf>(), std::memory_order_relaxed);
+}
+
+index_btree::~index_btree()
+{
+    freeNode(root.load(std::memory_order_relaxed));
+}
+
+// Zeroed and cache line aligned.
+template <typename T>
+T *index_btree::newNode()
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, 64, sizeof(T)) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    memset(ptr, 0, sizeof(T));
+    T *node = new (ptr) T();
+    node->leaf = std::is_same<T, Leaf>::value;
+    return node;
+}
+
+void index_btree::freeNode(Node *node)
+{
+    if (!node->leaf)
+    {
+        Inner *inner = (Inner *)node;
+        for (uint32_t i = 0; i <= inner->count; i++)
+        {
+            freeNode(inner->children[i]);
+        }
+    }
+    free(node);
+}
+
+// Note the version of node, false if a writer holds it.
+bool index_btree::readLock(Node *node, uint64_t &version)
+{
+    version = node->version.load(std::memory_order_acquire);
+    return (version & LOCKED) == 0;
+}
+
+// Whether node did not change since its version was noted.
+bool index_btree::validate(Node *node, uint64_t version)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return node->version.load(std::memory_order_relaxed) == version;
+}
+
+// Lock node, false if it changed since its version was noted.
+bool index_btree::upgrade(Node *node, uint64_t version)
+{
+    return node->version.compare_exchange_strong(version, version + LOCKED, std::memory_order_acq_rel);
+}
+
+void index_btree::writeUnlock(Node *node)
+{
+    node->version.fetch_add(LOCKED, std::memory_order_release);
+}
+
+/*
+   The child of inner holding key. The count is bounded as a reader may
+   see a node being changed, its result is then dropped by validate.
+*/
+uint32_t index_btree::childOf(Inner *inner, uint64_t key)
+{
+    uint32_t lo = 0, hi = inner->count < INNER_CAP ? inner->count : INNER_CAP;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (inner->keys[mid] <= key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Position of the first key of leaf not lower than key.
+uint32_t index_btree::leafPos(Leaf *leaf, uint64_t key)
+{
+    uint32_t lo = 0, hi = leaf->count < LEAF_CAP ? leaf->count : LEAF_CAP;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (leaf->keys[mid] < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Move the upper half of inner to a new node. sep moves up to the parent.
+index_btree::Inner *index_btree::splitInner(Inner *inner, uint64_t &sep)
+{
+    Inner *right = newNode<Inner>();
+    uint32_t mid = inner->count / 2;
+    sep = inner->keys[mid];
+    right->count = inner->count - mid - 1;
+    memcpy(right->keys, inner->keys + mid + 1, sizeof(uint64_t) * right->count);
+    memcpy(right->children, inner->children + mid + 1, sizeof(Node *) * (right->count + 1));
+    inner->count = mid;
+    return right;
+}
+
+/*
+   Move the upper half of leaf to a new leaf. When key goes past the last
+   leaf, as when keys are loaded in order, the new leaf starts empty so
+   that leaves are left full.
+*/
+index_btree::Leaf *index_btree::splitLeaf(Leaf *leaf, uint64_t key, uint64_t &sep)
+{
+    Leaf *right = newNode<Leaf>();
+    uint32_t mid = leaf->count / 2;
+    if (leaf->next == nullptr && key > leaf->keys[leaf->count - 1])
+    {
+        mid = leaf->count;
+    }
+    right->count = leaf->count - mid;
+    memcpy(right->keys, leaf->keys + mid, sizeof(uint64_t) * right->count);
+    memcpy(right->items, leaf->items + mid, sizeof(uint64_t) * right->count);
+    sep = right->count > 0 ? right->keys[0] : key;
+    right->next = leaf->next;
+    leaf->next = right;
+    leaf->count = mid;
+    return right;
+}
+
+// Add the node right of a split child, inner not being full.
+void index_btree::insertInner(Inner *inner, uint64_t sep, Node *right)
+{
+    uint32_t pos = childOf(inner, sep);
+    memmove(inner->keys + pos + 1, inner->keys + pos, sizeof(uint64_t) * (inner->count - pos));
+    memmove(inner->children + pos + 2, inner->children + pos + 1, sizeof(Node *) * (inner->count - pos));
+    inner->keys[pos] = sep;
+    inner->children[pos + 1] = right;
+    inner->count++;
+}
+
+// Called with the old root locked, which keeps other splits of it out.
+void index_btree::makeRoot(uint64_t sep, Node *left, Node *right)
+{
+    Inner *inner = newNode<Inner>();
+    inner->count = 1;
+    inner->keys[0] = sep;
+    inner->children[0] = left;
+    inner->children[1] = right;
+    root.store(inner, std::memory_order_release);
+}
+
+void index_btree::index_insert(uint64_t key, uint64_t item)
+{
+    uint64_t restarts = 0;
+restart:
+    backoff(restarts);
+
+    Node *node = root.load(std::memory_order_acquire);
+    uint64_t version;
+    if (!readLock(node, version) || node != root.load(std::memory_order_acquire))
+    {
+        goto restart;
+    }
+    Inner *parent = nullptr;
+    uint64_t parentVersion = 0;
+
+    while (!node->leaf)
+    {
+        Inner *inner = (Inner *)node;
+        if (inner->count == INNER_CAP)
+        {
+            // Split on the way down, so the parent of a split has room.
+            if (parent != nullptr && !upgrade(parent, parentVersion))
+            {
+                goto restart;
+            }
+            if (!upgrade(inner, version))
+            {
+                if (parent != nullptr)
+                {
+                    writeUnlock(parent);
+                }
+                goto restart;
+            }
+            if (parent == nullptr && inner != root.load(std::memory_order_acquire))
+            {
+                writeUnlock(inner);
+                goto restart;
+            }
+            uint64_t sep;
+            Inner *right = splitInner(inner, sep);
+            if (parent != nullptr)
+            {
+                insertInner(parent, sep, right);
+            }
+            else
+            {
+                makeRoot(sep, inner, right);
+            }
+            writeUnlock(inner);
+            if (parent != nullptr)
+            {
+                writeUnlock(parent);
+            }
+            goto restart;
+        }
+
+        if (parent != nullptr && !validate(parent, parentVersion))
+        {
+            goto restart;
+        }
+        parent = inner;
+        parentVersion = version;
+        node = inner->children[childOf(inner, key)];
+        if (!validate(inner, version) || node == nullptr || !readLock(node, version))
+        {
+            goto restart;
+        }
+    }
+
+    Leaf *leaf = (Leaf *)node;
+    uint32_t pos = leafPos(leaf, key);
+    bool found = pos < leaf->count && leaf->keys[pos] == key;
+    if (!found && leaf->count == LEAF_CAP)
+    {
+        if (parent != nullptr && !upgrade(parent, parentVersion))
+        {
+            goto restart;
+        }
+        if (!upgrade(leaf, version))
+        {
+            if (parent != nullptr)
+            {
+                writeUnlock(parent);
+            }
+            goto restart;
+        }
+        if (parent == nullptr && leaf != root.load(std::memory_order_acquire))
+        {
+            writeUnlock(leaf);
+            goto restart;
+        }
+        uint64_t sep;
+        Leaf *right = splitLeaf(leaf, key, sep);
+        if (parent != nullptr)
+        {
+            insertInner(parent, sep, right);
+        }
+        else
+        {
+            makeRoot(sep, leaf, right);
+        }
+        writeUnlock(leaf);
+        if (parent != nullptr)
+        {
+            writeUnlock(parent);
+        }
+        goto restart;
+    }
+
+    // The noted version vouches for pos and found once the leaf is locked.
+    if (!upgrade(leaf, version))
+    {
+        goto restart;
+    }
+    if (parent != nullptr && !validate(parent, parentVersion))
+    {
+        writeUnlock(leaf);
+        goto restart;
+    }
+    if (found)
+    {
+        leaf->items[pos] = item;
+    }
+    else
+    {
+        memmove(leaf->keys + pos + 1, leaf->keys + pos, sizeof(uint64_t) * (leaf->count - pos));
+        memmove(leaf->items + pos + 1, leaf->items + pos, sizeof(uint64_t) * (leaf->count - pos));
+        leaf->keys[pos] = key;
+        leaf->items[pos] = item;
+        leaf->count++;
+    }
+    writeUnlock(leaf);
+}
+
+/*
+   The leaf that holds key, with its noted version, or NULL if the path
+   changed on the way down. The parent is checked once the leaf version
+   is noted, so the leaf did not split away from key before.
+*/
+index_btree::Leaf *index_btree::findLeaf(uint64_t key, uint64_t &version)
+{
+    Node *node = root.load(std::memory_order_acquire);
+    if (!readLock(node, version) || node != root.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    Inner *parent = nullptr;
+    uint64_t parentVersion = 0;
+    while (!node->leaf)
+    {
+        Inner *inner = (Inner *)node;
+        if (parent != nullptr && !validate(parent, parentVersion))
+        {
+            return nullptr;
+        }
+        parent = inner;
+        parentVersion = version;
+        node = inner->children[childOf(inner, key)];
+        if (!validate(inner, version) || node == nullptr || !readLock(node, version))
+        {
+            return nullptr;
+        }
+    }
+    if (parent != nullptr && !validate(parent, parentVersion))
+    {
+        return nullptr;
+    }
+    return (Leaf *)node;
+}
+
+bool index_btree::index_read(uint64_t key, uint64_t &item)
+{
+    uint64_t restarts = 0;
+    while (true)
+    {
+        uint64_t version;
+        Leaf *leaf = findLeaf(key, version);
+        if (leaf != nullptr)
+        {
+            uint32_t pos = leafPos(leaf, key);
+            bool found = pos < leaf->count && leaf->keys[pos] == key;
+            uint64_t value = found ? leaf->items[pos] : 0;
+            if (validate(leaf, version))
+            {
+                item = value;
+                return found;
+            }
+        }
+        backoff(restarts);
+    }
+}
+
+uint64_t index_btree::index_scan(uint64_t lo, uint64_t hi, uint64_t *keys, uint64_t *items, uint64_t max)
+{
+    uint64_t cnt = 0;
+    uint64_t restarts = 0;
+    uint64_t bufKeys[LEAF_CAP];
+    uint64_t bufItems[LEAF_CAP];
+
+    // Keys from lo on are still to be read.
+    while (lo < hi && cnt < max)
+    {
+        uint64_t version;
+        Leaf *leaf = findLeaf(lo, version);
+        while (leaf != nullptr)
+        {
+            // Copy the keys of the leaf, kept if the leaf did not change.
+            uint32_t count = leaf->count < LEAF_CAP ? leaf->count : LEAF_CAP;
+            uint32_t pos = leafPos(leaf, lo);
+            uint64_t n = 0;
+            bool done = false;
+            for (; pos < count; pos++)
+            {
+                if (leaf->keys[pos] >= hi || cnt + n == max)
+                {
+                    done = true;
+                    break;
+                }
+                bufKeys[n] = leaf->keys[pos];
+                bufItems[n] = leaf->items[pos];
+                n++;
+            }
+            Leaf *next = leaf->next;
+            if (!validate(leaf, version))
+            {
+                break;
+            }
+
+            memcpy(keys + cnt, bufKeys, sizeof(uint64_t) * n);
+            memcpy(items + cnt, bufItems, sizeof(uint64_t) * n);
+            cnt += n;
+            if (n > 0)
+            {
+                lo = bufKeys[n - 1] + 1;
+            }
+            if (done || next == nullptr)
+            {
+                return cnt;
+            }
+            leaf = next;
+            if (!readLock(leaf, version))
+            {
+                break;
+            }
+        }
+        backoff(restarts);
+    }
+    return cnt;
+}
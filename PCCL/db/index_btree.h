@@ -0,0 +1,92 @@
+#ifndef _INDEX_BTREE_H_
+#define _INDEX_BTREE_H_
+
+#include <atomic>
+#include <stdint.h>
+
+// Bytes per node, a whole number of cache lines.
+#define BTREE_NODE_SIZE 1024
+
+/*
+   Concurrent B+-tree from integer keys to 64 bit items, with optimistic
+   lock coupling. Every node holds a version, with a lock bit set while a
+   writer changes the node and bumped when it is done. Readers take no
+   lock: they note the version of a node, read it, and check the version
+   did not change, else restart from the root. A writer locks a node by
+   moving its noted version to the locked one, so it fails if the node
+   changed since it read it. Full nodes are split on the way down, so a
+   split only needs the locks of the node and of its parent.
+
+   Nodes are never freed before the tree, so a reader may follow a
+   pointer read from a node that changed meanwhile. Leaves are linked in
+   key order for range scans.
+*/
+class index_btree
+{
+private:
+    struct Node
+    {
+        std::atomic<uint64_t> version; // LOCKED set while a writer holds the node
+        uint32_t count;
+        bool leaf;
+    };
+
+    static const uint64_t LOCKED = 2;
+    static const uint32_t INNER_CAP = (BTREE_NODE_SIZE - sizeof(Node) - sizeof(Node *)) / (sizeof(uint64_t) + sizeof(Node *));
+    static const uint32_t LEAF_CAP = (BTREE_NODE_SIZE - sizeof(Node) - sizeof(Node *)) / (2 * sizeof(uint64_t));
+
+    // Child i holds the keys k with keys[i - 1] <= k < keys[i].
+    struct Inner : Node
+    {
+        uint64_t keys[INNER_CAP];
+        Node *children[INNER_CAP + 1];
+    };
+
+    struct Leaf : Node
+    {
+        uint64_t keys[LEAF_CAP];
+        uint64_t items[LEAF_CAP];
+        Leaf *next; // leaf of the next keys
+    };
+
+    std::atomic<Node *> root;
+
+    template <typename T>
+    static T *newNode();
+    static void freeNode(Node *node);
+
+    static bool readLock(Node *node, uint64_t &version);
+    static bool validate(Node *node, uint64_t version);
+    static bool upgrade(Node *node, uint64_t version);
+    static void writeUnlock(Node *node);
+
+    static uint32_t childOf(Inner *inner, uint64_t key);
+    static uint32_t leafPos(Leaf *leaf, uint64_t key);
+    static Inner *splitInner(Inner *inner, uint64_t &sep);
+    static Leaf *splitLeaf(Leaf *leaf, uint64_t key, uint64_t &sep);
+    static void insertInner(Inner *inner, uint64_t sep, Node *right);
+    void makeRoot(uint64_t sep, Node *left, Node *right);
+    Leaf *findLeaf(uint64_t key, uint64_t &version);
+
+public:
+    index_btree();
+    ~index_btree();
+
+    // Kept for the interface of IndexHash, the tree grows as needed.
+    void init(uint64_t keyCnt) {}
+
+    // Insert key, or replace its item.
+    void index_insert(uint64_t key, uint64_t item);
+
+    // Returns false if key is not in the index.
+    bool index_read(uint64_t key, uint64_t &item);
+
+    /*
+       Get, in key order, up to max keys of [lo, hi) with their items.
+       Returns the number of keys found. A scan is not atomic: each leaf
+       is read as it was at one time.
+    */
+    uint64_t index_scan(uint64_t lo, uint64_t hi, uint64_t *keys, uint64_t *items, uint64_t max);
+};
+
+#endif
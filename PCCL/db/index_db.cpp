@@ -0,0 +1,186 @@
+#include "database.h"
+#include "../config.h"
+#include "../system/global.h"
+#include "db_util.h"
+#include <iostream>
+
+IndexDB::IndexDB()
+{
+    _dbInstance = "Index";
+    index = nullptr;
+    chunkFree = 0;
+}
+
+int IndexDB::Open(const std::string)
+{
+#if BANKING_SMART_CONTRACT
+    uint64_t keyCnt = g_account_num + 10;
+#else
+    uint64_t keyCnt = max((uint64_t)g_account_num + 10, (uint64_t)g_synth_table_size * g_ycsb_column);
+#endif
+    index = new INDEX();
+    index->init(keyCnt);
+
+    std::cout << std::endl
+              << "Index DB configuration OK" << std::endl;
+
+    return 0;
+}
+
+#if ISEOV
+void IndexDB::Init(const std::string value)
+{
+    uint64_t init_value = std::stoull(value);
+    uint64_t init_num = g_account_num + 10;
+#if !BANKING_SMART_CONTRACT
+    init_num = max(init_num, (uint64_t)g_synth_table_size * g_ycsb_column);
+#endif
+
+    // The initial keys share one slot array, each thread loading a range.
+    Slot *initSlots = new Slot[init_num];
+    chunks.push_back(initSlots);
+    chunkFree = 0;
+    parallel_for(init_num, [this, initSlots, init_value](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++)
+        {
+            initSlots[i].value = init_value;
+            initSlots[i].version = 1;
+            index->index_insert(i, (uint64_t)&initSlots[i]);
+        }
+    });
+
+    std::cout << "IndexDB::Init DONE" << std::endl;
+}
+#endif
+
+IndexDB::Slot *IndexDB::findSlot(uint64_t key)
+{
+    uint64_t item;
+    return index->index_read(key, item) ? (Slot *)item : nullptr;
+}
+
+// The slot of key, inserted if missing.
+IndexDB::Slot *IndexDB::getSlot(uint64_t key)
+{
+    Slot *slot = findSlot(key);
+    if (slot != nullptr)
+    {
+        return slot;
+    }
+
+    std::lock_guard<std::mutex> guard(insertLock);
+    slot = findSlot(key);
+    if (slot == nullptr)
+    {
+        if (chunkFree == 0)
+        {
+            chunks.push_back(new Slot[SLOT_CHUNK]());
+            chunkFree = SLOT_CHUNK;
+        }
+        slot = &chunks.back()[SLOT_CHUNK - chunkFree--];
+        index->index_insert(key, (uint64_t)slot);
+    }
+    return slot;
+}
+
+uint64_t IndexDB::Get(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    Slot *slot = findSlot(key);
+    if (slot == nullptr)
+    {
+        version = 0;
+        return dflt;
+    }
+    version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    uint64_t value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+    return version == 0 ? dflt : value;
+}
+
+uint64_t IndexDB::Get(uint64_t key, uint64_t dflt)
+{
+    uint64_t version;
+    return Get(key, dflt, version);
+}
+
+void IndexDB::Put(uint64_t key, uint64_t value, uint64_t version)
+{
+    Slot *slot = getSlot(key);
+    __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->version, version, __ATOMIC_RELEASE);
+}
+
+void IndexDB::Put(uint64_t key, uint64_t value)
+{
+    Slot *slot = getSlot(key);
+    Put(key, value, __atomic_load_n(&slot->version, __ATOMIC_RELAXED) + 1);
+}
+
+// One pass over the index for the whole range, the missing keys are dflt.
+void IndexDB::Scan(uint64_t start, uint64_t cnt, uint64_t *values, uint64_t *versions, uint64_t dflt)
+{
+    std::vector<uint64_t> keys(cnt), items(cnt);
+    uint64_t found = index->index_scan(start, start + cnt, keys.data(), items.data(), cnt);
+    for (uint64_t i = 0; i < cnt; i++)
+    {
+        values[i] = dflt;
+        versions[i] = 0;
+    }
+    for (uint64_t i = 0; i < found; i++)
+    {
+        Slot *slot = (Slot *)items[i];
+        uint64_t j = keys[i] - start;
+        versions[j] = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+        uint64_t value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+        values[j] = versions[j] == 0 ? dflt : value;
+    }
+}
+
+std::string IndexDB::Get(const std::string key)
+{
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        auto it = strTable.find(key);
+        return it == strTable.end() ? std::string() : it->second;
+    }
+    uint64_t version;
+    uint64_t value = Get(k, 0, version);
+    return version == 0 ? std::string() : numericString(k, value);
+}
+
+std::string IndexDB::Put(const std::string key, const std::string value)
+{
+    // The key alone tells where it lives, as in Get.
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::lock_guard<std::mutex> guard(tableLock);
+        std::string oldValue = strTable[key];
+        strTable[key] = value;
+        return oldValue;
+    }
+    std::string oldValue = Get(key);
+    putNumeric(k, value);
+    return oldValue;
+}
+
+int IndexDB::SelectTable(const std::string tableName)
+{
+    // A single index; table names are ignored.
+    return 0;
+}
+
+int IndexDB::Close(const std::string)
+{
+    delete index;
+    index = nullptr;
+    for (Slot *chunk : chunks)
+    {
+        delete[] chunk;
+    }
+    chunks.clear();
+    chunkFree = 0;
+    strTable.clear();
+    return 0;
+}
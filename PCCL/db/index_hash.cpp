@@ -0,0 +1,101 @@
+#include "index_hash.h"
+
+IndexHash::IndexHash()
+{
+    buckets = nullptr;
+    bucketMask = 0;
+}
+
+IndexHash::~IndexHash()
+{
+    if (buckets == nullptr)
+    {
+        return;
+    }
+    for (uint64_t b = 0; b <= bucketMask; b++)
+    {
+        Entry *entry = buckets[b].load(std::memory_order_relaxed);
+        while (entry != nullptr)
+        {
+            Entry *next = entry->next;
+            delete entry;
+            entry = next;
+        }
+    }
+    delete[] buckets;
+}
+
+void IndexHash::init(uint64_t keyCnt)
+{
+    // About one key per bucket.
+    uint64_t bucketCnt = 1;
+    while (bucketCnt < keyCnt)
+    {
+        bucketCnt *= 2;
+    }
+    buckets = new std::atomic<Entry *>[bucketCnt]();
+    bucketMask = bucketCnt - 1;
+}
+
+// Finalizer of MurmurHash3, so runs of keys spread over the buckets.
+uint64_t IndexHash::bucketOf(uint64_t key) const
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key & bucketMask;
+}
+
+IndexHash::Entry *IndexHash::find(uint64_t key, uint64_t bucket) const
+{
+    Entry *entry = buckets[bucket].load(std::memory_order_acquire);
+    while (entry != nullptr && entry->key != key)
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+void IndexHash::index_insert(uint64_t key, uint64_t item)
+{
+    uint64_t bucket = bucketOf(key);
+    std::lock_guard<std::mutex> guard(locks[bucket & (LOCK_STRIPES - 1)]);
+    Entry *entry = find(key, bucket);
+    if (entry != nullptr)
+    {
+        entry->item.store(item, std::memory_order_release);
+        return;
+    }
+    entry = new Entry();
+    entry->key = key;
+    entry->item.store(item, std::memory_order_relaxed);
+    entry->next = buckets[bucket].load(std::memory_order_relaxed);
+    // Readers see the entry whole once it heads the chain.
+    buckets[bucket].store(entry, std::memory_order_release);
+}
+
+bool IndexHash::index_read(uint64_t key, uint64_t &item) const
+{
+    Entry *entry = find(key, bucketOf(key));
+    if (entry == nullptr)
+    {
+        return false;
+    }
+    item = entry->item.load(std::memory_order_acquire);
+    return true;
+}
+
+uint64_t IndexHash::index_scan(uint64_t lo, uint64_t hi, uint64_t *keys, uint64_t *items, uint64_t max) const
+{
+    uint64_t cnt = 0;
+    for (uint64_t key = lo; key < hi && cnt < max; key++)
+    {
+        if (index_read(key, items[cnt]))
+        {
+            keys[cnt++] = key;
+        }
+    }
+    return cnt;
+}
@@ -0,0 +1,56 @@
+#ifndef _INDEX_HASH_H_
+#define _INDEX_HASH_H_
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+/*
+   Concurrent hash index from integer keys to 64 bit items. The buckets
+   are chains of entries that are only ever added, so readers walk them
+   without a lock. Writers take the lock of the stripe of the bucket, and
+   an item is replaced in place by an atomic store. Entries are freed
+   with the index.
+
+   The index has no order: index_scan probes every key of the range.
+*/
+class IndexHash
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::atomic<uint64_t> item;
+        Entry *next;
+    };
+
+    static const uint64_t LOCK_STRIPES = 1024;
+
+    std::atomic<Entry *> *buckets;
+    uint64_t bucketMask;
+    std::mutex locks[LOCK_STRIPES];
+
+    uint64_t bucketOf(uint64_t key) const;
+    Entry *find(uint64_t key, uint64_t bucket) const;
+
+public:
+    IndexHash();
+    ~IndexHash();
+
+    // Size the table for about keyCnt keys. Must be called first.
+    void init(uint64_t keyCnt);
+
+    // Insert key, or replace its item.
+    void index_insert(uint64_t key, uint64_t item);
+
+    // Returns false if key is not in the index.
+    bool index_read(uint64_t key, uint64_t &item) const;
+
+    /*
+       Get, in key order, up to max keys of [lo, hi) with their items.
+       Returns the number of keys found.
+    */
+    uint64_t index_scan(uint64_t lo, uint64_t hi, uint64_t *keys, uint64_t *items, uint64_t max) const;
+};
+
+#endif
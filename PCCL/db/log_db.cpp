@@ -0,0 +1,386 @@
+#include "database.h"
+#include "../config.h"
+#include "../system/global.h"
+#include "db_util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+   On disk formats.
+
+   Record:   'I' key value version      (uint64_t each)
+             'S' klen vlen key value    (uint32_t lengths, raw bytes)
+   Log:      a sequence of groups, [uint32_t len][uint32_t sum][len bytes
+             of records], sum being the FNV-1a hash of the records. A group
+             that is cut short or does not match its sum ends the log.
+   Snapshot: LOG_SNAP_MAGIC, the records of the whole state, then 'E'.
+*/
+#define LOG_REC_INT 'I'
+#define LOG_REC_STR 'S'
+#define LOG_REC_END 'E'
+#define LOG_SNAP_MAGIC 0x50414e5344474f4cULL // "LOGDSNAP"
+
+static inline uint32_t log_sum(const char *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return h;
+}
+
+template <typename T>
+static inline void log_append(std::string &buf, T val)
+{
+    buf.append((const char *)&val, sizeof(T));
+}
+
+template <typename T>
+static inline bool log_read(const std::string &buf, size_t &pos, size_t end, T &val)
+{
+    if (pos + sizeof(T) > end)
+    {
+        return false;
+    }
+    memcpy(&val, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static inline void log_int(std::string &buf, uint64_t key, uint64_t value, uint64_t version)
+{
+    buf.push_back(LOG_REC_INT);
+    log_append(buf, key);
+    log_append(buf, value);
+    log_append(buf, version);
+}
+
+static inline void log_str(std::string &buf, const std::string &key, const std::string &value)
+{
+    buf.push_back(LOG_REC_STR);
+    log_append(buf, (uint32_t)key.size());
+    log_append(buf, (uint32_t)value.size());
+    buf.append(key);
+    buf.append(value);
+}
+
+static bool read_file(const std::string &path, std::string &buf)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    buf = ss.str();
+    return true;
+}
+
+LogDB::LogDB()
+{
+    _dbInstance = "Log";
+    logFd = -1;
+    inBatch = false;
+    recovered = false;
+    batchCnt = 0;
+}
+
+int LogDB::Open(const std::string id)
+{
+    int rc = DenseDB::Open(id);
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    std::string name = id.empty() ? std::string("db") : id;
+    logPath = name + ".log";
+    snapPath = name + ".snap";
+
+    recovered = loadSnapshot();
+    replayLog();
+    rebuildDigest();
+    rebuildMerkle();
+
+    logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logFd < 0)
+    {
+        std::cerr << "LogDB: cannot open " << logPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+        return 1;
+    }
+
+    std::cout << "Log DB configuration OK, log = " << logPath
+              << (recovered ? ", state recovered" : "") << std::endl;
+    return 0;
+}
+
+#if ISEOV
+void LogDB::Init(const std::string value)
+{
+    if (recovered)
+    {
+        std::cout << "LogDB::Init skipped, state recovered" << std::endl;
+        return;
+    }
+    DenseDB::Init(value);
+    // The initial state is made durable by a first snapshot.
+    snapshot();
+}
+#endif
+
+/*
+   Apply the records of buf[pos, end) to the state, up to an end record.
+   Returns the position after the last complete record.
+*/
+size_t LogDB::applyRecords(const std::string &buf, size_t pos, size_t end)
+{
+    while (pos < end)
+    {
+        size_t start = pos;
+        char type = buf[pos++];
+        if (type == LOG_REC_INT)
+        {
+            uint64_t key, value, version;
+            if (!log_read(buf, pos, end, key) || !log_read(buf, pos, end, value) || !log_read(buf, pos, end, version))
+            {
+                return start;
+            }
+            Slot &slot = getSlot(key);
+            slot.value = value;
+            slot.version = version;
+        }
+        else if (type == LOG_REC_STR)
+        {
+            uint32_t klen, vlen;
+            if (!log_read(buf, pos, end, klen) || !log_read(buf, pos, end, vlen) || pos + klen + vlen > end)
+            {
+                return start;
+            }
+            strTable[buf.substr(pos, klen)] = buf.substr(pos + klen, vlen);
+            pos += klen + vlen;
+        }
+        else
+        {
+            return start;
+        }
+    }
+    return pos;
+}
+
+bool LogDB::loadSnapshot()
+{
+    std::string buf;
+    if (!read_file(snapPath, buf))
+    {
+        return false;
+    }
+
+    size_t pos = 0;
+    uint64_t magic = 0;
+    if (!log_read(buf, pos, buf.size(), magic) || magic != LOG_SNAP_MAGIC)
+    {
+        std::cerr << "LogDB: " << snapPath << " is not a snapshot" << std::endl;
+        assert(0);
+        return false;
+    }
+    pos = applyRecords(buf, pos, buf.size());
+    if (pos >= buf.size() || buf[pos] != LOG_REC_END)
+    {
+        std::cerr << "LogDB: snapshot " << snapPath << " is truncated" << std::endl;
+        assert(0);
+        return false;
+    }
+    return true;
+}
+
+void LogDB::replayLog()
+{
+    std::string buf;
+    if (!read_file(logPath, buf))
+    {
+        return;
+    }
+
+    size_t pos = 0;
+    uint64_t groups = 0;
+    while (true)
+    {
+        size_t start = pos;
+        uint32_t len, sum;
+        if (!log_read(buf, pos, buf.size(), len) || !log_read(buf, pos, buf.size(), sum) ||
+            pos + len > buf.size() || log_sum(buf.data() + pos, len) != sum)
+        {
+            pos = start;
+            break;
+        }
+        applyRecords(buf, pos, pos + len);
+        pos += len;
+        groups++;
+    }
+
+    // Drop a group that was cut short by a crash.
+    if (pos < buf.size() && truncate(logPath.c_str(), pos) != 0)
+    {
+        std::cerr << "LogDB: cannot truncate " << logPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+    }
+    if (groups > 0)
+    {
+        recovered = true;
+        std::cout << "LogDB: replayed " << groups << " log groups" << std::endl;
+    }
+}
+
+// Write the pending records as one group and wait for the disk.
+void LogDB::flush()
+{
+    if (logBuf.empty())
+    {
+        return;
+    }
+    uint32_t hdr[2] = {(uint32_t)logBuf.size(), log_sum(logBuf.data(), logBuf.size())};
+    if (!write_all(logFd, (const char *)hdr, sizeof(hdr)) ||
+        !write_all(logFd, logBuf.data(), logBuf.size()) ||
+        fdatasync(logFd) != 0)
+    {
+        std::cerr << "LogDB: cannot write " << logPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+    }
+    logBuf.clear();
+}
+
+/*
+   Write the whole state to a new snapshot, then empty the log. The
+   snapshot replaces the old one atomically. If the process stops before
+   the log is emptied, replaying the log again on top of the snapshot gives
+   the same state, as records hold absolute values.
+*/
+void LogDB::snapshot()
+{
+    std::string tmpPath = snapPath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "LogDB: cannot open " << tmpPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+        return;
+    }
+
+    // Written by chunks of about 1MB.
+    const size_t chunk = 1 << 20;
+    std::string buf;
+    bool ok = true;
+    log_append(buf, (uint64_t)LOG_SNAP_MAGIC);
+    for (uint64_t key = 0; key < capacity && ok; key++)
+    {
+        if (slots[key].version != 0)
+        {
+            log_int(buf, key, slots[key].value, slots[key].version);
+        }
+        if (buf.size() >= chunk)
+        {
+            ok = write_all(fd, buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+    for (const auto &item : overflow)
+    {
+        log_int(buf, item.first, item.second.value, item.second.version);
+    }
+    for (const auto &item : strTable)
+    {
+        log_str(buf, item.first, item.second);
+    }
+    buf.push_back(LOG_REC_END);
+    ok = ok && write_all(fd, buf.data(), buf.size());
+
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+    ok = ok && rename(tmpPath.c_str(), snapPath.c_str()) == 0;
+    if (!ok)
+    {
+        std::cerr << "LogDB: cannot write snapshot " << snapPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+        return;
+    }
+
+    if (logFd >= 0 && (ftruncate(logFd, 0) != 0 || fdatasync(logFd) != 0))
+    {
+        std::cerr << "LogDB: cannot truncate " << logPath << ": " << strerror(errno) << std::endl;
+        assert(0);
+    }
+    batchCnt = 0;
+}
+
+std::string LogDB::Put(const std::string key, const std::string value)
+{
+    uint64_t k, v;
+    if (parseKey(key, k) && parseKey(value, v))
+    {
+        // Logged by the integer Put.
+        return DenseDB::Put(key, value);
+    }
+    std::string oldValue = DenseDB::Put(key, value);
+    log_str(logBuf, key, value);
+    if (!inBatch)
+    {
+        flush();
+    }
+    return oldValue;
+}
+
+void LogDB::Put(uint64_t key, uint64_t value)
+{
+    DenseDB::Put(key, value);
+    Slot &slot = getSlot(key);
+    log_int(logBuf, key, slot.value, slot.version);
+    if (!inBatch)
+    {
+        flush();
+    }
+}
+
+void LogDB::Put(uint64_t key, uint64_t value, uint64_t version)
+{
+    DenseDB::Put(key, value, version);
+    log_int(logBuf, key, value, version);
+    if (!inBatch)
+    {
+        flush();
+    }
+}
+
+void LogDB::BeginBatch()
+{
+    inBatch = true;
+}
+
+// Group commit of the batch.
+void LogDB::CommitBatch()
+{
+    flush();
+    inBatch = false;
+    if (++batchCnt >= LOG_SNAPSHOT_PERIOD)
+    {
+        snapshot();
+    }
+}
+
+int LogDB::Close(const std::string id)
+{
+    flush();
+    if (logFd >= 0)
+    {
+        close(logFd);
+        logFd = -1;
+    }
+    return DenseDB::Close(id);
+}
@@ -0,0 +1,334 @@
+#include "merkle_tree.h"
+#include "db_util.h"
+#include "sha.h"
+#include <algorithm>
+#include <cstring>
+
+// Below this many hashes a level is hashed by the tree thread alone.
+#define MERKLE_PARALLEL_MIN 256
+
+MerkleTree::MerkleTree(uint64_t keyCnt)
+{
+    this->keyCnt = keyCnt;
+    bucketCnt = (keyCnt + MERKLE_BUCKET - 1) / MERKLE_BUCKET;
+    leafBase = 1;
+    while (leafBase < bucketCnt)
+    {
+        leafBase *= 2;
+    }
+    nodes.resize(2 * leafBase);
+    leaves.resize(bucketCnt * 2 * MERKLE_BUCKET);
+    rootTxn = UINT64_MAX;
+    built = false;
+    restored = nullptr;
+    touched = new std::atomic<uint8_t>[bucketCnt]();
+    unapplied = 0;
+    stop = false;
+    worker = std::thread(&MerkleTree::run, this);
+}
+
+// Pending updates are dropped, the process is going down.
+MerkleTree::~MerkleTree()
+{
+    {
+        std::lock_guard<std::mutex> guard(pendingLock);
+        stop = true;
+    }
+    pendingCond.notify_all();
+    worker.join();
+    for (Update *update : pending)
+    {
+        delete update;
+    }
+    delete[] touched;
+}
+
+void MerkleTree::hashLeaf(uint64_t bucket, const uint64_t *words, Hash &out)
+{
+    uint8_t buf[sizeof(uint64_t) * (1 + 2 * MERKLE_BUCKET)];
+    memcpy(buf, &bucket, sizeof(uint64_t));
+    memcpy(buf + sizeof(uint64_t), words, sizeof(uint64_t) * 2 * MERKLE_BUCKET);
+    CryptoPP::SHA256().CalculateDigest(out.b, buf, sizeof(buf));
+}
+
+void MerkleTree::hashNode(const Hash &left, const Hash &right, Hash &out)
+{
+    uint8_t buf[2 * sizeof(Hash)];
+    memcpy(buf, left.b, sizeof(Hash));
+    memcpy(buf + sizeof(Hash), right.b, sizeof(Hash));
+    CryptoPP::SHA256().CalculateDigest(out.b, buf, sizeof(buf));
+}
+
+/*
+   Rehash the ancestors of nodeIds, which all are at the same level, up to
+   the root. Each level is hashed once all of the level below is.
+*/
+void MerkleTree::rehash(std::vector<uint64_t> &nodeIds)
+{
+    while (!nodeIds.empty() && nodeIds.front() > 1)
+    {
+        for (uint64_t &id : nodeIds)
+        {
+            id /= 2;
+        }
+        std::sort(nodeIds.begin(), nodeIds.end());
+        nodeIds.erase(std::unique(nodeIds.begin(), nodeIds.end()), nodeIds.end());
+        parallel_for(nodeIds.size(), [this, &nodeIds](uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; i++)
+            {
+                uint64_t id = nodeIds[i];
+                hashNode(nodes[2 * id], nodes[2 * id + 1], nodes[id]);
+            }
+        }, MERKLE_PARALLEL_MIN);
+    }
+}
+
+void MerkleTree::Build(const uint64_t *words)
+{
+    std::lock_guard<std::mutex> guard(treeLock);
+    memcpy(leaves.data(), words, sizeof(uint64_t) * 2 * keyCnt);
+    parallel_for(bucketCnt, [this](uint64_t begin, uint64_t end) {
+        for (uint64_t b = begin; b < end; b++)
+        {
+            hashLeaf(b, &leaves[b * 2 * MERKLE_BUCKET], nodes[leafBase + b]);
+        }
+    }, MERKLE_PARALLEL_MIN);
+    for (uint64_t level = leafBase / 2; level >= 1; level /= 2)
+    {
+        parallel_for(level, [this, level](uint64_t begin, uint64_t end) {
+            for (uint64_t id = level + begin; id < level + end; id++)
+            {
+                hashNode(nodes[2 * id], nodes[2 * id + 1], nodes[id]);
+            }
+        }, MERKLE_PARALLEL_MIN);
+    }
+    rootTxn = UINT64_MAX;
+    built = true;
+    restored = nullptr;
+
+    std::lock_guard<std::mutex> dirtyGuard(dirtyLock);
+    for (uint64_t b : dirty)
+    {
+        touched[b].store(0, std::memory_order_relaxed);
+    }
+    dirty.clear();
+}
+
+// Thread safe, the first touch of a bucket since the last Commit lists it.
+void MerkleTree::Touch(uint64_t key)
+{
+    if (key >= keyCnt)
+    {
+        return;
+    }
+    uint64_t bucket = key / MERKLE_BUCKET;
+    if (touched[bucket].exchange(1, std::memory_order_relaxed) == 0)
+    {
+        std::lock_guard<std::mutex> guard(dirtyLock);
+        dirty.push_back(bucket);
+    }
+}
+
+/*
+   Hand the leaves touched since the last call, as found in words, to the
+   tree thread, which computes the root of the state after txn_id. No
+   update may run meanwhile. Waits if the tree thread is MAX_PENDING
+   blocks behind.
+*/
+void MerkleTree::Commit(uint64_t txn_id, const uint64_t *words)
+{
+    if (!built)
+    {
+        Build(words);
+    }
+
+    Update *update = new Update();
+    update->txnId = txn_id;
+    {
+        std::lock_guard<std::mutex> guard(dirtyLock);
+        update->buckets.swap(dirty);
+    }
+    update->words.resize(update->buckets.size() * 2 * MERKLE_BUCKET);
+    for (uint64_t i = 0; i < update->buckets.size(); i++)
+    {
+        uint64_t b = update->buckets[i];
+        touched[b].store(0, std::memory_order_relaxed);
+        // The last bucket may run past the keys, its tail stays zero.
+        uint64_t cnt = std::min((uint64_t)MERKLE_BUCKET, keyCnt - b * MERKLE_BUCKET);
+        memcpy(&update->words[i * 2 * MERKLE_BUCKET], words + b * 2 * MERKLE_BUCKET,
+               sizeof(uint64_t) * 2 * cnt);
+    }
+
+    std::unique_lock<std::mutex> lock(pendingLock);
+    pendingCond.wait(lock, [this]() { return pending.size() < MAX_PENDING; });
+    pending.push_back(update);
+    unapplied++;
+    lock.unlock();
+    pendingCond.notify_all();
+}
+
+void MerkleTree::Sync()
+{
+    std::unique_lock<std::mutex> lock(pendingLock);
+    pendingCond.wait(lock, [this]() { return unapplied == 0; });
+}
+
+void MerkleTree::apply(Update *update)
+{
+    std::string root;
+    {
+        std::lock_guard<std::mutex> guard(treeLock);
+        std::vector<uint64_t> &buckets = update->buckets;
+        for (uint64_t i = 0; i < buckets.size(); i++)
+        {
+            memcpy(&leaves[buckets[i] * 2 * MERKLE_BUCKET], &update->words[i * 2 * MERKLE_BUCKET],
+                   sizeof(uint64_t) * 2 * MERKLE_BUCKET);
+            if (restored != nullptr)
+            {
+                fresh[buckets[i]] = 1;
+            }
+        }
+        parallel_for(buckets.size(), [this, &buckets](uint64_t begin, uint64_t end) {
+            for (uint64_t i = begin; i < end; i++)
+            {
+                uint64_t b = buckets[i];
+                hashLeaf(b, &leaves[b * 2 * MERKLE_BUCKET], nodes[leafBase + b]);
+            }
+        }, MERKLE_PARALLEL_MIN);
+        for (uint64_t &b : buckets)
+        {
+            b += leafBase;
+        }
+        rehash(buckets);
+        rootTxn = update->txnId;
+        root.assign((const char *)nodes[1].b, sizeof(Hash));
+    }
+    if (listener)
+    {
+        listener(update->txnId, root);
+    }
+}
+
+void MerkleTree::run()
+{
+    while (true)
+    {
+        Update *update;
+        {
+            std::unique_lock<std::mutex> lock(pendingLock);
+            pendingCond.wait(lock, [this]() { return stop || !pending.empty(); });
+            if (stop)
+            {
+                return;
+            }
+            update = pending.front();
+            pending.pop_front();
+        }
+        pendingCond.notify_all();
+        apply(update);
+        delete update;
+        {
+            std::lock_guard<std::mutex> lock(pendingLock);
+            unapplied--;
+        }
+        pendingCond.notify_all();
+    }
+}
+
+/*
+   Make the proof of key against the last published root. Returns false
+   for keys past the tree, and before the first Build.
+*/
+bool MerkleTree::Prove(uint64_t key, MerkleProof &proof)
+{
+    if (key >= keyCnt)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(treeLock);
+    if (!built)
+    {
+        return false;
+    }
+    uint64_t bucket = key / MERKLE_BUCKET;
+    proof.txnId = rootTxn;
+    proof.root.assign((const char *)nodes[1].b, sizeof(Hash));
+    proof.key = key;
+    if (restored != nullptr && !fresh[bucket])
+    {
+        // The last bucket may run past the keys, its tail stays zero.
+        uint64_t cnt = std::min((uint64_t)MERKLE_BUCKET, keyCnt - bucket * MERKLE_BUCKET);
+        memset(proof.words, 0, sizeof(proof.words));
+        memcpy(proof.words, restored + bucket * 2 * MERKLE_BUCKET, sizeof(uint64_t) * 2 * cnt);
+    }
+    else
+    {
+        memcpy(proof.words, &leaves[bucket * 2 * MERKLE_BUCKET], sizeof(proof.words));
+    }
+    proof.path.clear();
+    for (uint64_t id = leafBase + bucket; id > 1; id /= 2)
+    {
+        proof.path.push_back(std::string((const char *)nodes[id ^ 1].b, sizeof(Hash)));
+    }
+    return true;
+}
+
+uint64_t MerkleTree::NodeBytes() const
+{
+    return nodes.size() * sizeof(Hash);
+}
+
+// Call with no block pending, see Sync.
+void MerkleTree::SaveNodes(std::string &out)
+{
+    std::lock_guard<std::mutex> guard(treeLock);
+    out.assign((const char *)nodes.data(), NodeBytes());
+}
+
+void MerkleTree::Restore(const char *nodeBytes, const uint64_t *words)
+{
+    std::lock_guard<std::mutex> guard(treeLock);
+    memcpy(nodes.data(), nodeBytes, NodeBytes());
+    restored = words;
+    fresh.assign(bucketCnt, 0);
+    rootTxn = UINT64_MAX;
+    built = true;
+}
+
+void MerkleTree::SetListener(const MerkleRootListener &listener)
+{
+    this->listener = listener;
+}
+
+bool MerkleTree::Verify(const MerkleProof &proof, const std::string &root)
+{
+    uint64_t depth = proof.path.size();
+    uint64_t bucket = proof.key / MERKLE_BUCKET;
+    if (depth >= 64 || bucket >= ((uint64_t)1 << depth) || root.size() != sizeof(Hash))
+    {
+        return false;
+    }
+
+    Hash hash;
+    hashLeaf(bucket, proof.words, hash);
+    uint64_t id = ((uint64_t)1 << depth) + bucket;
+    for (const std::string &sibling : proof.path)
+    {
+        if (sibling.size() != sizeof(Hash))
+        {
+            return false;
+        }
+        Hash other;
+        memcpy(other.b, sibling.data(), sizeof(Hash));
+        if (id & 1)
+        {
+            hashNode(other, hash, hash);
+        }
+        else
+        {
+            hashNode(hash, other, hash);
+        }
+        id /= 2;
+    }
+    return memcmp(hash.b, root.data(), sizeof(Hash)) == 0;
+}
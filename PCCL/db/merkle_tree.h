@@ -0,0 +1,141 @@
+#ifndef _MERKLE_TREE_H_
+#define _MERKLE_TREE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+
+// Keys hashed together in one leaf of the tree.
+#define MERKLE_BUCKET 16
+
+// Called with the last txn of a block and the root of the state after it.
+using MerkleRootListener = std::function<void(uint64_t txn_id, const std::string &root)>;
+
+/*
+   Proof that a key held a value in the state whose root is root. It holds
+   the whole leaf of the key, i.e. the (value, version) pairs of the
+   MERKLE_BUCKET keys sharing it, and the hashes of the siblings of the
+   nodes on the path from the leaf to the root.
+*/
+struct MerkleProof
+{
+    uint64_t txnId; // last txn of the block the root is the state of
+    std::string root;
+    uint64_t key;
+    uint64_t words[2 * MERKLE_BUCKET];
+    std::vector<std::string> path; // from the leaf up
+
+    uint64_t value() const
+    {
+        return words[2 * (key % MERKLE_BUCKET)];
+    }
+
+    // 0 if the key was never written.
+    uint64_t version() const
+    {
+        return words[2 * (key % MERKLE_BUCKET) + 1];
+    }
+};
+
+/*
+   Binary Merkle tree over the integer keys [0, keyCnt) of a dense store,
+   whose state is an array of (value, version) pairs. Leaf b hashes the
+   pairs of keys [b * MERKLE_BUCKET, (b + 1) * MERKLE_BUCKET) with b, an
+   inner node hashes its two children, and leaves past the last bucket
+   are zero. A leaf hash input is longer than a node one, so one cannot
+   be passed for the other.
+
+   The store calls Touch on every update. Once per block, the execute
+   thread calls Commit, which copies the touched leaves and hands them to
+   a thread of the tree, so hashing does not hold up execution. That
+   thread rehashes the leaves, then their parents level by level, each
+   level split over the hardware threads when large enough, and publishes
+   the root of the block. Proofs are made from the tree's own copy of the
+   leaves, so they always match the last published root.
+
+   A snapshot of the store saves the hashes of the tree with the state. A
+   tree restored from it reads the leaves no block updated since from the
+   snapshot, so loading it does not read the whole state.
+*/
+class MerkleTree
+{
+private:
+    struct Hash
+    {
+        uint8_t b[32];
+    };
+
+    // Leaves touched by one block, with their words after it.
+    struct Update
+    {
+        uint64_t txnId;
+        std::vector<uint64_t> buckets;
+        std::vector<uint64_t> words;
+    };
+
+    static const size_t MAX_PENDING = 64; // Commit waits beyond
+
+    uint64_t keyCnt;
+    uint64_t bucketCnt;
+    uint64_t leafBase;          // node of leaf 0, a power of two
+    std::vector<Hash> nodes;    // node 1 is the root, n has children 2n, 2n + 1
+    std::vector<uint64_t> leaves; // words of the committed state
+    uint64_t rootTxn;           // UINT64_MAX before the first block
+    bool built;
+    const uint64_t *restored;   // words of the snapshot restored, or NULL
+    std::vector<uint8_t> fresh; // leaves updated since Restore
+    std::mutex treeLock;        // leaves, nodes, fresh and rootTxn
+
+    std::atomic<uint8_t> *touched;
+    std::vector<uint64_t> dirty; // touched buckets, in touch order
+    std::mutex dirtyLock;
+
+    std::deque<Update *> pending;
+    uint64_t unapplied; // blocks committed and not applied yet
+    bool stop;
+    std::mutex pendingLock;
+    std::condition_variable pendingCond;
+    std::thread worker;
+    MerkleRootListener listener;
+
+    static void hashLeaf(uint64_t bucket, const uint64_t *words, Hash &out);
+    static void hashNode(const Hash &left, const Hash &right, Hash &out);
+    void rehash(std::vector<uint64_t> &nodeIds);
+    void apply(Update *update);
+    void run();
+
+public:
+    MerkleTree(uint64_t keyCnt);
+    ~MerkleTree();
+
+    // Hash the whole state words, the keyCnt pairs of the store.
+    void Build(const uint64_t *words);
+    void Touch(uint64_t key);
+    void Commit(uint64_t txn_id, const uint64_t *words);
+    // Wait until the tree thread applied every block committed.
+    void Sync();
+    bool Prove(uint64_t key, MerkleProof &proof);
+
+    // Size of the hashes saved with a snapshot.
+    uint64_t NodeBytes() const;
+    void SaveNodes(std::string &out);
+    /*
+       Take the hashes saved by SaveNodes with the state whose keyCnt pairs
+       are words. words must stay mapped as long as the tree, and must not
+       change.
+    */
+    void Restore(const char *nodeBytes, const uint64_t *words);
+    // Set before the first Commit.
+    void SetListener(const MerkleRootListener &listener);
+
+    // Check a proof against the root, e.g. one taken from a block.
+    static bool Verify(const MerkleProof &proof, const std::string &root);
+};
+
+#endif
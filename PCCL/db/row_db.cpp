@@ -0,0 +1,188 @@
+#include "database.h"
+#include "../config.h"
+#include "../system/global.h"
+#include <unordered_map>
+#include <iostream>
+
+RowDB::RowDB()
+{
+    _dbInstance = "Row";
+    rows = nullptr;
+    rowCnt = 0;
+    columns = 1;
+    stride = 0;
+}
+
+int RowDB::Open(const std::string)
+{
+#if BANKING_SMART_CONTRACT
+    columns = 1;
+    rowCnt = g_account_num + 10;
+#else
+    columns = g_ycsb_column;
+    rowCnt = max((uint64_t)g_synth_table_size, ((uint64_t)g_account_num + 10) / columns + 1);
+#endif
+
+    // Round the row slot up to whole cache lines.
+    uint64_t words_per_line = CL_SIZE / sizeof(uint64_t);
+    stride = (2 * columns + words_per_line - 1) / words_per_line * words_per_line;
+
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, CL_SIZE, rowCnt * stride * sizeof(uint64_t)) != 0)
+    {
+        std::cerr << "RowDB: cannot allocate " << rowCnt << " rows" << std::endl;
+        assert(0);
+        return 1;
+    }
+    rows = (uint64_t *)ptr;
+    memset(rows, 0, rowCnt * stride * sizeof(uint64_t));
+
+    std::cout << std::endl
+              << "Row DB configuration OK, rows = " << rowCnt << ", columns = " << columns << std::endl;
+
+    return 0;
+}
+
+#if ISEOV
+void RowDB::Init(const std::string value)
+{
+    uint64_t init_value = std::stoull(value);
+    uint64_t init_num = (uint64_t)g_account_num + 10;
+    for (uint64_t key = 0; key < init_num; key++)
+    {
+        uint64_t *r = getRow(key / columns);
+        r[key % columns] = init_value;
+        r[columns + key % columns] = 1;
+    }
+
+    std::cout << "RowDB::Init DONE" << std::endl;
+}
+#endif
+
+uint64_t *RowDB::findRow(uint64_t row)
+{
+    if (row < rowCnt)
+    {
+        return &rows[row * stride];
+    }
+    auto it = overflow.find(row);
+    return it == overflow.end() ? nullptr : it->second.data();
+}
+
+uint64_t *RowDB::getRow(uint64_t row)
+{
+    if (row < rowCnt)
+    {
+        return &rows[row * stride];
+    }
+    std::vector<uint64_t> &r = overflow[row];
+    if (r.empty())
+    {
+        r.assign(2 * columns, 0);
+    }
+    return r.data();
+}
+
+void RowDB::GetRow(uint64_t row, uint64_t colCnt, uint64_t *cols, uint64_t *versions, uint64_t dflt)
+{
+    assert(colCnt == columns);
+    uint64_t *r = findRow(row);
+    if (r == nullptr)
+    {
+        for (uint64_t j = 0; j < colCnt; j++)
+        {
+            cols[j] = dflt;
+            versions[j] = 0;
+        }
+        return;
+    }
+    for (uint64_t j = 0; j < colCnt; j++)
+    {
+        versions[j] = r[columns + j];
+        cols[j] = versions[j] != 0 ? r[j] : dflt;
+    }
+}
+
+void RowDB::PutColumn(uint64_t row, uint64_t colCnt, uint64_t col, uint64_t value)
+{
+    assert(colCnt == columns && col < colCnt);
+    uint64_t *r = getRow(row);
+    r[col] = value;
+    r[columns + col]++;
+}
+
+uint64_t RowDB::Get(uint64_t key, uint64_t dflt)
+{
+    uint64_t version;
+    return Get(key, dflt, version);
+}
+
+void RowDB::Put(uint64_t key, uint64_t value)
+{
+    PutColumn(key / columns, columns, key % columns, value);
+}
+
+uint64_t RowDB::Get(uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    uint64_t *r = findRow(key / columns);
+    uint64_t col = key % columns;
+    version = r == nullptr ? 0 : r[columns + col];
+    return version != 0 ? r[col] : dflt;
+}
+
+void RowDB::Put(uint64_t key, uint64_t value, uint64_t version)
+{
+    uint64_t *r = getRow(key / columns);
+    r[key % columns] = value;
+    r[columns + key % columns] = version;
+}
+
+std::string RowDB::Get(const std::string key)
+{
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        auto it = strTable.find(key);
+        return it == strTable.end() ? std::string() : it->second;
+    }
+
+    uint64_t version;
+    uint64_t value = Get(k, 0, version);
+    if (version == 0)
+    {
+        return std::string();
+    }
+    return numericString(k, value);
+}
+
+std::string RowDB::Put(const std::string key, const std::string value)
+{
+    // The key alone tells where it lives, as in Get.
+    uint64_t k;
+    if (!parseKey(key, k))
+    {
+        std::string oldValue = strTable[key];
+        strTable[key] = value;
+        return oldValue;
+    }
+
+    std::string oldValue = Get(key);
+    putNumeric(k, value);
+    return oldValue;
+}
+
+int RowDB::SelectTable(const std::string tableName)
+{
+    // A single row table; table names are ignored.
+    return 0;
+}
+
+int RowDB::Close(const std::string)
+{
+    free(rows);
+    rows = nullptr;
+    rowCnt = 0;
+    overflow.clear();
+    strTable.clear();
+    return 0;
+}
@@ -1,53 +1,81 @@
 #include "config.h"
 #include "database.h"
+#include "../system/global.h"
 #include "assert.h"
 #include <iostream>
 
 // Private methods
 
-int SQLite::callback(void *x, int nCol, char **colValue, char **colNames)
+void SQLite::exec(const std::string &query, const char *op)
 {
-    res_data *data = (res_data *)x;
-    //std::cout << "DATA returned from " << data->op << " operation" << std::endl;
-
-    if (data->results.size() == 0)
+    int rc = sqlite3_exec(conn, query.c_str(), nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK)
     {
-        // Store column names for debugging
-        data->results.push_back(std::vector<std::string>());
-        for (int i = 0; i < nCol; i++)
-        {
-            data->results.back().push_back(colNames[i]);
-        }
+        std::cerr << "query: " << query << std::endl;
+        std::cerr << "[" << op << "]: SQL error " << rc << ": " << sqlite3_errmsg(conn) << std::endl;
+        assert(0);
     }
+}
 
-    data->results.push_back(std::vector<std::string>());
-    for (int i = 0; i < nCol; i++)
+sqlite3_stmt *SQLite::prepare(const std::string &query)
+{
+    sqlite3_stmt *stmt = nullptr;
+    int rc = sqlite3_prepare_v2(conn, query.c_str(), -1, &stmt, nullptr);
+    if (rc != SQLITE_OK)
     {
-        data->results.back().push_back(colValue[i] ? colValue[i] : "NULL");
+        std::cerr << "query: " << query << std::endl;
+        std::cerr << "[prepare]: SQL error " << rc << ": " << sqlite3_errmsg(conn) << std::endl;
+        assert(0);
     }
-
-    return 0;
+    return stmt;
 }
 
-int SQLite::createTable(const std::string tableName)
+void SQLite::prepareStatements()
 {
-    std::string query = "CREATE TABLE IF NOT EXISTS " + tableName + "("
-                                                                    "KEY      CHAR(64) PRIMARY KEY    NOT NULL,"
-                                                                    "VALUE    TEXT                    NOT NULL);";
+    getStmt = prepare("SELECT VALUE FROM " + table + " WHERE KEY = ?1;");
+    putStmt = prepare("INSERT OR REPLACE INTO " + table + " (KEY, VALUE) VALUES(?1, ?2);");
+    beginStmt = prepare("BEGIN TRANSACTION;");
+    commitStmt = prepare("COMMIT;");
+}
 
-    int rc = sqlite3_exec(*db, query.c_str(), this->callback, 0, nullptr);
+void SQLite::finalizeStatements()
+{
+    // Finalizing a NULL statement is a no-op.
+    sqlite3_finalize(getStmt);
+    sqlite3_finalize(putStmt);
+    sqlite3_finalize(beginStmt);
+    sqlite3_finalize(commitStmt);
+    getStmt = putStmt = beginStmt = commitStmt = nullptr;
+}
 
-    if (rc != SQLITE_OK)
+// Run a statement that returns no row, then reset it for the next use.
+void SQLite::run(sqlite3_stmt *stmt, const char *op)
+{
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE)
     {
-        std::cerr << "query: " << query << std::endl;
-        std::cerr << "[createTable]: SQL error " << rc << ": " << sqlite3_errmsg(*db) << std::endl;
+        std::cerr << "[" << op << "]: SQL error " << rc << ": " << sqlite3_errmsg(conn) << std::endl;
         assert(0);
-        return 1;
-    }
-    else
-    {
-        return 0;
     }
+    sqlite3_reset(stmt);
+}
+
+// Insert or overwrite without reading the previous value.
+void SQLite::upsert(uint64_t key, uint64_t value)
+{
+    sqlite3_bind_int64(putStmt, 1, (sqlite3_int64)key);
+    sqlite3_bind_int64(putStmt, 2, (sqlite3_int64)value);
+    run(putStmt, "PUT");
+}
+
+void SQLite::begin()
+{
+    run(beginStmt, "BEGIN");
+}
+
+void SQLite::commit()
+{
+    run(commitStmt, "COMMIT");
 }
 
 // Public methods
@@ -55,6 +83,9 @@ int SQLite::createTable(const std::string tableName)
 SQLite::SQLite()
 {
     _dbInstance = "SQLite";
+    conn = nullptr;
+    inBatch = false;
+    getStmt = putStmt = beginStmt = commitStmt = nullptr;
 }
 
 int SQLite::Open(const std::string dbName)
@@ -62,20 +93,26 @@ int SQLite::Open(const std::string dbName)
     //std::string sqliteName = dbName + "_SQLite";
     std::string sqliteName = dbName;
     #if EXT_DB == SQL_PERSISTENT
-        int rc = sqlite3_open(sqliteName.c_str(), db);
+        int rc = sqlite3_open(sqliteName.c_str(), &conn);
         std::cout << std::endl << "SQlite Persistent.";
     #else
-        int rc = sqlite3_open(":memory:", db);
+        int rc = sqlite3_open(":memory:", &conn);
         std::cout << std::endl << "SQlite In-Memory.";
     #endif
 
     if (rc != SQLITE_OK)
     {
-        std::cerr << "Error opening SQLite3 database: " << sqlite3_errmsg(*db) << std::endl;
-        sqlite3_close(*db);
+        std::cerr << "Error opening SQLite3 database: " << sqlite3_errmsg(conn) << std::endl;
+        sqlite3_close(conn);
         assert(0);
     }
 
+    #if EXT_DB == SQL_PERSISTENT
+        // Commits append to the log, only checkpoints wait for the disk.
+        exec("PRAGMA journal_mode=WAL;", "Open");
+        exec("PRAGMA synchronous=NORMAL;", "Open");
+    #endif
+
     if (SelectTable("KV") != 0)
     {
         return rc;
@@ -87,45 +124,46 @@ int SQLite::Open(const std::string dbName)
     return rc;
 }
 
+#if ISEOV
+void SQLite::Init(const std::string value)
+{
+    uint64_t init_value = std::stoull(value);
+    std::lock_guard<std::mutex> guard(lock);
+    begin();
+    for (uint64_t i = 0; i < g_account_num + 10; i++)
+    {
+        upsert(i, init_value);
+    }
+    commit();
+
+    std::cout << "SQLite::Init DONE" << std::endl;
+}
+#endif
+
 std::string SQLite::Get(const std::string key)
 {
     std::string value;
-    res_data res("GET");
+    std::lock_guard<std::mutex> guard(lock);
 
-    std::string query = "SELECT KEY, VALUE FROM " + this->table + " WHERE KEY = '" + key + "';";
-    int rc = sqlite3_exec(*db, query.c_str(), this->callback, (void *)&res, nullptr);
-    if (rc != SQLITE_OK)
+    // Numeric keys take the INTEGER affinity of the KEY column.
+    sqlite3_bind_text(getStmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = sqlite3_step(getStmt);
+    if (rc == SQLITE_ROW)
     {
-        std::cerr << "query: " << query << std::endl;
-        std::cerr << "[GET]: SQL error " << rc << ": " << sqlite3_errmsg(*db) << std::endl;
-        assert(0);
+        value = (const char *)sqlite3_column_text(getStmt, 0);
     }
-
-    // Print all returned ROWS
-    // First row contains the name of each returned columns
-    // The next rows contain the actual values return
-    //for(auto &row: res.res) {
-    //    for(auto &col: row) {
-    //        std::cout << col << " ";
-    //    }
-    //    std::cout << std::endl;
-    //}
-
-    if (res.results.size())
+    else if (rc != SQLITE_DONE)
     {
-        // skip first row that contains the COLUMN name
-        // skip first row that contains the KEY and return VALUE
-        value = res.results[1][1];
+        std::cerr << "[GET]: SQL error " << rc << ": " << sqlite3_errmsg(conn) << std::endl;
+        assert(0);
     }
+    sqlite3_reset(getStmt);
 
     return value;
 }
 
 std::string SQLite::Put(const std::string key, const std::string value)
 {
-    std::string query;
-    res_data res("PUT");
-
     std::string prev = Get(key);
     // If the value to be inserted is the same, just return
     if (value == prev)
@@ -133,59 +171,131 @@ std::string SQLite::Put(const std::string key, const std::string value)
         return prev;
     }
 
-    if (prev.size())
-    {
-        //std::cout << "Updating the value" << std::endl;
-        query = "UPDATE " + this->table + " set VALUE = '" + value + "' where KEY = '" + key + "';";
-    }
-    else
+    std::lock_guard<std::mutex> guard(lock);
+    sqlite3_bind_text(putStmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(putStmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+    run(putStmt, "PUT");
+
+    return prev;
+}
+
+uint64_t SQLite::Get(uint64_t key, uint64_t dflt)
+{
+    uint64_t value = dflt;
+    std::lock_guard<std::mutex> guard(lock);
+
+    sqlite3_bind_int64(getStmt, 1, (sqlite3_int64)key);
+    int rc = sqlite3_step(getStmt);
+    if (rc == SQLITE_ROW)
     {
-        //std::cout << "Inserting the value" << std::endl;
-        query = "INSERT INTO " + table + " (KEY, VALUE) VALUES('" + key + "', '" + value + "');";
+        value = (uint64_t)sqlite3_column_int64(getStmt, 0);
     }
-
-    int rc = sqlite3_exec(*db, query.c_str(), this->callback, (void *)&res, nullptr);
-    if (rc != SQLITE_OK)
+    else if (rc != SQLITE_DONE)
     {
-        std::cerr << "query: " << query << std::endl;
-        std::cerr << "[PUT]: Error executing SQLite query: " << sqlite3_errmsg(*db) << std::endl;
+        std::cerr << "[GET]: SQL error " << rc << ": " << sqlite3_errmsg(conn) << std::endl;
         assert(0);
     }
+    sqlite3_reset(getStmt);
 
-    return prev;
+    return value;
 }
 
-int SQLite::SelectTable(const std::string tableName)
+void SQLite::Put(uint64_t key, uint64_t value)
 {
-    std::string query = "SELECT name FROM sqlite_master WHERE type='table' AND name='" + tableName + "';";
-    res_data res("SelectTable");
+    std::lock_guard<std::mutex> guard(lock);
+    upsert(key, value);
+}
 
-    int rc = sqlite3_exec(*db, query.c_str(), this->callback, (void *)&res, nullptr);
-    if (rc != SQLITE_OK)
+// The writes share one transaction, the batch one if it is open.
+void SQLite::ApplyWriteSet(const RWSet &writes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    bool own = !inBatch;
+    if (own)
     {
-        std::cerr << "query: " << query << std::endl;
-        std::cerr << "[SelectTable]: Error " << rc << " executing SQLite query: " << sqlite3_errmsg(*db) << std::endl;
-        assert(0);
-        return 1;
+        begin();
+    }
+    for (const auto &item : writes)
+    {
+        storeValue(item.first, item.buf);
+        upsert(item.first, item.second);
+    }
+    if (own)
+    {
+        commit();
     }
+}
 
-    this->table = tableName;
+// Versions are not kept, only the values are written.
+void SQLite::ApplyWriteSet(const Overlay &writes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    bool own = !inBatch;
+    if (own)
+    {
+        begin();
+    }
+    for (const auto &item : writes)
+    {
+        storeValue(item.first, item.second.buf.get());
+        upsert(item.first, item.second.value);
+    }
+    if (own)
+    {
+        commit();
+    }
+}
 
-    if (res.results.size() == 0)
+void SQLite::BeginBatch()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!inBatch)
     {
-        return this->createTable(tableName);
+        begin();
+        inBatch = true;
     }
+}
+
+void SQLite::CommitBatch()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (inBatch)
+    {
+        commit();
+        inBatch = false;
+    }
+}
+
+int SQLite::SelectTable(const std::string tableName)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    exec("CREATE TABLE IF NOT EXISTS " + tableName + "("
+         "KEY      INTEGER PRIMARY KEY    NOT NULL,"
+         "VALUE    INTEGER                NOT NULL) WITHOUT ROWID;",
+         "SelectTable");
+
+    finalizeStatements();
+    this->table = tableName;
+    prepareStatements();
 
     return 0;
 }
 
 int SQLite::Close(const std::string dbName)
 {
-    if (*db != nullptr)
+    std::lock_guard<std::mutex> guard(lock);
+    if (conn == nullptr)
     {
-        delete db;
-        return 0;
+        return 1;
     }
 
-    return 1;
+    if (inBatch)
+    {
+        commit();
+        inBatch = false;
+    }
+    finalizeStatements();
+    sqlite3_close(conn);
+    conn = nullptr;
+    return 0;
 }
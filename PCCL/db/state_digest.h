@@ -0,0 +1,121 @@
+#ifndef _STATE_DIGEST_H_
+#define _STATE_DIGEST_H_
+
+#include <string>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+   Digest of the integer keys of the state: the sum, lane by lane modulo
+   2^64, of a hash of every (key, value) pair of a written key. An update
+   takes out the hash of the old pair and adds the hash of the new one, so
+   it costs the same whatever the size of the state, and updates may be
+   applied in any order. Replicas holding the same state have the same
+   digest whatever the order of their updates.
+
+   The hash detects diverging replicas; it is not meant to resist a
+   replica that crafts a colliding state.
+*/
+struct StateDigest
+{
+    static const int LANES = 4;
+    uint64_t lanes[LANES];
+
+    StateDigest()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (int i = 0; i < LANES; i++)
+        {
+            lanes[i] = 0;
+        }
+    }
+
+    // Add a pair. Not thread safe, used to build a digest then merged.
+    void add(uint64_t key, uint64_t value)
+    {
+        uint64_t h = pairHash(key, value);
+        for (int i = 0; i < LANES; i++)
+        {
+            lanes[i] += laneHash(h, i);
+        }
+    }
+
+    // Add a digest built with add. May run concurrently with update.
+    void merge(const StateDigest &other)
+    {
+        for (int i = 0; i < LANES; i++)
+        {
+            __atomic_add_fetch(&lanes[i], other.lanes[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    /*
+       Replace the pair of key. written tells if the key held oldValue
+       before, else it is a new key. May run concurrently with itself.
+    */
+    void update(uint64_t key, bool written, uint64_t oldValue, uint64_t newValue)
+    {
+        uint64_t h = pairHash(key, newValue);
+        uint64_t o = written ? pairHash(key, oldValue) : 0;
+        for (int i = 0; i < LANES; i++)
+        {
+            uint64_t delta = laneHash(h, i) - (written ? laneHash(o, i) : 0);
+            __atomic_add_fetch(&lanes[i], delta, __ATOMIC_RELAXED);
+        }
+    }
+
+    bool operator==(const StateDigest &other) const
+    {
+        for (int i = 0; i < LANES; i++)
+        {
+            if (lanes[i] != other.lanes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const StateDigest &other) const
+    {
+        return !(*this == other);
+    }
+
+    std::string toString() const
+    {
+        char buf[LANES * 16 + 1];
+        for (int i = 0; i < LANES; i++)
+        {
+            snprintf(buf + i * 16, 17, "%016llx", (unsigned long long)lanes[i]);
+        }
+        return std::string(buf, LANES * 16);
+    }
+
+private:
+    // Finalizer of MurmurHash3.
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t pairHash(uint64_t key, uint64_t value)
+    {
+        return mix(mix(key ^ 0x6a09e667f3bcc908ULL) ^ value);
+    }
+
+    static uint64_t laneHash(uint64_t h, int lane)
+    {
+        return mix(h + (lane + 1) * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+#endif
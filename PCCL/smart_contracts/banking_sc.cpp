@@ -1,23 +1,36 @@
 #include "global.h"
 #include "smart_contract.h"
 #include "smart_contract_txn.h"
+#include "overlay.h"
 
 #if BANKING_SMART_CONTRACT
+#if ISEOV
+// Accounts that were never written start with a balance of 10000.
+static inline uint64_t get_balance(uint64_t id, uint64_t &version)
+{
+    return db->Get(id, 10000, version);
+}
+
+// Balance as seen through an overlay of not yet committed writes.
+static inline uint64_t get_balance(uint64_t id, Overlay &overlay, uint64_t &version)
+{
+    return state_get(overlay, id, 10000, version);
+}
+#endif
+
 /*
 returns:
      1 for commit 
      0 for abort
 */
-uint64_t TransferMoneySmartContract::execute()
+uint64_t TransferMoneySmartContract::execute(DataBase *state)
 {
-    string temp = db->Get(std::to_string(this->source_id));
-    uint64_t source = temp.empty() ? 0 : stoi(temp);
-    temp = db->Get(std::to_string(this->dest_id));
-    uint64_t dest = temp.empty() ? 0 : stoi(temp);
+    uint64_t source = state->Get(this->source_id, 0);
+    uint64_t dest = state->Get(this->dest_id, 0);
     if (amount <= source)
     {
-        db->Put(std::to_string(this->source_id), std::to_string(source - amount));
-        db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+        state->Put(this->source_id, source - amount);
+        state->Put(this->dest_id, dest + amount);
         return 1;
     }
     return 0;
@@ -27,11 +40,10 @@ uint64_t TransferMoneySmartContract::execute()
 returns:
      1 for commit 
 */
-uint64_t DepositMoneySmartContract::execute()
+uint64_t DepositMoneySmartContract::execute(DataBase *state)
 {
-    string temp = db->Get(std::to_string(this->dest_id));
-    uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+    uint64_t dest = state->Get(this->dest_id, 0);
+    state->Put(this->dest_id, dest + amount);
     return 1;
 }
 
@@ -40,57 +52,41 @@ returns:
      1 for commit 
      0 for abort
 */
-uint64_t WithdrawMoneySmartContract::execute()
+uint64_t WithdrawMoneySmartContract::execute(DataBase *state)
 {
-    string temp = db->Get(std::to_string(this->source_id));
 #if SB_READ_TX
+    state->Get(this->source_id, 0);
     return 1;
 #else
-    uint64_t source = temp.empty() ? 0 : stoi(temp);
+    uint64_t source = state->Get(this->source_id, 0);
     if (amount <= source)
     {
-        db->Put(std::to_string(this->source_id), std::to_string(source - amount));
+        state->Put(this->source_id, source - amount);
         return 1;
     }
 #endif
     return 0;
 }
 
-#if ISEOV
+#if ISEOV && !HOT_ESCROW
 #if PRE_EX
-uint64_t TransferMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+uint64_t TransferMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
-    string temp;
-    if (speculateSet.find(this->source_id) == speculateSet.end())
-    {
-        temp = db->Get(std::to_string(this->source_id));
-    }
-    else {
-        temp = std::to_string(speculateSet[this->source_id]);
-    }
-    
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->source_id] = source;
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, speculateSet, source_version);
+    readSet[this->source_id] = read_stamp(source, source_version);
 
-    if (speculateSet.find(this->dest_id) == speculateSet.end())
-    {
-        temp = db->Get(std::to_string(this->dest_id));
-    }
-    else {
-        temp = std::to_string(speculateSet[this->dest_id]);
-    }
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->dest_id] = dest;
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, speculateSet, dest_version);
+    readSet[this->dest_id] = read_stamp(dest, dest_version);
     writeSet[this->source_id] = source - amount;
     writeSet[this->dest_id] = dest + amount;
-    speculateSet[this->source_id] = source - amount;
-    speculateSet[this->dest_id] = dest + amount;   
+    overlay_put(speculateSet, this->source_id, source - amount, source_version);
+    overlay_put(speculateSet, this->dest_id, dest + amount, dest_version);
     if (amount <= source)
     {
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
-        //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+        //db->Put(this->source_id, source - amount);
+        //db->Put(this->dest_id, dest + amount);
         //writeSet[this->source_id] = source - amount;
         //writeSet[this->dest_id] = dest + amount;
         return 1;
@@ -99,73 +95,56 @@ uint64_t TransferMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, m
 }
 
 /*
+A deposit does not depend on the balance, so it is a delta write with no
+read: deposits to a same account do not conflict with each other. Later
+txns of the batch still see the deposited balance through speculateSet.
 returns:
      1 for commit 
 */
-uint64_t DepositMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+uint64_t DepositMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
-    string temp;
-    if (speculateSet.find(this->dest_id) == speculateSet.end())
-    {
-        temp = db->Get(std::to_string(this->dest_id));
-    }
-    else {
-        temp = std::to_string(speculateSet[this->dest_id]);
-    }
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->dest_id] = dest;
-    //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
-    writeSet[this->dest_id] = dest + amount;
-    speculateSet[this->dest_id] = dest + amount;
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, speculateSet, dest_version);
+    writeSet.add(this->dest_id, amount);
+    overlay_put(speculateSet, this->dest_id, dest + amount, dest_version);
     return 1;
 }
 
-uint64_t WithdrawMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+uint64_t WithdrawMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
-    string temp;
-    if (speculateSet.find(this->source_id) == speculateSet.end())
-    {
-        temp = db->Get(std::to_string(this->source_id));
-    }
-    else {
-        temp = std::to_string(speculateSet[this->source_id]);
-    }
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->source_id] = source;
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, speculateSet, source_version);
+    readSet[this->source_id] = read_stamp(source, source_version);
 #if SB_READ_TX
+    // Read only, later txns keep seeing the version that was read.
     writeSet[this->source_id] = source;
-    speculateSet[this->source_id] = source;
 #else
     writeSet[this->source_id] = source - amount;
-    speculateSet[this->source_id] = source - amount;
+    overlay_put(speculateSet, this->source_id, source - amount, source_version);
 #endif
     if (amount <= source)
     {
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
+        //db->Put(this->source_id, source - amount);
         //writeSet[this->source_id] = source - amount;
         return 1;
     }
     return 0;
 }
 #else
-uint64_t TransferMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
-{
-    string temp = db->Get(std::to_string(this->source_id));
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->source_id] = source;
-    temp = db->Get(std::to_string(this->dest_id));
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->dest_id] = dest;
+uint64_t TransferMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
+{
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, source_version);
+    readSet[this->source_id] = read_stamp(source, source_version);
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, dest_version);
+    readSet[this->dest_id] = read_stamp(dest, dest_version);
     writeSet[this->source_id] = source - amount;
     writeSet[this->dest_id] = dest + amount;
     if (amount <= source)
     {
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
-        //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+        //db->Put(this->source_id, source - amount);
+        //db->Put(this->dest_id, dest + amount);
         //writeSet[this->source_id] = source - amount;
         //writeSet[this->dest_id] = dest + amount;
         return 1;
@@ -174,26 +153,21 @@ uint64_t TransferMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, m
 }
 
 /*
+A deposit is a delta write with no read, see above.
 returns:
      1 for commit 
 */
-uint64_t DepositMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t DepositMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
 {
-    string temp = db->Get(std::to_string(this->dest_id));
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->dest_id] = dest;
-    //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
-    writeSet[this->dest_id] = dest + amount;
+    writeSet.add(this->dest_id, amount);
     return 1;
 }
 
-uint64_t WithdrawMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t WithdrawMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
 {
-    string temp = db->Get(std::to_string(this->source_id));
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    readSet[this->source_id] = source;
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, source_version);
+    readSet[this->source_id] = read_stamp(source, source_version);
 #if SB_READ_TX
     writeSet[this->source_id] = source;
 #else
@@ -201,7 +175,7 @@ uint64_t WithdrawMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, m
 #endif
     if (amount <= source)
     {
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
+        //db->Put(this->source_id, source - amount);
         //writeSet[this->source_id] = source - amount;
         return 1;
     }
@@ -210,27 +184,27 @@ uint64_t WithdrawMoneySmartContract::simulate(map<uint64_t,uint64_t> &readSet, m
 #endif
 
 #if !RE_EXECUTE
-uint64_t TransferMoneySmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t TransferMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
 {
-    string temp = db->Get(std::to_string(this->source_id));
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->source_id] != source){
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, source_version);
+    if(readSet[this->source_id] != read_stamp(source, source_version)){
         DEBUG("test_v5:TransferMoneySmartContract::get_old_source = %ld, now source = %ld\n", readSet[this->source_id], source);
         return 0;
     }
-    temp = db->Get(std::to_string(this->dest_id));
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->dest_id] != dest){
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, dest_version);
+    if(readSet[this->dest_id] != read_stamp(dest, dest_version)){
         DEBUG("test_v5:TransferMoneySmartContract::get_old_dest = %ld, now dest = %ld\n", readSet[this->dest_id], dest);
         return 0;
     }
 
     if (amount <= source)
     {
-        db->Put(std::to_string(this->source_id), std::to_string(source - amount));
-        db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+        RWSet writes;
+        writes[this->source_id] = source - amount;
+        writes[this->dest_id] = dest + amount;
+        db->ApplyWriteSet(writes);
         return 1;
     }
     DEBUG("test_v5:TransferMoneySmartContract::v_and_c err\n");
@@ -238,16 +212,14 @@ uint64_t TransferMoneySmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, ma
 }
 
 
-uint64_t DepositMoneySmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t DepositMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
 {
-    string temp = db->Get(std::to_string(this->dest_id));
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->dest_id] != dest){
-        DEBUG("test_v5:TransferMoneySmartContract::get_old_dest = %ld, now dest = %ld\n", readSet[this->dest_id], dest);
-        return 0;
-    }
-    db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+    // Nothing was read, the amount is added to the current balance.
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, dest_version);
+    RWSet writes;
+    writes[this->dest_id] = dest + amount;
+    db->ApplyWriteSet(writes);
     return 1;
 }
 
@@ -256,64 +228,54 @@ returns:
      1 for commit 
      0 for abort
 */
-uint64_t WithdrawMoneySmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t WithdrawMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
 {
-    string temp = db->Get(std::to_string(this->source_id));
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->source_id] != source){
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, source_version);
+    if(readSet[this->source_id] != read_stamp(source, source_version)){
         DEBUG("test_v5:WithdrawMoneySmartContract::get_old_source = %ld, now source = %ld\n", readSet[this->source_id], source);
         return 0;
     }
+#if SB_READ_TX
+    return 1;
+#else
     if (amount <= source)
     {
-        db->Put(std::to_string(this->source_id), std::to_string(source - amount));
+        RWSet writes;
+        writes[this->source_id] = source - amount;
+        db->ApplyWriteSet(writes);
         return 1;
     }
+#endif
     DEBUG("test_v5:WithdrawMoneySmartContract::v_and_c err\n");
     return 0;
 }
 #else
-uint64_t TransferMoneySmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+uint64_t TransferMoneySmartContract::v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
     //DEBUG_V1("test_v6:enter TransferMoneySmartContract::v_and_merge\n");
     //string temp = db->Get(std::to_string(this->source_id));
-    string temp;
-    if (mergeSet.find(this->source_id) == mergeSet.end())
-    {
-        temp = db->Get(std::to_string(this->source_id));
-    }
-    else {
-        temp = std::to_string(mergeSet[this->source_id]);
-    }
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->source_id] != source){
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, mergeSet, source_version);
+    if(readSet[this->source_id] != read_stamp(source, source_version)){
         //DEBUG_V1("test_v5:Merge:TransferMoneySmartContract::get_old_source = %ld, now source = %ld\n", readSet[this->source_id], source);
         return 0;
     }
     //temp = db->Get(std::to_string(this->dest_id));
-    if (mergeSet.find(this->dest_id) == mergeSet.end())
-    {
-        temp = db->Get(std::to_string(this->dest_id));
-    }
-    else {
-        temp = std::to_string(mergeSet[this->dest_id]);
-    }
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->dest_id] != dest){
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, mergeSet, dest_version);
+    if(readSet[this->dest_id] != read_stamp(dest, dest_version)){
         //DEBUG_V1("test_v5:Merge:TransferMoneySmartContract::get_old_dest = %ld, now dest = %ld\n", readSet[this->dest_id], dest);
         return 0;
     }
 
     if (amount <= source)
     {
-        mergeSet[this->source_id] = source - amount;
-        mergeSet[this->dest_id] = dest + amount;
+        overlay_put(mergeSet, this->source_id, source - amount, source_version);
+        overlay_put(mergeSet, this->dest_id, dest + amount, dest_version);
         //DEBUG_V1("test_v6:enter TransferMoneySmartContract::return 1, source_key = %ld, amount = %ld, dest_key = %ld\n", this->source_id, amount, this->dest_id);
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
-        //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+        //db->Put(this->source_id, source - amount);
+        //db->Put(this->dest_id, dest + amount);
         return 1;
     }
     //DEBUG_V1("test_v5:Merge:TransferMoneySmartContract::v_and_c err\n");
@@ -321,26 +283,15 @@ uint64_t TransferMoneySmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet
 }
 
 
-uint64_t DepositMoneySmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+uint64_t DepositMoneySmartContract::v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
     //DEBUG_V1("test_v6:enter DepositMoneySmartContract::v_and_merge\n");
     //string temp = db->Get(std::to_string(this->dest_id));
-    string temp;
-    if (mergeSet.find(this->dest_id) == mergeSet.end())
-    {
-        temp = db->Get(std::to_string(this->dest_id));
-    }
-    else {
-        temp = std::to_string(mergeSet[this->dest_id]);
-    }
-    //uint64_t dest = temp.empty() ? 0 : stoi(temp);
-    uint64_t dest = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->dest_id] != dest){
-        //DEBUG_V1("test_v5:Merge:TransferMoneySmartContract::get_old_dest = %ld, now dest = %ld\n", readSet[this->dest_id], dest);
-        return 0;
-    }
-    mergeSet[this->dest_id] = dest + amount;
-    //db->Put(std::to_string(this->dest_id), std::to_string(dest + amount));
+    // Nothing was read, the amount is added to the merged balance.
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, mergeSet, dest_version);
+    overlay_put(mergeSet, this->dest_id, dest + amount, dest_version);
+    //db->Put(this->dest_id, dest + amount);
     return 1;
 }
 
@@ -349,21 +300,13 @@ returns:
      1 for commit 
      0 for abort
 */
-uint64_t WithdrawMoneySmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+uint64_t WithdrawMoneySmartContract::v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
     //DEBUG_V1("test_v6:enter WithdrawMoneySmartContract::v_and_merge\n");
     //string temp = db->Get(std::to_string(this->source_id));
-    string temp;
-    if (mergeSet.find(this->source_id) == mergeSet.end())
-    {
-        temp = db->Get(std::to_string(this->source_id));
-    }
-    else {
-        temp = std::to_string(mergeSet[this->source_id]);
-    }
-    //uint64_t source = temp.empty() ? 0 : stoi(temp);
-    uint64_t source = temp.empty() ? 10000 : stoi(temp);
-    if(readSet[this->source_id] != source){
+    uint64_t source_version;
+    uint64_t source = get_balance(this->source_id, mergeSet, source_version);
+    if(readSet[this->source_id] != read_stamp(source, source_version)){
        // DEBUG_V1("test_v5:Merge:WithdrawMoneySmartContract::get_old_source = %ld, now source = %ld\n", readSet[this->source_id], source);
         return 0;
     }
@@ -372,17 +315,368 @@ uint64_t WithdrawMoneySmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet
 #else
     if (amount <= source)
     {
-        mergeSet[this->source_id] = source - amount;
-        //db->Put(std::to_string(this->source_id), std::to_string(source - amount));
+        overlay_put(mergeSet, this->source_id, source - amount, source_version);
+        //db->Put(this->source_id, source - amount);
         return 1;
     }
 #endif
     //DEBUG_V1("test_v5:Merge:WithdrawMoneySmartContract::v_and_c err\n");
     return 0;
 }
+
+#if PARTIAL_RE_EXECUTE
+/*
+Re-execution of a txn that failed validation, on top of the merged writes
+of the batch. Same logic as v_and_merge without the read checks.
+returns:
+     1 for commit 
+     0 for abort
+*/
+uint64_t TransferMoneySmartContract::re_execute(Overlay &mergeSet)
+{
+    uint64_t source_version, dest_version;
+    uint64_t source = get_balance(this->source_id, mergeSet, source_version);
+    uint64_t dest = get_balance(this->dest_id, mergeSet, dest_version);
+    if (amount <= source)
+    {
+        overlay_put(mergeSet, this->source_id, source - amount, source_version);
+        overlay_put(mergeSet, this->dest_id, dest + amount, dest_version);
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t DepositMoneySmartContract::re_execute(Overlay &mergeSet)
+{
+    uint64_t dest_version;
+    uint64_t dest = get_balance(this->dest_id, mergeSet, dest_version);
+    overlay_put(mergeSet, this->dest_id, dest + amount, dest_version);
+    return 1;
+}
+
+uint64_t WithdrawMoneySmartContract::re_execute(Overlay &mergeSet)
+{
+    uint64_t source_version;
+#if SB_READ_TX
+    get_balance(this->source_id, mergeSet, source_version);
+    return 1;
+#else
+    uint64_t source = get_balance(this->source_id, mergeSet, source_version);
+    if (amount <= source)
+    {
+        overlay_put(mergeSet, this->source_id, source - amount, source_version);
+        return 1;
+    }
+    return 0;
+#endif
+}
+#endif
 #endif
 #endif
 
+#if ISEOV && HOT_ESCROW
+/*
+HOT_ESCROW: the balance of a split account is the sum of its escrow shards,
+and the account itself holds ESCROW_SPLIT. A withdrawal or a transfer takes
+the amount from the shard it picks, and only reads the others when that
+shard runs dry, so txns on a hot account that pick different shards do not
+conflict. Deposits, and the credit of a transfer to a split account, are
+delta writes to a shard.
+
+Every contract is written once against an EscrowView, which serves simulate
+and v_and_c alike.
+*/
+struct EscrowView
+{
+    Overlay *overlay; // speculateSet, or NULL for the store
+    RWSet *readSet;   // reads are recorded here when not NULL
+    RWSet *writeSet;
+
+    // Read key without recording it.
+    uint64_t peek(uint64_t key, uint64_t &version)
+    {
+        return overlay == NULL ? get_balance(key, version) : get_balance(key, *overlay, version);
+    }
+
+    uint64_t get(uint64_t key, uint64_t &version)
+    {
+        uint64_t value = peek(key, version);
+        if (readSet != NULL)
+        {
+            (*readSet)[key] = read_stamp(value, version);
+        }
+        return value;
+    }
+
+    void put(uint64_t key, uint64_t value, uint64_t version)
+    {
+        (*writeSet)[key] = value;
+        if (overlay != NULL)
+        {
+            overlay_put(*overlay, key, value, version);
+        }
+    }
+
+    void add(uint64_t key, uint64_t amount)
+    {
+        writeSet->add(key, amount);
+        if (overlay != NULL)
+        {
+            uint64_t version;
+            uint64_t value = peek(key, version);
+            overlay_put(*overlay, key, value + amount, version);
+        }
+    }
+};
+
+// Shard of a split account a contract uses, the same on every replica.
+static inline uint64_t escrow_pick(uint64_t id, uint64_t other, uint64_t amount)
+{
+    uint64_t h = id * 0x9e3779b97f4a7c15ULL ^ other * 0xc2b2ae3d27d4eb4fULL ^ amount;
+    h ^= h >> 29;
+    return h % HOT_ESCROW_SHARDS;
+}
+
+// Take amount from split account id: from shard pick if it holds enough,
+// else from the shards in turn. Returns false if they hold less together.
+static bool escrow_debit(EscrowView &view, uint64_t id, uint64_t amount, uint64_t pick)
+{
+    uint64_t values[HOT_ESCROW_SHARDS];
+    uint64_t versions[HOT_ESCROW_SHARDS];
+    values[pick] = view.get(escrow_key(id, pick), versions[pick]);
+    if (amount <= values[pick])
+    {
+        view.put(escrow_key(id, pick), values[pick] - amount, versions[pick]);
+        return true;
+    }
+
+    // The shard ran dry, fall back to the balance of the account.
+    uint64_t total = 0;
+    for (uint64_t s = 0; s < HOT_ESCROW_SHARDS; s++)
+    {
+        if (s != pick)
+        {
+            values[s] = view.get(escrow_key(id, s), versions[s]);
+        }
+        total += values[s];
+    }
+    if (amount > total)
+    {
+        return false;
+    }
+    uint64_t left = amount;
+    for (uint64_t i = 0; left > 0; i++)
+    {
+        uint64_t s = (pick + i) % HOT_ESCROW_SHARDS;
+        uint64_t take = min(left, values[s]);
+        if (take > 0)
+        {
+            view.put(escrow_key(id, s), values[s] - take, versions[s]);
+            left -= take;
+        }
+    }
+    return true;
+}
+
+static uint64_t escrow_transfer(EscrowView &view, uint64_t source_id, uint64_t dest_id, uint64_t amount)
+{
+    uint64_t pick = escrow_pick(source_id, dest_id, amount);
+    uint64_t source_version, dest_version;
+    uint64_t source = view.get(source_id, source_version);
+    uint64_t dest = view.get(dest_id, dest_version);
+    if (source == ESCROW_SPLIT)
+    {
+        if (!escrow_debit(view, source_id, amount, pick))
+        {
+            return 0;
+        }
+    }
+    else if (amount <= source)
+    {
+        view.put(source_id, source - amount, source_version);
+    }
+    else
+    {
+        return 0;
+    }
+    if (dest == ESCROW_SPLIT)
+    {
+        view.add(escrow_key(dest_id, pick), amount);
+    }
+    else
+    {
+        view.put(dest_id, dest + amount, dest_version);
+    }
+    return 1;
+}
+
+// Whether the account is split is not recorded as a read: the deposit is a
+// delta either way, and v_and_c sends it where the account is at commit.
+static uint64_t escrow_deposit(EscrowView &view, uint64_t dest_id, uint64_t amount)
+{
+    uint64_t dest_version;
+    if (view.peek(dest_id, dest_version) == ESCROW_SPLIT)
+    {
+        view.add(escrow_key(dest_id, escrow_pick(dest_id, dest_id, amount)), amount);
+    }
+    else
+    {
+        view.add(dest_id, amount);
+    }
+    return 1;
+}
+
+static uint64_t escrow_withdraw(EscrowView &view, uint64_t source_id, uint64_t amount)
+{
+    uint64_t source_version;
+    uint64_t source = view.get(source_id, source_version);
+    if (source == ESCROW_SPLIT)
+    {
+        return escrow_debit(view, source_id, amount, escrow_pick(source_id, source_id, amount));
+    }
+    if (amount <= source)
+    {
+        view.put(source_id, source - amount, source_version);
+        return 1;
+    }
+    return 0;
+}
+
+void escrow_split(uint64_t id, Overlay &overlay)
+{
+    uint64_t version;
+    uint64_t balance = get_balance(id, overlay, version);
+    if (balance == ESCROW_SPLIT)
+    {
+        return;
+    }
+    overlay_put(overlay, id, ESCROW_SPLIT, version);
+    for (uint64_t s = 0; s < HOT_ESCROW_SHARDS; s++)
+    {
+        uint64_t shard_version;
+        get_balance(escrow_key(id, s), overlay, shard_version);
+        uint64_t share = balance / HOT_ESCROW_SHARDS + (s < balance % HOT_ESCROW_SHARDS ? 1 : 0);
+        overlay_put(overlay, escrow_key(id, s), share, shard_version);
+    }
+}
+
+// Whether the reads of a txn still hold.
+static bool escrow_reads_valid(RWSet &readSet)
+{
+    for (const RWEntry &item : readSet)
+    {
+        uint64_t version;
+        uint64_t value = get_balance(item.first, version);
+        if (item.second != read_stamp(value, version))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Apply the writes of a txn, deltas added to the committed balances.
+static void escrow_commit(RWSet &writes)
+{
+    for (RWEntry &item : writes)
+    {
+        if (item.delta)
+        {
+            uint64_t version;
+            item.second += get_balance(item.first, version);
+            item.delta = false;
+        }
+    }
+    db->ApplyWriteSet(writes);
+}
+
+#if PRE_EX
+uint64_t TransferMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
+{
+    EscrowView view{&speculateSet, &readSet, &writeSet};
+    return escrow_transfer(view, this->source_id, this->dest_id, amount);
+}
+
+uint64_t DepositMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
+{
+    EscrowView view{&speculateSet, &readSet, &writeSet};
+    return escrow_deposit(view, this->dest_id, amount);
+}
+
+uint64_t WithdrawMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
+{
+    EscrowView view{&speculateSet, &readSet, &writeSet};
+    return escrow_withdraw(view, this->source_id, amount);
+}
+#else
+uint64_t TransferMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
+{
+    EscrowView view{NULL, &readSet, &writeSet};
+    return escrow_transfer(view, this->source_id, this->dest_id, amount);
+}
+
+uint64_t DepositMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
+{
+    EscrowView view{NULL, &readSet, &writeSet};
+    return escrow_deposit(view, this->dest_id, amount);
+}
+
+uint64_t WithdrawMoneySmartContract::simulate(RWSet &readSet, RWSet &writeSet)
+{
+    EscrowView view{NULL, &readSet, &writeSet};
+    return escrow_withdraw(view, this->source_id, amount);
+}
+#endif
+
+/*
+The reads are checked, then the contract runs again on the store: it reads
+what was read at simulation, so it takes the same shards.
+returns:
+     1 for commit 
+     0 for abort
+*/
+uint64_t TransferMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
+{
+    if (!escrow_reads_valid(readSet))
+    {
+        return 0;
+    }
+    RWSet writes;
+    EscrowView view{NULL, NULL, &writes};
+    if (!escrow_transfer(view, this->source_id, this->dest_id, amount))
+    {
+        return 0;
+    }
+    escrow_commit(writes);
+    return 1;
+}
+
+uint64_t DepositMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
+{
+    RWSet writes;
+    EscrowView view{NULL, NULL, &writes};
+    escrow_deposit(view, this->dest_id, amount);
+    escrow_commit(writes);
+    return 1;
+}
+
+uint64_t WithdrawMoneySmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
+{
+    if (!escrow_reads_valid(readSet))
+    {
+        return 0;
+    }
+    RWSet writes;
+    EscrowView view{NULL, NULL, &writes};
+    if (!escrow_withdraw(view, this->source_id, amount))
+    {
+        return 0;
+    }
+    escrow_commit(writes);
+    return 1;
+}
+#endif
+
 /*
 Smartt Contract Transaction Manager and Workload
 */
@@ -399,28 +693,28 @@ void SmartContractTxn::reset()
     TxnManager::reset();
 }
 
-RC SmartContractTxn::run_txn()
+RC SmartContractTxn::run_txn(DataBase *state)
 {
-    this->smart_contract->execute();
+    this->smart_contract->execute(state);
     return RCOK;
 };
 
 #if ISEOV
 #if PRE_EX
-RC SmartContractTxn::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+RC SmartContractTxn::simulate_txn(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
     this->smart_contract->simulate(readSet, writeSet, speculateSet);
     return RCOK;
 };
 #else
-RC SmartContractTxn::simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+RC SmartContractTxn::simulate_txn(RWSet &readSet, RWSet &writeSet)
 {
     this->smart_contract->simulate(readSet, writeSet);
     return RCOK;
 };
 #endif
 #if !RE_EXECUTE
-RC SmartContractTxn::validate_and_commit(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+RC SmartContractTxn::validate_and_commit(RWSet &readSet, RWSet &writeSet)
 {
 #if CHECK_CONFILICT
     if(this->smart_contract->v_and_c(readSet, writeSet) == RCOK){
@@ -433,7 +727,7 @@ RC SmartContractTxn::validate_and_commit(map<uint64_t,uint64_t> &readSet, map<ui
 #endif
 };
 #else
-RC SmartContractTxn::validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+RC SmartContractTxn::validate_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
 #if CHECK_CONFILICT
     if(this->smart_contract->v_and_merge(readSet, writeSet, mergeSet) == RCOK){
@@ -445,6 +739,16 @@ RC SmartContractTxn::validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uin
     return RCOK;
 #endif
 };
+
+#if PARTIAL_RE_EXECUTE
+RC SmartContractTxn::re_execute_txn(Overlay &mergeSet)
+{
+    if(this->smart_contract->re_execute(mergeSet) == RCOK){
+        return RCOK;
+    }
+    else return NONE;
+};
+#endif
 #endif
 
 #endif
@@ -464,7 +768,7 @@ RC SCWorkload::get_txn_man(TxnManager *&txn_manager)
     return RCOK;
 }
 
-uint64_t SmartContract::execute()
+uint64_t SmartContract::execute(DataBase *state)
 {
     int result = 0;
     switch (this->type)
@@ -472,19 +776,19 @@ uint64_t SmartContract::execute()
     case BSC_TRANSFER:
     {
         TransferMoneySmartContract *tm = (TransferMoneySmartContract *)this;
-        result = tm->execute();
+        result = tm->execute(state);
         break;
     }
     case BSC_DEPOSIT:
     {
         DepositMoneySmartContract *dm = (DepositMoneySmartContract *)this;
-        result = dm->execute();
+        result = dm->execute(state);
         break;
     }
     case BSC_WITHDRAW:
     {
         WithdrawMoneySmartContract *wm = (WithdrawMoneySmartContract *)this;
-        result = wm->execute();
+        result = wm->execute(state);
         break;
     }
     default:
@@ -500,7 +804,7 @@ uint64_t SmartContract::execute()
 
 #if ISEOV
 #if PRE_EX
-uint64_t SmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet)
+uint64_t SmartContract::simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet)
 {
     int result = 0;
     switch (this->type)
@@ -534,7 +838,7 @@ uint64_t SmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,u
         return NONE;
 }
 #else
-uint64_t SmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t SmartContract::simulate(RWSet &readSet, RWSet &writeSet)
 {
     int result = 0;
     switch (this->type)
@@ -569,7 +873,7 @@ uint64_t SmartContract::simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,u
 }
 #endif
 #if !RE_EXECUTE
-uint64_t SmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet)
+uint64_t SmartContract::v_and_c(RWSet &readSet, RWSet &writeSet)
 {
     int result = 0;
     switch (this->type)
@@ -603,7 +907,7 @@ uint64_t SmartContract::v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,ui
         return NONE;
 }
 #else
-uint64_t SmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet)
+uint64_t SmartContract::v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet)
 {
    // DEBUG_V1("test_v6:enter SmartContract::v_and_merge\n");
     int result = 0;
@@ -640,6 +944,42 @@ uint64_t SmartContract::v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_
     else
         return NONE;
 }
+
+#if PARTIAL_RE_EXECUTE
+uint64_t SmartContract::re_execute(Overlay &mergeSet)
+{
+    int result = 0;
+    switch (this->type)
+    {
+    case BSC_TRANSFER:
+    {
+        TransferMoneySmartContract *tm = (TransferMoneySmartContract *)this;
+        result = tm->re_execute(mergeSet);
+        break;
+    }
+    case BSC_DEPOSIT:
+    {
+        DepositMoneySmartContract *dm = (DepositMoneySmartContract *)this;
+        result = dm->re_execute(mergeSet);
+        break;
+    }
+    case BSC_WITHDRAW:
+    {
+        WithdrawMoneySmartContract *wm = (WithdrawMoneySmartContract *)this;
+        result = wm->re_execute(mergeSet);
+        break;
+    }
+    default:
+        assert(0);
+        break;
+    }
+
+    if (result)
+        return RCOK;
+    else
+        return NONE;
+}
+#endif
 #endif
 #endif
 
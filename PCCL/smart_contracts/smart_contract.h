@@ -5,21 +5,39 @@
 
 #if BANKING_SMART_CONTRACT
 
+#if HOT_ESCROW
+// Balance of an account split into escrow shards, see banking_sc.cpp.
+#define ESCROW_SPLIT UINT64_MAX
+
+// Key of shard s of account id, past the keys of the accounts.
+static inline uint64_t escrow_key(uint64_t id, uint64_t s)
+{
+    return g_account_num + 10 + id * HOT_ESCROW_SHARDS + s;
+}
+
+// Split account id into HOT_ESCROW_SHARDS shards sharing its balance,
+// writing them into overlay. Does nothing if it is split already.
+void escrow_split(uint64_t id, Overlay &overlay);
+#endif
+
 class SmartContract
 {
 public:
-    uint64_t execute();
+    uint64_t execute(DataBase *state);
     BSCType type;
 #if ISEOV
 #if PRE_EX
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
 #else
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet);
 #endif
 #if RE_EXECUTE
-    uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+#if PARTIAL_RE_EXECUTE
+    uint64_t re_execute(Overlay &mergeSet);
+#endif
 #else
-    uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t v_and_c(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 };
@@ -33,17 +51,20 @@ public:
     uint64_t source_id;
     uint64_t dest_id;
     uint64_t amount;
-    uint64_t execute();
+    uint64_t execute(DataBase *state);
 #if ISEOV
 #if PRE_EX
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
 #else
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet);
 #endif
 #if RE_EXECUTE
-    uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+#if PARTIAL_RE_EXECUTE
+    uint64_t re_execute(Overlay &mergeSet);
+#endif
 #else
-    uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t v_and_c(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 };
@@ -57,17 +78,20 @@ class DepositMoneySmartContract : public SmartContract
 public:
     uint64_t dest_id;
     uint64_t amount;
-    uint64_t execute();
+    uint64_t execute(DataBase *state);
 #if ISEOV
 #if PRE_EX
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
 #else
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet);
 #endif
 #if RE_EXECUTE
-    uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+#if PARTIAL_RE_EXECUTE
+    uint64_t re_execute(Overlay &mergeSet);
+#endif
 #else
-    uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t v_and_c(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 };
@@ -81,17 +105,20 @@ class WithdrawMoneySmartContract : public SmartContract
 public:
     uint64_t source_id;
     uint64_t amount;
-    uint64_t execute();
+    uint64_t execute(DataBase *state);
 #if ISEOV
 #if PRE_EX
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet);
 #else
-    uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t simulate(RWSet &readSet, RWSet &writeSet);
 #endif
 #if RE_EXECUTE
-    uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet);
+    uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet);
+#if PARTIAL_RE_EXECUTE
+    uint64_t re_execute(Overlay &mergeSet);
+#endif
 #else
-    uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet);
+    uint64_t v_and_c(RWSet &readSet, RWSet &writeSet);
 #endif
 #endif
 };
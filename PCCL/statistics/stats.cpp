@@ -60,9 +60,22 @@ void Stats_thd::clear()
 #if CHECK_CONFILICT
     valid_txn_cnt = 0;
     invalid_txn_cnt = 0;
-    #if ABORT_BATCH
+    #if ABORT_BATCH || PARTIAL_RE_EXECUTE
     re_execute_txn_cnt = 0;
     #endif
+#endif
+#if BLOCK_STM
+    stm_re_execute_cnt = 0;
+#endif
+#if PARTITIONED_EXECUTE
+    cross_partition_txn_cnt = 0;
+#endif
+#if HOT_ESCROW
+    escrow_split_cnt = 0;
+#endif
+#if DEFER_CONFLICTS
+    defer_txn_cnt = 0;
+    defer_committed_cnt = 0;
 #endif
     local_txn_commit_cnt = 0;
     remote_txn_commit_cnt = 0;
@@ -373,9 +386,22 @@ void Stats_thd::combine(Stats_thd *stats)
 #if CHECK_CONFILICT
     valid_txn_cnt += stats->valid_txn_cnt;
     invalid_txn_cnt += stats->invalid_txn_cnt;
-    #if ABORT_BATCH
+    #if ABORT_BATCH || PARTIAL_RE_EXECUTE
     re_execute_txn_cnt += stats->re_execute_txn_cnt;
     #endif
+#endif
+#if BLOCK_STM
+    stm_re_execute_cnt += stats->stm_re_execute_cnt;
+#endif
+#if PARTITIONED_EXECUTE
+    cross_partition_txn_cnt += stats->cross_partition_txn_cnt;
+#endif
+#if HOT_ESCROW
+    escrow_split_cnt += stats->escrow_split_cnt;
+#endif
+#if DEFER_CONFLICTS
+    defer_txn_cnt += stats->defer_txn_cnt;
+    defer_committed_cnt += stats->defer_committed_cnt;
 #endif
     local_txn_commit_cnt += stats->local_txn_commit_cnt;
     remote_txn_commit_cnt += stats->remote_txn_commit_cnt;
@@ -718,10 +744,23 @@ void Stats::print(bool prog)
 #if ISEOV && CHECK_CONFILICT
     fprintf(outf, "valid_tput         =%f\tvalid_txn_cnt=%ld\tinvalid_txn_cnt=%ld\tvalid_percentage=%f\n", valid_tput, totals->valid_txn_cnt, totals->invalid_txn_cnt, (double)totals->valid_txn_cnt/totals->txn_cnt);
     fprintf(outf, "NodeLatency=%f\n", (totals->txn_total_time_span / BILLION) / totals->txn_cnt);
-    #if ABORT_BATCH
+    #if ABORT_BATCH || PARTIAL_RE_EXECUTE
     fprintf(outf, "re_execute_txn_cnt=%ld\n", totals->re_execute_txn_cnt);
     #endif
 #endif    
+#if BLOCK_STM
+    fprintf(outf, "stm_re_execute_cnt=%ld\n", totals->stm_re_execute_cnt);
+#endif
+#if PARTITIONED_EXECUTE
+    fprintf(outf, "cross_partition_txn_cnt=%ld\n", totals->cross_partition_txn_cnt);
+#endif
+#if HOT_ESCROW
+    fprintf(outf, "escrow_split_cnt=%ld\n", totals->escrow_split_cnt);
+#endif
+#if DEFER_CONFLICTS
+    fprintf(outf, "defer_txn_cnt=%ld\n", totals->defer_txn_cnt);
+    fprintf(outf, "defer_committed_cnt=%ld\n", totals->defer_committed_cnt);
+#endif
     g_is_sharding ? fprintf(outf, "cput         =%f\tc_txn_cnt=%ld\n", c_tput, totals->cross_shard_txn_cnt): true;
     fprintf(outf, "=======================================================\n");
     fflush(outf);
@@ -52,9 +52,22 @@ public:
 #if CHECK_CONFILICT
     uint64_t valid_txn_cnt;
     uint64_t invalid_txn_cnt;
-    #if ABORT_BATCH
+    #if ABORT_BATCH || PARTIAL_RE_EXECUTE
     uint64_t re_execute_txn_cnt;
     #endif
+#endif
+#if BLOCK_STM
+    uint64_t stm_re_execute_cnt; // executions of a txn beyond its first one
+#endif
+#if PARTITIONED_EXECUTE
+    uint64_t cross_partition_txn_cnt; // txns touching several partitions
+#endif
+#if HOT_ESCROW
+    uint64_t escrow_split_cnt; // accounts split into escrow shards
+#endif
+#if DEFER_CONFLICTS
+    uint64_t defer_txn_cnt;       // requests held back to a later batch
+    uint64_t defer_committed_cnt; // requests held back that then passed validation
 #endif
     uint64_t local_txn_commit_cnt;
     uint64_t remote_txn_commit_cnt;
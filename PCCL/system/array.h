@@ -120,7 +120,7 @@ public:
 
     void swap(uint64_t i, uint64_t j)
     {
-        const T& tmp = items[i];
+        T tmp = items[i];
         items[i] = items[j];
         items[j] = tmp;
     }
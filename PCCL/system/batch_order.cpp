@@ -0,0 +1,180 @@
+#include "batch_order.h"
+#include "message.h"
+#include "ycsb_query.h"
+#include <algorithm>
+
+/*
+   Keys touched by one client request, appended to keys. Returns whether the
+   request writes them. YCSB requests give their record keys, all those of
+   the range for a scan, or with attr_keys the keys of all the columns of
+   the records, as found in the read/write sets. With reads_only, the keys
+   only written through a delta (deposits, YCSB increments) are left out.
+*/
+bool request_footprint(ClientQueryMessage *req, vector<uint64_t> &keys, bool attr_keys, bool reads_only)
+{
+    bool writer = false;
+#if BANKING_SMART_CONTRACT
+    BankingSmartContractMessage *bsc = (BankingSmartContractMessage *)req;
+    switch (bsc->type)
+    {
+    case BSC_TRANSFER:
+        keys.push_back(bsc->inputs[0]);
+        keys.push_back(bsc->inputs[2]);
+        writer = true;
+        break;
+    case BSC_DEPOSIT:
+        if (!reads_only)
+        {
+            keys.push_back(bsc->inputs[0]);
+        }
+        writer = true;
+        break;
+    case BSC_WITHDRAW:
+        keys.push_back(bsc->inputs[0]);
+#if !SB_READ_TX
+        writer = true;
+#endif
+        break;
+    default:
+        assert(0);
+        break;
+    }
+#else
+    YCSBClientQueryMessage *yq = (YCSBClientQueryMessage *)req;
+    for (uint64_t j = 0; j < yq->requests.size(); j++)
+    {
+        if (reads_only && yq->requests[j]->type == YCSB_INCREMENT)
+        {
+            writer = true;
+            continue;
+        }
+        // A scan covers scan_len records from its key.
+        uint64_t first = yq->requests[j]->key;
+        uint64_t last = first + 1;
+        if (yq->requests[j]->type == YCSB_SCAN)
+        {
+            last = first + yq->requests[j]->scan_len;
+        }
+        for (uint64_t key = first; key < last; key++)
+        {
+            if (attr_keys)
+            {
+                for (uint64_t c = 0; c < g_ycsb_column; c++)
+                {
+                    keys.push_back(key * g_ycsb_column + c);
+                }
+            }
+            else
+            {
+                keys.push_back(key);
+            }
+        }
+        if (yq->requests[j]->type == YCSB_UPDATE || yq->requests[j]->type == YCSB_INCREMENT)
+        {
+            writer = true;
+        }
+    }
+#endif
+    return writer;
+}
+
+#if BATCH_REORDER
+#if PRE_ORDER
+#error "BATCH_REORDER cannot be used with PRE_ORDER, the client state follows the arrival order"
+#endif
+
+// YCSB requests conflict at record granularity, as validation reads every
+// column of a record.
+void BatchReorderer::add_footprint(ClientQueryBatch *msg, uint64_t txn)
+{
+    bool writer = request_footprint(msg->cqrySet[txn], keys, false);
+    key_begin.push_back(keys.size());
+    is_writer.push_back(writer);
+}
+
+void BatchReorderer::order_writers()
+{
+#if BATCH_REORDER == DISJOINT_FIRST
+    std::stable_sort(writers.begin(), writers.end(), [this](uint32_t a, uint32_t b) {
+        return key_begin[a + 1] - key_begin[a] < key_begin[b + 1] - key_begin[b];
+    });
+
+    claimed.clear();
+    deferred.clear();
+    for (uint32_t w : writers)
+    {
+        bool disjoint = true;
+        for (uint32_t k = key_begin[w]; k < key_begin[w + 1]; k++)
+        {
+            if (claimed.count(keys[k]))
+            {
+                disjoint = false;
+                break;
+            }
+        }
+        if (!disjoint)
+        {
+            deferred.push_back(w);
+            continue;
+        }
+        for (uint32_t k = key_begin[w]; k < key_begin[w + 1]; k++)
+        {
+            claimed.insert(keys[k]);
+        }
+        order.push_back(w);
+    }
+
+    // Writers that lost a key to an earlier one, grouped by key.
+    std::stable_sort(deferred.begin(), deferred.end(), [this](uint32_t a, uint32_t b) {
+        return keys[key_begin[a]] < keys[key_begin[b]];
+    });
+    order.insert(order.end(), deferred.begin(), deferred.end());
+#else
+    order.insert(order.end(), writers.begin(), writers.end());
+#endif
+}
+
+void BatchReorderer::reorder(ClientQueryBatch *msg)
+{
+    uint64_t txn_cnt = msg->cqrySet.size();
+
+    keys.clear();
+    key_begin.assign(1, 0);
+    is_writer.clear();
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+        add_footprint(msg, i);
+    }
+
+    order.clear();
+    writers.clear();
+    for (uint32_t i = 0; i < txn_cnt; i++)
+    {
+        if (is_writer[i])
+        {
+            writers.push_back(i);
+        }
+        else
+        {
+            order.push_back(i);
+        }
+    }
+    order_writers();
+    assert(order.size() == txn_cnt);
+
+    // Apply the permutation, new position i takes request order[i].
+    reqs.resize(txn_cnt);
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+        reqs[i] = msg->cqrySet[i];
+    }
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+#if BANKING_SMART_CONTRACT
+        msg->cqrySet.set(i, (BankingSmartContractMessage *)reqs[order[i]]);
+#else
+        msg->cqrySet.set(i, (YCSBClientQueryMessage *)reqs[order[i]]);
+#endif
+    }
+}
+#endif
@@ -0,0 +1,47 @@
+#ifndef _BATCH_ORDER_H_
+#define _BATCH_ORDER_H_
+
+#include "global.h"
+#include <unordered_set>
+
+class ClientQueryBatch;
+class ClientQueryMessage;
+
+bool request_footprint(ClientQueryMessage *req, vector<uint64_t> &keys, bool attr_keys, bool reads_only = false);
+
+/*
+   Reorders the requests of a client batch on the primary, before they are
+   simulated and hashed, so that fewer of them fail validation at execute
+   time. The new order only depends on the content of the batch and is the
+   one shipped in BatchRequests, so every replica executes the same order.
+
+   Policies (BATCH_REORDER):
+   READERS_FIRST   read-only requests first, then the writers.
+   DISJOINT_FIRST  read-only requests first, then a greedy set of writers
+                   with pairwise disjoint keys (smallest footprint first),
+                   then the remaining writers grouped by their first key.
+   Ties always keep the arrival order.
+*/
+class BatchReorderer
+{
+public:
+    void reorder(ClientQueryBatch *msg);
+
+private:
+    void add_footprint(ClientQueryBatch *msg, uint64_t txn);
+    void order_writers();
+
+    // Footprint of the batch: the keys of txn i are
+    // keys[key_begin[i] .. key_begin[i + 1]).
+    vector<uint64_t> keys;
+    vector<uint32_t> key_begin;
+    vector<uint8_t> is_writer;
+
+    vector<uint32_t> order;
+    vector<uint32_t> writers;
+    vector<uint32_t> deferred;
+    unordered_set<uint64_t> claimed;
+    vector<ClientQueryMessage *> reqs;
+};
+
+#endif
@@ -0,0 +1,537 @@
+#include "block_stm.h"
+#include "txn.h"
+#include <thread>
+
+#if BLOCK_STM
+#if ISEOV
+#error "BLOCK_STM executes the txns of a batch on the replica, it needs ISEOV off"
+#endif
+
+void MVView::begin(uint32_t txn)
+{
+    this->txn = txn;
+    reads.clear();
+    writes.clear();
+    puts.clear();
+    blocking = -1;
+}
+
+uint64_t MVView::Get(uint64_t key, uint64_t dflt)
+{
+    // A txn reads its own writes first.
+    const RWEntry *w = writes.find(key);
+    if (w != nullptr)
+    {
+        return w->second;
+    }
+    return stm->read(*this, key, dflt);
+}
+
+void MVView::Put(uint64_t key, uint64_t value)
+{
+    writes[key] = value;
+    puts[key]++;
+}
+
+void MVView::PutValue(uint64_t key, ValueBuf *value)
+{
+    writes.put(key, value);
+    puts[key]++;
+}
+
+std::string MVView::Get(const std::string key)
+{
+    std::cerr << "MVView: string key " << key << " is not supported" << std::endl;
+    assert(0);
+    return std::string();
+}
+
+std::string MVView::Put(const std::string key, const std::string value)
+{
+    std::cerr << "MVView: string key " << key << " is not supported" << std::endl;
+    assert(0);
+    return std::string();
+}
+
+void BlockSTM::init(uint64_t worker_cnt)
+{
+    for (uint64_t i = 0; i <= worker_cnt; i++)
+    {
+        views.push_back(new MVView(this));
+    }
+    workers.resize(worker_cnt);
+    for (uint64_t i = 0; i < worker_cnt; i++)
+    {
+        WorkerArg *arg = new WorkerArg{this, i};
+        pthread_create(&workers[i], NULL, worker_main, (void *)arg);
+    }
+}
+
+void *BlockSTM::worker_main(void *arg)
+{
+    BlockSTM *stm = ((WorkerArg *)arg)->stm;
+    uint64_t worker = ((WorkerArg *)arg)->worker;
+    delete (WorkerArg *)arg;
+    uint64_t gen = 0;
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(stm->mtx);
+        stm->cv.wait(lock, [stm, gen] { return stm->open && stm->batch_gen != gen; });
+        gen = stm->batch_gen;
+        stm->running++;
+        lock.unlock();
+
+        stm->work(*stm->views[worker]);
+
+        lock.lock();
+        bool last = --stm->running == 0;
+        lock.unlock();
+        if (last)
+        {
+            stm->cv.notify_all();
+        }
+    }
+    return NULL;
+}
+
+uint64_t BlockSTM::run(vector<TxnManager *> &txns)
+{
+    this->txns = &txns;
+    txn_cnt = txns.size();
+    if (txn_cnt > state_cap)
+    {
+        states.reset(new TxnState[txn_cnt]);
+        state_cap = txn_cnt;
+    }
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+        TxnState &state = states[i];
+        state.incarnation = 0;
+        state.status = READY_TO_EXECUTE;
+        state.dependents.clear();
+        state.reads.reset();
+        state.written.clear();
+    }
+    execution_idx = 0;
+    validation_idx = 0;
+    decrease_cnt = 0;
+    active_tasks = 0;
+    executions = 0;
+    done = false;
+
+    std::unique_lock<std::mutex> lock(mtx);
+    batch_gen++;
+    open = true;
+    lock.unlock();
+    cv.notify_all();
+
+    work(*views.back());
+
+    // No worker may still touch the memory once it is applied.
+    lock.lock();
+    open = false;
+    cv.wait(lock, [this] { return running == 0; });
+    lock.unlock();
+
+    apply_writes();
+    return executions - txn_cnt;
+}
+
+void BlockSTM::work(MVView &view)
+{
+    Task task = {0, 0, NO_TASK};
+    while (!done)
+    {
+        if (task.kind == EXECUTION)
+        {
+            task = try_execute(task, view);
+        }
+        else if (task.kind == VALIDATION)
+        {
+            task = try_validate(task);
+        }
+        else
+        {
+            task = next_task();
+            if (task.kind == NO_TASK)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+/*
+   The lower of the two indexes goes first, so a txn is validated before
+   later txns are executed on top of it.
+*/
+BlockSTM::Task BlockSTM::next_task()
+{
+    if (validation_idx < execution_idx)
+    {
+        return next_version_to_validate();
+    }
+    return next_version_to_execute();
+}
+
+BlockSTM::Task BlockSTM::next_version_to_execute()
+{
+    if (execution_idx >= txn_cnt)
+    {
+        check_done();
+        return Task{0, 0, NO_TASK};
+    }
+    active_tasks++;
+    return try_incarnate(execution_idx.fetch_add(1));
+}
+
+BlockSTM::Task BlockSTM::next_version_to_validate()
+{
+    if (validation_idx >= txn_cnt)
+    {
+        check_done();
+        return Task{0, 0, NO_TASK};
+    }
+    active_tasks++;
+    uint64_t txn = validation_idx.fetch_add(1);
+    if (txn < txn_cnt)
+    {
+        TxnState &state = states[txn];
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (state.status == EXECUTED)
+        {
+            return Task{(uint32_t)txn, state.incarnation, VALIDATION};
+        }
+    }
+    active_tasks--;
+    return Task{0, 0, NO_TASK};
+}
+
+// Start the next incarnation of txn, if it is ready to execute.
+BlockSTM::Task BlockSTM::try_incarnate(uint64_t txn)
+{
+    if (txn < txn_cnt)
+    {
+        TxnState &state = states[txn];
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (state.status == READY_TO_EXECUTE)
+        {
+            state.status = EXECUTING;
+            return Task{(uint32_t)txn, state.incarnation, EXECUTION};
+        }
+    }
+    active_tasks--;
+    return Task{0, 0, NO_TASK};
+}
+
+/*
+   Run an incarnation. If it read an estimate, its result is dropped and
+   the txn waits for the writer of the estimate, unless the writer is
+   already done, in which case the txn runs again at once.
+*/
+BlockSTM::Task BlockSTM::try_execute(Task task, MVView &view)
+{
+    while (true)
+    {
+        view.begin(task.txn);
+        executions++;
+        (*txns)[task.txn]->run_txn(&view);
+        if (view.blocking < 0)
+        {
+            break;
+        }
+        if (add_dependency(task.txn, view.blocking))
+        {
+            return Task{0, 0, NO_TASK};
+        }
+    }
+    bool wrote_new_key = record(task.txn, task.incarnation, view);
+    return finish_execution(task.txn, task.incarnation, wrote_new_key);
+}
+
+BlockSTM::Task BlockSTM::try_validate(Task task)
+{
+    bool aborted = false;
+    if (!validate_reads(task.txn))
+    {
+        // Only one validation of an incarnation may abort it.
+        TxnState &state = states[task.txn];
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (state.status == EXECUTED && state.incarnation == task.incarnation)
+        {
+            state.status = ABORTING;
+            aborted = true;
+        }
+    }
+    if (aborted)
+    {
+        convert_to_estimates(task.txn);
+    }
+    return finish_validation(task.txn, aborted);
+}
+
+/*
+   Wake the txns waiting for txn. The later txns were validated against
+   the previous writes of txn, so they are validated again if txn wrote a
+   key it did not write before. Otherwise only txn itself needs validation.
+*/
+BlockSTM::Task BlockSTM::finish_execution(uint32_t txn, uint32_t incarnation, bool wrote_new_key)
+{
+    vector<uint32_t> dependents;
+    {
+        TxnState &state = states[txn];
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.status = EXECUTED;
+        dependents.swap(state.dependents);
+    }
+    if (!dependents.empty())
+    {
+        uint32_t lowest = txn_cnt;
+        for (uint32_t dep : dependents)
+        {
+            set_ready(dep);
+            lowest = min(lowest, dep);
+        }
+        decrease(execution_idx, lowest);
+    }
+
+    if (validation_idx > txn)
+    {
+        if (!wrote_new_key)
+        {
+            return Task{txn, incarnation, VALIDATION};
+        }
+        decrease(validation_idx, txn);
+    }
+    active_tasks--;
+    return Task{0, 0, NO_TASK};
+}
+
+/*
+   An aborted txn is executed again, and every later txn validated again
+   once it is.
+*/
+BlockSTM::Task BlockSTM::finish_validation(uint32_t txn, bool aborted)
+{
+    if (aborted)
+    {
+        set_ready(txn);
+        decrease(validation_idx, txn + 1);
+        if (execution_idx > txn)
+        {
+            return try_incarnate(txn);
+        }
+    }
+    active_tasks--;
+    return Task{0, 0, NO_TASK};
+}
+
+// Make txn wait for blocking. Returns false if blocking is already executed.
+bool BlockSTM::add_dependency(uint32_t txn, uint32_t blocking)
+{
+    {
+        TxnState &state = states[blocking];
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (state.status == EXECUTED)
+        {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> own(states[txn].lock);
+            states[txn].status = ABORTING;
+        }
+        state.dependents.push_back(txn);
+    }
+    active_tasks--;
+    return true;
+}
+
+void BlockSTM::set_ready(uint32_t txn)
+{
+    TxnState &state = states[txn];
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.incarnation++;
+    state.status = READY_TO_EXECUTE;
+}
+
+void BlockSTM::decrease(std::atomic<uint64_t> &idx, uint64_t target)
+{
+    uint64_t cur = idx;
+    while (cur > target && !idx.compare_exchange_weak(cur, target))
+    {
+    }
+    decrease_cnt++;
+}
+
+/*
+   The batch is done when both indexes are past the last txn and no task
+   is held. The count of decreases makes sure no index was lowered while
+   this was checked.
+*/
+void BlockSTM::check_done()
+{
+    uint64_t observed = decrease_cnt;
+    if (min(execution_idx.load(), validation_idx.load()) >= txn_cnt && active_tasks == 0 && observed == decrease_cnt)
+    {
+        done = true;
+    }
+}
+
+uint64_t BlockSTM::read(MVView &view, uint64_t key, uint64_t dflt)
+{
+    MVStripe &stripe = stripe_of(key);
+    {
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        auto it = stripe.keys.find(key);
+        if (it != stripe.keys.end())
+        {
+            auto v = it->second.lower_bound(view.txn);
+            if (v != it->second.begin())
+            {
+                --v;
+                if (v->second.estimate && view.blocking < 0)
+                {
+                    view.blocking = v->first;
+                }
+                view.reads.push_back(MVRead{key, v->first, v->second.incarnation});
+                return v->second.value;
+            }
+        }
+    }
+    view.reads.push_back(MVRead{key, -1, 0});
+    return db->Get(key, dflt);
+}
+
+/*
+   Put the writes of an incarnation in the memory, and drop those of the
+   previous incarnation to keys it no longer writes. Returns true if it
+   wrote a key the previous one did not.
+*/
+bool BlockSTM::record(uint32_t txn, uint32_t incarnation, MVView &view)
+{
+    TxnState &state = states[txn];
+    vector<uint64_t> written;
+    written.reserve(view.writes.size());
+    for (const RWEntry &w : view.writes)
+    {
+        MVStripe &stripe = stripe_of(w.first);
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        MVEntry &entry = stripe.keys[w.first][txn];
+        entry.incarnation = incarnation;
+        entry.estimate = false;
+        entry.value = w.second;
+        entry.puts = view.puts.find(w.first)->second;
+        entry.buf = ValueRef(w.buf);
+        written.push_back(w.first);
+    }
+
+    // Both lists of keys are sorted.
+    bool wrote_new_key = false;
+    uint64_t j = 0;
+    for (uint64_t key : written)
+    {
+        for (; j < state.written.size() && state.written[j] < key; j++)
+        {
+            erase_write(state.written[j], txn);
+        }
+        if (j < state.written.size() && state.written[j] == key)
+        {
+            j++;
+        }
+        else
+        {
+            wrote_new_key = true;
+        }
+    }
+    for (; j < state.written.size(); j++)
+    {
+        erase_write(state.written[j], txn);
+    }
+    state.written.swap(written);
+    std::atomic_store(&state.reads, std::shared_ptr<const vector<MVRead>>(new vector<MVRead>(std::move(view.reads))));
+    return wrote_new_key;
+}
+
+// Check that every read of txn would still see the same write.
+bool BlockSTM::validate_reads(uint32_t txn)
+{
+    std::shared_ptr<const vector<MVRead>> reads = std::atomic_load(&states[txn].reads);
+    for (const MVRead &read : *reads)
+    {
+        MVStripe &stripe = stripe_of(read.key);
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        int64_t writer = -1;
+        const MVEntry *entry = NULL;
+        auto it = stripe.keys.find(read.key);
+        if (it != stripe.keys.end())
+        {
+            auto v = it->second.lower_bound(txn);
+            if (v != it->second.begin())
+            {
+                --v;
+                writer = v->first;
+                entry = &v->second;
+            }
+        }
+        if (writer != read.txn)
+        {
+            return false;
+        }
+        if (entry != NULL && (entry->estimate || entry->incarnation != read.incarnation))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The writes of an aborted incarnation are likely written again.
+void BlockSTM::convert_to_estimates(uint32_t txn)
+{
+    for (uint64_t key : states[txn].written)
+    {
+        MVStripe &stripe = stripe_of(key);
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        stripe.keys[key][txn].estimate = true;
+    }
+}
+
+void BlockSTM::erase_write(uint64_t key, uint32_t txn)
+{
+    MVStripe &stripe = stripe_of(key);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    auto it = stripe.keys.find(key);
+    it->second.erase(txn);
+    if (it->second.empty())
+    {
+        stripe.keys.erase(it);
+    }
+}
+
+/*
+   Every key takes the value of its last writer, and its version grows by
+   the number of Puts of the batch, as if the txns ran one after another.
+*/
+void BlockSTM::apply_writes()
+{
+    for (uint64_t s = 0; s < MV_STRIPES; s++)
+    {
+        for (auto &item : stripes[s].keys)
+        {
+            uint64_t puts = 0;
+            for (auto &v : item.second)
+            {
+                puts += v.second.puts;
+            }
+            const MVEntry &last = item.second.rbegin()->second;
+            assert(!last.estimate);
+            uint64_t version;
+            db->Get(item.first, 0, version);
+            final_writes[item.first] = OverlayEntry{last.value, version + puts, last.buf};
+        }
+        stripes[s].keys.clear();
+    }
+    db->ApplyWriteSet(final_writes);
+    final_writes.clear();
+}
+#endif
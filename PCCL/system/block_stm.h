@@ -0,0 +1,198 @@
+#ifndef _BLOCK_STM_H_
+#define _BLOCK_STM_H_
+
+#include "global.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+
+class TxnManager;
+class BlockSTM;
+
+// A read of a txn: the key, and the incarnation of the earlier txn of the
+// batch whose write it saw, or txn -1 if it read the database.
+struct MVRead
+{
+    uint64_t key;
+    int64_t txn;
+    uint32_t incarnation;
+};
+
+/*
+   The state as seen by one incarnation of a txn run by BlockSTM. A read
+   finds the write of the closest earlier txn of the batch in the
+   multi-version memory, or else goes to the database, and is recorded with
+   what it saw. Writes stay in the view until the incarnation is done. The
+   view does not keep versions, and only has integer keys.
+*/
+class MVView : public DataBase
+{
+public:
+    using DataBase::Get;
+    using DataBase::Put;
+    MVView(BlockSTM *stm) : stm(stm) {}
+
+    // Start an incarnation of txn.
+    void begin(uint32_t txn);
+
+    uint64_t Get(uint64_t key, uint64_t dflt);
+    void Put(uint64_t key, uint64_t value);
+    void PutValue(uint64_t key, ValueBuf *value);
+
+    int Open(const std::string id = {}) { return 0; }
+    std::string Get(const std::string key);
+    std::string Put(const std::string key, const std::string value);
+    int SelectTable(const std::string tableName) { return 0; }
+    int Close(const std::string id = {}) { return 0; }
+
+    uint32_t txn;
+    vector<MVRead> reads;
+    RWSet writes;
+    RWSet puts; // number of Puts of each written key
+    // An earlier txn whose write was read while it was an estimate, -1 if
+    // none. The incarnation then has to wait for that txn.
+    int64_t blocking;
+
+private:
+    BlockSTM *stm;
+};
+
+/*
+   Executes the txns of a batch on a pool of threads, with the result of
+   running them one after another in batch order (Block-STM). Every txn runs
+   optimistically against a multi-version memory holding, for each key, the
+   write of each txn of the batch. A txn reads the write of the closest
+   earlier txn, and its reads are validated once it is done: if an earlier
+   txn since wrote a different value, the txn is run again as a new
+   incarnation, and its writes are marked as estimates meanwhile so the
+   later txns reading them wait for it. Only what a write invalidates is
+   executed again. Once every txn is executed and validated, the last write
+   of each key goes to the database.
+
+   Tasks are handed out from two indexes, the next txn to execute and the
+   next one to validate, lowered when a txn is to be executed or validated
+   again. The calling thread takes part in the work. Views and the memory
+   are reused from one batch to the next.
+*/
+class BlockSTM
+{
+public:
+    void init(uint64_t worker_cnt);
+    uint64_t get_worker_cnt() { return workers.size() + 1; }
+
+    /*
+       Execute txns[0..n) and apply their writes to the database. Returns
+       the number of executions beyond the first one of each txn.
+    */
+    uint64_t run(vector<TxnManager *> &txns);
+
+    // Read key for txn through view.
+    uint64_t read(MVView &view, uint64_t key, uint64_t dflt);
+
+private:
+    enum Status
+    {
+        READY_TO_EXECUTE,
+        EXECUTING,
+        EXECUTED,
+        ABORTING
+    };
+    enum TaskKind
+    {
+        NO_TASK,
+        EXECUTION,
+        VALIDATION
+    };
+    struct Task
+    {
+        uint32_t txn;
+        uint32_t incarnation;
+        TaskKind kind;
+    };
+
+    struct TxnState
+    {
+        std::mutex lock; // status, incarnation and dependents
+        uint32_t incarnation;
+        Status status;
+        vector<uint32_t> dependents; // txns waiting for this one
+        // Reads of the last recorded incarnation, swapped atomically as a
+        // validation may read them while the txn runs again.
+        std::shared_ptr<const vector<MVRead>> reads;
+        vector<uint64_t> written; // keys written by the last recorded incarnation
+    };
+
+    // Write of a txn to a key.
+    struct MVEntry
+    {
+        uint32_t incarnation;
+        bool estimate;
+        uint64_t value;
+        uint64_t puts;
+        ValueRef buf;
+    };
+    typedef std::map<uint32_t, MVEntry> MVVersions; // by txn
+    static const uint64_t MV_STRIPES = 256;
+    struct MVStripe
+    {
+        std::mutex lock;
+        unordered_map<uint64_t, MVVersions> keys;
+    };
+
+    struct WorkerArg
+    {
+        BlockSTM *stm;
+        uint64_t worker;
+    };
+    static void *worker_main(void *arg);
+    void work(MVView &view);
+
+    Task next_task();
+    Task next_version_to_execute();
+    Task next_version_to_validate();
+    Task try_incarnate(uint64_t txn);
+    Task try_execute(Task task, MVView &view);
+    Task try_validate(Task task);
+    Task finish_execution(uint32_t txn, uint32_t incarnation, bool wrote_new_key);
+    Task finish_validation(uint32_t txn, bool aborted);
+    bool add_dependency(uint32_t txn, uint32_t blocking);
+    void set_ready(uint32_t txn);
+    void decrease(std::atomic<uint64_t> &idx, uint64_t target);
+    void check_done();
+
+    bool record(uint32_t txn, uint32_t incarnation, MVView &view);
+    bool validate_reads(uint32_t txn);
+    void convert_to_estimates(uint32_t txn);
+    void erase_write(uint64_t key, uint32_t txn);
+    void apply_writes();
+
+    MVStripe &stripe_of(uint64_t key) { return stripes[key % MV_STRIPES]; }
+
+    vector<pthread_t> workers;
+    vector<MVView *> views; // per worker, the last one for the calling thread
+
+    // The batch being run.
+    vector<TxnManager *> *txns;
+    uint64_t txn_cnt = 0;
+    std::unique_ptr<TxnState[]> states;
+    uint64_t state_cap = 0;
+    MVStripe stripes[MV_STRIPES];
+    Overlay final_writes;
+
+    std::atomic<uint64_t> execution_idx;
+    std::atomic<uint64_t> validation_idx;
+    std::atomic<uint64_t> decrease_cnt;
+    std::atomic<int64_t> active_tasks;
+    std::atomic<uint64_t> executions;
+    std::atomic<bool> done;
+
+    // Workers join a batch while it is open, protected by mtx.
+    uint64_t batch_gen = 0;
+    bool open = false;
+    uint64_t running = 0;
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include "conflict_graph.h"
+#include "txn.h"
+#include "message.h"
+#include "batch_order.h"
+
+#if ISEOV
+void ConflictGraph::add_edge(uint32_t from, uint32_t to)
+{
+    if (from == to)
+    {
+        return;
+    }
+    succ[from].push_back(to);
+    indeg[to]++;
+}
+
+void ConflictGraph::reset(uint64_t cnt)
+{
+    txn_cnt = cnt;
+    if (succ.size() < txn_cnt)
+    {
+        succ.resize(txn_cnt);
+    }
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+        succ[i].clear();
+    }
+    indeg.assign(txn_cnt, 0);
+}
+
+void ConflictGraph::add_read(uint64_t key, uint32_t txn)
+{
+    KeyState &ks = keys.emplace(key, KeyState{-1, {}}).first->second;
+    if (!ks.readers.empty() && ks.readers.back() == txn)
+    {
+        return;
+    }
+    // Read-after-write.
+    if (ks.last_writer >= 0)
+    {
+        add_edge(ks.last_writer, txn);
+    }
+    ks.readers.push_back(txn);
+}
+
+void ConflictGraph::add_write(uint64_t key, uint32_t txn)
+{
+    KeyState &ks = keys.emplace(key, KeyState{-1, {}}).first->second;
+    // Write-after-write and write-after-read.
+    if (ks.last_writer >= 0)
+    {
+        add_edge(ks.last_writer, txn);
+    }
+    for (uint32_t r : ks.readers)
+    {
+        add_edge(r, txn);
+    }
+    ks.last_writer = txn;
+    ks.readers.clear();
+}
+
+void ConflictGraph::build(vector<RWSet> &readSet, vector<RWSet> &writeSet, uint64_t cnt)
+{
+    reset(cnt);
+    keys.clear();
+
+    for (uint32_t j = 0; j < txn_cnt; j++)
+    {
+        for (const auto &item : readSet[j])
+        {
+            add_read(item.first, j);
+        }
+        for (const auto &item : writeSet[j])
+        {
+            add_write(item.first, j);
+        }
+    }
+}
+
+void ConflictGraph::build(BatchRequests *breq, uint64_t cnt)
+{
+    reset(cnt);
+    keys.clear();
+
+    // The sets come from the primary, while validation also touches the
+    // keys of the request. A txn writing is taken to write its whole
+    // footprint.
+    for (uint32_t j = 0; j < txn_cnt; j++)
+    {
+        footprint.clear();
+        bool writer = request_footprint(breq->requestMsg[j], footprint, true);
+        for (const auto &item : breq->readSet[j])
+        {
+            add_read(item.first, j);
+        }
+        if (!writer)
+        {
+            for (uint64_t key : footprint)
+            {
+                add_read(key, j);
+            }
+        }
+        for (const auto &item : breq->writeSet[j])
+        {
+            add_write(item.first, j);
+        }
+        if (writer)
+        {
+            for (uint64_t key : footprint)
+            {
+                add_write(key, j);
+            }
+        }
+    }
+}
+#endif
+
+#if PARALLEL_VALIDATE || PARALLEL_SIMULATE
+
+void GraphScheduler::init(uint64_t worker_cnt)
+{
+    workers.resize(worker_cnt);
+    for (uint64_t i = 0; i < worker_cnt; i++)
+    {
+        WorkerArg *arg = new WorkerArg{this, i};
+        pthread_create(&workers[i], NULL, worker_main, (void *)arg);
+    }
+}
+
+// Called between two graphs, when no worker has a transaction.
+GraphScheduler::~GraphScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    for (pthread_t &thd : workers)
+    {
+        pthread_join(thd, NULL);
+    }
+}
+
+void *GraphScheduler::worker_main(void *arg)
+{
+    GraphScheduler *sched = ((WorkerArg *)arg)->sched;
+    uint64_t worker = ((WorkerArg *)arg)->worker;
+    delete (WorkerArg *)arg;
+    while (sched->work(true, worker))
+    {
+    }
+    return NULL;
+}
+
+/*
+   Process one ready transaction and release its successors. If wait is set,
+   block until a transaction is ready, otherwise return false when there is
+   none. Also returns false once the scheduler is stopped.
+*/
+bool GraphScheduler::work(bool wait, uint64_t worker)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    if (wait)
+    {
+        cv.wait(lock, [this] { return stop || !ready.empty(); });
+    }
+    if (ready.empty())
+    {
+        return false;
+    }
+
+    uint32_t txn = ready.back();
+    ready.pop_back();
+    lock.unlock();
+
+    process(txn, worker);
+
+    lock.lock();
+    bool notify = false;
+    for (uint32_t s : cur_graph->successors(txn))
+    {
+        if (--pending[s] == 0)
+        {
+            ready.push_back(s);
+            notify = true;
+        }
+    }
+    if (--remaining == 0)
+    {
+        notify = true;
+    }
+    lock.unlock();
+
+    if (notify)
+    {
+        cv.notify_all();
+    }
+    return true;
+}
+
+/*
+   Process every transaction of graph and return once all are done.
+*/
+void GraphScheduler::schedule(ConflictGraph &graph)
+{
+    uint64_t txn_cnt = graph.size();
+    std::unique_lock<std::mutex> lock(mtx);
+    cur_graph = &graph;
+    pending.resize(txn_cnt);
+    ready.clear();
+    // Push in reverse so that workers pop roots in batch order.
+    for (int64_t i = txn_cnt - 1; i >= 0; i--)
+    {
+        pending[i] = graph.indegree(i);
+        if (pending[i] == 0)
+        {
+            ready.push_back(i);
+        }
+    }
+    remaining = txn_cnt;
+    lock.unlock();
+    cv.notify_all();
+
+    // The calling thread helps until the whole graph is done.
+    uint64_t self = workers.size();
+    while (true)
+    {
+        if (work(false, self))
+        {
+            continue;
+        }
+        lock.lock();
+        cv.wait(lock, [this] { return remaining == 0 || !ready.empty(); });
+        bool done = remaining == 0;
+        lock.unlock();
+        if (done)
+        {
+            break;
+        }
+    }
+}
+#endif
+
+#if PARALLEL_VALIDATE
+#if !ISEOV || RE_EXECUTE || !CHECK_CONFILICT
+#error "PARALLEL_VALIDATE needs ISEOV and CHECK_CONFILICT without RE_EXECUTE"
+#endif
+
+void ParallelValidator::process(uint32_t txn, uint64_t worker)
+{
+    TxnManager *tman = (*txns)[txn];
+    (*valid)[txn] = tman->validate_and_commit((*readSet)[txn], (*writeSet)[txn]) == RCOK;
+}
+
+/*
+   Validate and commit txns[0..n) of batch breq. On return valid[i] tells if
+   txns[i] passed validation.
+*/
+void ParallelValidator::run(vector<TxnManager *> &txns, BatchRequests *breq, vector<uint8_t> &valid)
+{
+    graph.build(breq, txns.size());
+    valid.assign(txns.size(), 0);
+    this->txns = &txns;
+    this->readSet = &breq->readSet;
+    this->writeSet = &breq->writeSet;
+    this->valid = &valid;
+    schedule(graph);
+}
+#endif
+
+#if PARALLEL_SIMULATE
+#if !ISEOV
+#error "PARALLEL_SIMULATE needs ISEOV"
+#endif
+
+void ParallelSimulator::process(uint32_t txn, uint64_t worker)
+{
+    TxnManager *tman = (*txns)[txn];
+#if PRE_EX
+    // Overlay of this txn: the versions written by its writers.
+    Overlay &view = views[worker];
+    view.clear();
+    for (uint32_t k = key_begin[txn]; k < key_begin[txn + 1]; k++)
+    {
+        int64_t src = source[k];
+        if (src >= 0 && present[src])
+        {
+            view[keys[k]] = value[src];
+        }
+    }
+
+    tman->simulate_txn((*readSet)[txn], (*writeSet)[txn], view);
+
+    // Publish the version of this txn.
+    for (uint32_t k = key_begin[txn]; k < key_begin[txn + 1]; k++)
+    {
+        auto it = view.find(keys[k]);
+        present[k] = it != view.end();
+        if (present[k])
+        {
+            value[k] = it->second;
+        }
+    }
+#else
+    tman->simulate_txn((*readSet)[txn], (*writeSet)[txn]);
+#endif
+}
+
+/*
+   Simulate txns[0..n), whose client requests are msg->cqrySet[0..n), into
+   readSet[0..n) and writeSet[0..n).
+*/
+void ParallelSimulator::run(ClientQueryBatch *msg, vector<TxnManager *> &txns, vector<RWSet> &readSet, vector<RWSet> &writeSet)
+{
+    uint64_t txn_cnt = txns.size();
+    this->txns = &txns;
+    this->readSet = &readSet;
+    this->writeSet = &writeSet;
+    graph.reset(txn_cnt);
+
+#if PRE_EX
+    views.resize(get_worker_cnt());
+    keys.clear();
+    key_begin.assign(1, 0);
+    slot_txn.clear();
+    last_writer.clear();
+    for (uint32_t i = 0; i < txn_cnt; i++)
+    {
+        bool writer = request_footprint(msg->cqrySet[i], keys, true);
+        key_begin.push_back(keys.size());
+        slot_txn.resize(keys.size(), i);
+        source.resize(keys.size());
+
+        // Bind each key to the slot of its last earlier writer.
+        for (uint32_t k = key_begin[i]; k < key_begin[i + 1]; k++)
+        {
+            auto it = last_writer.find(keys[k]);
+            source[k] = it == last_writer.end() ? -1 : it->second;
+            if (source[k] >= 0)
+            {
+                graph.add_edge(slot_txn[source[k]], i);
+            }
+        }
+        if (writer)
+        {
+            for (uint32_t k = key_begin[i]; k < key_begin[i + 1]; k++)
+            {
+                last_writer[keys[k]] = k;
+            }
+        }
+    }
+    value.resize(keys.size());
+    present.assign(keys.size(), 0);
+#endif
+
+    schedule(graph);
+}
+#endif
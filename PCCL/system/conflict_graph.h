@@ -0,0 +1,150 @@
+#ifndef _CONFLICT_GRAPH_H_
+#define _CONFLICT_GRAPH_H_
+
+#include "global.h"
+#include <condition_variable>
+
+class TxnManager;
+class ClientQueryBatch;
+class BatchRequests;
+
+/*
+   Dependency graph of the transactions of a batch, built from the read and
+   write sets computed by the primary. Txn j depends on an earlier txn i if
+   i writes a key that j reads or writes, or if i reads a key that j writes.
+   Executing every txn after all its predecessors therefore gives the same
+   result as executing the batch serially.
+*/
+class ConflictGraph
+{
+public:
+    void build(vector<RWSet> &readSet, vector<RWSet> &writeSet, uint64_t txn_cnt);
+    /*
+       Same, adding to the sets of each txn the footprint of its request, so
+       that keys a primary left out of the sets still order the txns.
+    */
+    void build(BatchRequests *breq, uint64_t txn_cnt);
+    // Start an empty graph, edges are then added by the caller.
+    void reset(uint64_t txn_cnt);
+    void add_edge(uint32_t from, uint32_t to);
+
+    uint64_t size() { return txn_cnt; }
+    vector<uint32_t> &successors(uint64_t txn) { return succ[txn]; }
+    uint32_t indegree(uint64_t txn) { return indeg[txn]; }
+
+private:
+
+    struct KeyState
+    {
+        int64_t last_writer;
+        vector<uint32_t> readers; // readers since last_writer
+    };
+
+    void add_read(uint64_t key, uint32_t txn);
+    void add_write(uint64_t key, uint32_t txn);
+
+    uint64_t txn_cnt = 0;
+    vector<vector<uint32_t>> succ;
+    vector<uint32_t> indeg;
+    unordered_map<uint64_t, KeyState> keys;
+    vector<uint64_t> footprint;
+};
+
+/*
+   Runs process() for every transaction of a ConflictGraph on a pool of
+   threads, each transaction after all its predecessors. The calling thread
+   takes part in the work. Workers are numbered 0..worker_cnt-1, the calling
+   thread is worker_cnt. Deleting the scheduler stops and joins the workers.
+*/
+class GraphScheduler
+{
+public:
+    virtual ~GraphScheduler();
+    void init(uint64_t worker_cnt);
+    uint64_t get_worker_cnt() { return workers.size() + 1; }
+
+protected:
+    virtual void process(uint32_t txn, uint64_t worker) = 0;
+    void schedule(ConflictGraph &graph);
+
+private:
+    struct WorkerArg
+    {
+        GraphScheduler *sched;
+        uint64_t worker;
+    };
+    static void *worker_main(void *arg);
+    bool work(bool wait, uint64_t worker);
+
+    vector<pthread_t> workers;
+
+    // State of the graph being scheduled, protected by mtx.
+    ConflictGraph *cur_graph;
+    vector<uint32_t> pending; // unfinished predecessors of each txn
+    vector<uint32_t> ready;
+    uint64_t remaining = 0;
+    bool stop = false;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+/*
+   Validates and commits the transactions of a batch on a pool of threads.
+   Transactions are scheduled along a ConflictGraph, so independent ones run
+   in parallel while the outcome stays identical to the serial batch order.
+   The calling (execute) thread takes part in the work.
+*/
+class ParallelValidator : public GraphScheduler
+{
+public:
+    void run(vector<TxnManager *> &txns, BatchRequests *breq, vector<uint8_t> &valid);
+
+private:
+    void process(uint32_t txn, uint64_t worker);
+
+    ConflictGraph graph;
+    vector<TxnManager *> *txns;
+    vector<RWSet> *readSet;
+    vector<RWSet> *writeSet;
+    vector<uint8_t> *valid;
+};
+
+/*
+   Simulates the transactions of a batch on a pool of threads (primary side).
+   With PRE_EX, a txn must see the speculative writes of the earlier txns of
+   the batch. The keys of each request are known before simulation, so every
+   key a txn touches is bound to the last earlier txn writing it, and the txn
+   only runs once those writers are done. Each txn leaves the values of its
+   keys in its own slots, a versioned overlay where txn i reads the version
+   of its writer, so later writers never disturb earlier readers. The result
+   is the one of the serial speculative order. Per-worker views and slots are
+   reused from one batch to the next.
+*/
+class ParallelSimulator : public GraphScheduler
+{
+public:
+    void run(ClientQueryBatch *msg, vector<TxnManager *> &txns, vector<RWSet> &readSet, vector<RWSet> &writeSet);
+
+private:
+    void process(uint32_t txn, uint64_t worker);
+
+    ConflictGraph graph;
+    vector<TxnManager *> *txns;
+    vector<RWSet> *readSet;
+    vector<RWSet> *writeSet;
+
+#if PRE_EX
+    // The keys of txn i are keys[key_begin[i] .. key_begin[i + 1]).
+    vector<uint64_t> keys;
+    vector<uint32_t> key_begin;
+    vector<uint32_t> slot_txn; // txn owning a slot
+    vector<int64_t> source;   // slot holding the value a key is read from, -1 for the database
+    vector<OverlayEntry> value; // value and version of a key after the txn
+    vector<uint8_t> present;  // the txn had the key in its overlay
+    unordered_map<uint64_t, int64_t> last_writer; // slot of the last writer of a key
+    vector<Overlay> views; // per worker speculateSet
+#endif
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "contention.h"
+#include "batch_order.h"
+#include "message.h"
+
+#if DEFER_CONFLICTS
+#if !ISEOV || !CHECK_CONFILICT
+#error "DEFER_CONFLICTS needs ISEOV and CHECK_CONFILICT: the keys a batch writes come from its simulation"
+#endif
+#if RING_BFT || SHARPER || VIEW_CHANGES
+#error "DEFER_CONFLICTS is only supported by PBFT without view changes"
+#endif
+#if STRONG_SERIAL || PRE_ORDER
+#error "DEFER_CONFLICTS cannot be used with STRONG_SERIAL or PRE_ORDER, client batches are not proposed as they arrive"
+#endif
+#if BATCH_REORDER
+#error "DEFER_CONFLICTS cannot be used with BATCH_REORDER, the last request of a batch has to stay last"
+#endif
+#if DEFER_MAX_BATCHES < 1
+#error "DEFER_MAX_BATCHES must be at least 1"
+#endif
+
+void InflightWrites::add(uint64_t end_txn, BatchRequests *breq, const vector<uint32_t> &deferred)
+{
+    Batch batch;
+    for (const RWSet &writes : breq->writeSet)
+    {
+        for (const RWEntry &item : writes)
+        {
+            batch.keys.push_back(item.first);
+        }
+    }
+    batch.deferred = deferred;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (uint64_t key : batch.keys)
+    {
+        writers[key]++;
+    }
+    batches[end_txn] = std::move(batch);
+}
+
+bool InflightWrites::retire(uint64_t end_txn, vector<uint32_t> &deferred)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = batches.find(end_txn);
+    if (it == batches.end())
+    {
+        return false;
+    }
+    for (uint64_t key : it->second.keys)
+    {
+        auto w = writers.find(key);
+        if (--w->second == 0)
+        {
+            writers.erase(w);
+        }
+    }
+    deferred.swap(it->second.deferred);
+    batches.erase(it);
+    return true;
+}
+
+void InflightWrites::find_conflicts(const vector<uint64_t> &keys, const vector<uint32_t> &key_begin, vector<uint8_t> &conflict)
+{
+    conflict.assign(key_begin.size() - 1, 0);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (writers.empty())
+    {
+        return;
+    }
+    for (uint64_t i = 0; i + 1 < key_begin.size(); i++)
+    {
+        for (uint32_t k = key_begin[i]; k < key_begin[i + 1]; k++)
+        {
+            if (writers.count(keys[k]))
+            {
+                conflict[i] = 1;
+                break;
+            }
+        }
+    }
+}
+
+bool ConflictDeferrer::arrive(ClientQueryBatch *msg, uint64_t thd_id, ClientQueryBatch *&ready)
+{
+    ready = held;
+    held = NULL;
+    ready_age.swap(age);
+    age.assign(msg->cqrySet.size(), 0);
+    find_conflicts(ready, msg);
+
+    uint64_t txn_cnt = msg->cqrySet.size();
+    uint64_t next_at = ready == NULL ? 0 : ready->cqrySet.size();
+    bool conflicting = false;
+    for (uint64_t j = 0; j + 1 < txn_cnt && !conflicting; j++)
+    {
+        conflicting = conflict[next_at + j];
+    }
+    if (ready == NULL && !conflicting)
+    {
+        return false;
+    }
+
+    // The message is released once processed.
+    char *buf = create_msg_buffer(msg);
+    ClientQueryBatch *copy = (ClientQueryBatch *)deep_copy_msg(buf, msg);
+    delete_msg_buffer(buf);
+    copy->return_node_id = msg->return_node_id;
+
+    uint64_t traded = 0;
+    if (ready != NULL)
+    {
+        traded = trade(ready, copy);
+        INC_STATS(thd_id, defer_txn_cnt, traded);
+        set_deferred(ready);
+    }
+    if (traded == 0 && !conflicting)
+    {
+        // Nothing moved, msg is proposed as it came.
+        Message::release_message(copy);
+        return false;
+    }
+    held = copy;
+    return true;
+}
+
+ClientQueryBatch *ConflictDeferrer::flush()
+{
+    ClientQueryBatch *ready = held;
+    held = NULL;
+    ready_age.swap(age);
+    if (ready != NULL)
+    {
+        set_deferred(ready);
+    }
+    return ready;
+}
+
+// Footprints of ready, if any, then of next. YCSB validation reads every
+// column of a record.
+void ConflictDeferrer::find_conflicts(ClientQueryBatch *ready, ClientQueryBatch *next)
+{
+    keys.clear();
+    key_begin.assign(1, 0);
+    for (uint64_t i = 0; ready != NULL && i < ready->cqrySet.size(); i++)
+    {
+        request_footprint(ready->cqrySet[i], keys, true, true);
+        key_begin.push_back(keys.size());
+    }
+    for (uint64_t i = 0; i < next->cqrySet.size(); i++)
+    {
+        request_footprint(next->cqrySet[i], keys, true, true);
+        key_begin.push_back(keys.size());
+    }
+    inflight_writes.find_conflicts(keys, key_begin, conflict);
+}
+
+// Called after find_conflicts(ready, next).
+uint64_t ConflictDeferrer::trade(ClientQueryBatch *ready, ClientQueryBatch *next)
+{
+    uint64_t txn_cnt = ready->cqrySet.size();
+    uint64_t traded = 0;
+    uint64_t j = 0;
+    for (uint64_t i = 0; i + 1 < txn_cnt; i++)
+    {
+        if (!conflict[i] || ready_age[i] >= DEFER_MAX_BATCHES)
+        {
+            continue;
+        }
+        while (j + 1 < txn_cnt && conflict[txn_cnt + j])
+        {
+            j++;
+        }
+        if (j + 1 >= txn_cnt)
+        {
+            break;
+        }
+
+        auto req = ready->cqrySet[i];
+        ready->cqrySet.set(i, next->cqrySet[j]);
+        next->cqrySet.set(j, req);
+        age[j] = ready_age[i] + 1;
+        ready_age[i] = 0;
+        j++;
+        traded++;
+    }
+    return traded;
+}
+
+void ConflictDeferrer::set_deferred(ClientQueryBatch *ready)
+{
+    deferred.clear();
+    for (uint32_t i = 0; i < ready->cqrySet.size(); i++)
+    {
+        if (ready_age[i] > 0)
+        {
+            deferred.push_back(i);
+        }
+    }
+}
+#endif
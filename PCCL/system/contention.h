@@ -0,0 +1,96 @@
+#ifndef _CONTENTION_H_
+#define _CONTENTION_H_
+
+#include "global.h"
+#include <mutex>
+
+class BatchRequests;
+class ClientQueryBatch;
+
+/*
+   Keys written by the batches the primary proposed and did not execute yet,
+   for DEFER_CONFLICTS. A request reading one of them was simulated against
+   a value that is about to change, and is almost certain to fail validation.
+   Each key counts the writes of the batches in flight, taken from their
+   simulated write sets when they are proposed and dropped once the execute
+   thread committed them.
+*/
+class InflightWrites
+{
+public:
+    /*
+       Record the writes of the batch ending with txn end_txn. deferred are
+       the positions in the batch of the requests held back before.
+    */
+    void add(uint64_t end_txn, BatchRequests *breq, const vector<uint32_t> &deferred);
+
+    /*
+       Drop the writes of the batch ending with txn end_txn, once its writes
+       are committed. Returns false if the batch is not in flight, else
+       deferred gets the positions given to add.
+    */
+    bool retire(uint64_t end_txn, vector<uint32_t> &deferred);
+
+    /*
+       For the footprints keys[key_begin[i] .. key_begin[i + 1]), tells in
+       conflict[i] if one of their keys is written by a batch in flight.
+    */
+    void find_conflicts(const vector<uint64_t> &keys, const vector<uint32_t> &key_begin, vector<uint8_t> &conflict);
+
+private:
+    struct Batch
+    {
+        vector<uint64_t> keys; // once per write
+        vector<uint32_t> deferred;
+    };
+    std::mutex mtx;
+    unordered_map<uint64_t, uint32_t> writers; // writes in flight to each key
+    unordered_map<uint64_t, Batch> batches;    // by last txn
+};
+
+/*
+   Holds the requests of a batching thread that would fail validation back
+   to a later batch, for DEFER_CONFLICTS. A client batch with a request
+   reading a key written in flight is held until the next arrival, other
+   batches are proposed at once. When a batch comes, the one held before is
+   proposed first, after trading each of its requests reading a key written
+   in flight for a request of the new batch that does not. The traded
+   requests are thus simulated one batch later, once more of the batches
+   they conflicted with have committed, and the new batch is held in turn.
+   A request is held back DEFER_MAX_BATCHES times at most. The last request
+   of a batch names the client the response goes to, it is never traded.
+
+   The txn ids of a batch are given on arrival, only requests move between
+   batches. The client of a batch only counts the responses to it.
+*/
+class ConflictDeferrer
+{
+public:
+    /*
+       Take a new client batch. ready gets the batch held before, to propose
+       first, owned by the caller, or NULL. Returns true if msg is held, as a
+       copy, else msg is to be proposed now, after ready.
+    */
+    bool arrive(ClientQueryBatch *msg, uint64_t thd_id, ClientQueryBatch *&ready);
+
+    // The held batch, when no other batch comes to trade with, or NULL.
+    ClientQueryBatch *flush();
+
+    // Positions in the batch last returned of requests held back before.
+    vector<uint32_t> deferred;
+
+private:
+    void find_conflicts(ClientQueryBatch *ready, ClientQueryBatch *next);
+    uint64_t trade(ClientQueryBatch *ready, ClientQueryBatch *next);
+    void set_deferred(ClientQueryBatch *ready);
+
+    ClientQueryBatch *held = NULL;
+    vector<uint32_t> age;       // times each request of held was held back
+    vector<uint32_t> ready_age; // same for the batch being proposed
+
+    vector<uint64_t> keys;
+    vector<uint32_t> key_begin;
+    vector<uint8_t> conflict; // of ready, if any, then of next
+};
+
+#endif
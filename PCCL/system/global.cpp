@@ -12,6 +12,8 @@
 #include "txn_table.h"
 #include "client_txn.h"
 #include "txn.h"
+#include "hot_keys.h"
+#include "contention.h"
 #include "../config.h"
 #include <array>
 
@@ -34,6 +36,12 @@ QWorkQueue work_queue;
 
 MessageQueue msg_queue;
 Client_txn client_man;
+#if HOT_ESCROW
+HotKeyManager hot_keys;
+#endif
+#if DEFER_CONFLICTS
+InflightWrites inflight_writes;
+#endif
 //map<uint64_t, bool> priconsensus;
 #if NET_BROADCAST
 std::array<bool,PRICONSENSUS_SIZE> priconsensus;
@@ -107,6 +115,9 @@ UInt64 g_synth_table_size = SYNTH_TABLE_SIZE;
 UInt32 g_req_per_query = REQ_PER_QUERY;
 UInt32 g_ycsb_column = YCSB_COLUMN;
 UInt32 g_ycsb_write_ratio = YCSB_WRITE_RATIO;
+UInt32 g_ycsb_scan_ratio = YCSB_SCAN_RATIO;
+UInt32 g_ycsb_increment_ratio = YCSB_INCREMENT_RATIO;
+UInt32 g_ycsb_max_scan_len = YCSB_MAX_SCAN_LEN;
 bool g_strict_ppt = STRICT_PPT == 1;
 UInt32 g_field_per_tuple = FIELD_PER_TUPLE;
 UInt32 g_init_parallelism = INIT_PARALLELISM;
@@ -752,6 +763,57 @@ uint64_t payload_size = 51200;
 DataBase *db = new SQLite();
 #elif EXT_DB == MEMORY
 DataBase *db = new InMemoryDB();
+#elif EXT_DB == MEMORY_DENSE
+DataBase *db = new DenseDB();
+#elif EXT_DB == MEMORY_ROW
+DataBase *db = new RowDB();
+#elif EXT_DB == MEMORY_LOG
+DataBase *db = new LogDB();
+#elif EXT_DB == MEMORY_CONCURRENT
+DataBase *db = new ConcurrentDB();
+#elif EXT_DB == MEMORY_INDEX
+DataBase *db = new IndexDB();
+#endif
+
+// File holding the state snapshot of this replica.
+std::string state_snapshot_path()
+{
+    return "db-" + std::to_string(g_node_id) + ".state";
+}
+
+#if STATE_SNAPSHOT && !ISEOV
+#error "STATE_SNAPSHOT needs ISEOV"
+#endif
+
+#if STATE_DIGEST && EXT_DB != MEMORY_DENSE && EXT_DB != MEMORY_LOG && EXT_DB != MEMORY_CONCURRENT
+#error "STATE_DIGEST needs a state store that keeps a digest (EXT_DB == MEMORY_DENSE, MEMORY_LOG or MEMORY_CONCURRENT)"
+#endif
+
+#if MERKLE_STATE && EXT_DB != MEMORY_DENSE && EXT_DB != MEMORY_LOG && EXT_DB != MEMORY_CONCURRENT
+#error "MERKLE_STATE needs a state store that keeps a Merkle tree (EXT_DB == MEMORY_DENSE, MEMORY_LOG or MEMORY_CONCURRENT)"
+#endif
+
+#if COW_SNAPSHOT && EXT_DB != MEMORY_CONCURRENT
+#error "COW_SNAPSHOT needs a state store with snapshots (EXT_DB == MEMORY_CONCURRENT)"
+#endif
+
+#if (PARALLEL_VALIDATE || PARALLEL_SIMULATE || PARTITIONED_EXECUTE || BLOCK_STM) && !CONCURRENT_SAFE_STORE
+#error "PARALLEL_VALIDATE, PARALLEL_SIMULATE, PARTITIONED_EXECUTE and BLOCK_STM need a state store that supports concurrent access to distinct keys (EXT_DB == MEMORY_DENSE, MEMORY_CONCURRENT, MEMORY_INDEX, or MEMORY with IS_TABLE_DEVIDE)"
+#endif
+
+#if VERSION_VALIDATE && (!ISEOV || (EXT_DB != MEMORY_DENSE && EXT_DB != MEMORY_LOG && EXT_DB != MEMORY_CONCURRENT && EXT_DB != MEMORY_INDEX && EXT_DB != MEMORY_ROW))
+#error "VERSION_VALIDATE needs ISEOV and a state store that keeps versions (EXT_DB == MEMORY_DENSE, MEMORY_LOG, MEMORY_CONCURRENT, MEMORY_INDEX or MEMORY_ROW)"
+#endif
+
+// The bytes of the values are kept in memory only, beside their digests.
+#if LARGER_TXN && (STATE_SNAPSHOT || EXT_DB == SQL_PERSISTENT || EXT_DB == MEMORY_LOG)
+#error "LARGER_TXN writes byte values, which are not persisted: it needs a state store in memory without STATE_SNAPSHOT"
+#endif
+
+// An increment adds to the integer value of a column, which for a column
+// holding bytes is their digest.
+#if LARGER_TXN && YCSB_INCREMENT_RATIO > 0
+#error "YCSB increments cannot be used with LARGER_TXN, whose updates write byte values"
 #endif
 
 #if STRONG_SERIAL
@@ -39,11 +39,95 @@
 #include "database.h"
 #include "hash_map.h"
 #include "hash_set.h"
+#include "rw_set.h"
 
 #include "semaphore.h"
 
 using namespace std;
 
+/******************************************/
+// Defaults for optional execution features
+// that are not set in config.h.
+/******************************************/
+#ifndef PARALLEL_VALIDATE_THD_CNT
+#define PARALLEL_VALIDATE_THD_CNT 4 // helper threads of the execute thread
+#endif
+#ifndef PARALLEL_SIMULATE_THD_CNT
+#define PARALLEL_SIMULATE_THD_CNT 4 // helper threads simulating a batch on the primary
+#endif
+#ifndef PARTITIONED_EXECUTE
+#define PARTITIONED_EXECUTE false // ISEOV: validate a batch with one thread per range of keys
+#endif
+#ifndef PARTITION_CNT
+#define PARTITION_CNT 4 // PARTITIONED_EXECUTE: ranges of keys, the execute thread owns one
+#endif
+#ifndef BLOCK_STM
+#define BLOCK_STM false // !ISEOV: execute the txns of a batch in parallel on a multi-version memory
+#endif
+#ifndef BLOCK_STM_THD_CNT
+#define BLOCK_STM_THD_CNT 4 // helper threads of the execute thread with BLOCK_STM
+#endif
+#ifndef HOT_ESCROW
+#define HOT_ESCROW false // banking ISEOV: split the accounts txns abort on into escrow shards
+#endif
+#ifndef HOT_ESCROW_SHARDS
+#define HOT_ESCROW_SHARDS 8 // HOT_ESCROW: shards of a split account
+#endif
+#ifndef HOT_ESCROW_ABORTS
+#define HOT_ESCROW_ABORTS 16 // HOT_ESCROW: aborts on an account between two batches of the primary to split it
+#endif
+#ifndef HOT_ESCROW_MAX
+#define HOT_ESCROW_MAX 64 // HOT_ESCROW: accounts split at most
+#endif
+#ifndef PARTIAL_RE_EXECUTE
+#define PARTIAL_RE_EXECUTE false // RE_EXECUTE: redo only invalid txns and their dependents
+#endif
+// Reordering of client batches on the primary (BatchReorderer).
+#define READERS_FIRST 1
+#define DISJOINT_FIRST 2
+#ifndef BATCH_REORDER
+#define BATCH_REORDER false // false, READERS_FIRST or DISJOINT_FIRST
+#endif
+#ifndef DEFER_CONFLICTS
+#define DEFER_CONFLICTS false // ISEOV primary: hold back requests reading keys written by batches in flight
+#endif
+#ifndef DEFER_MAX_BATCHES
+#define DEFER_MAX_BATCHES 4 // DEFER_CONFLICTS: batches a request is held back at most
+#endif
+#ifndef LOG_SNAPSHOT_PERIOD
+#define LOG_SNAPSHOT_PERIOD 10000 // EXT_DB == MEMORY_LOG: batches between two snapshots
+#endif
+#ifndef VERSION_VALIDATE
+#define VERSION_VALIDATE false // ISEOV: read sets carry key versions instead of values
+#endif
+#ifndef STATE_SNAPSHOT
+#define STATE_SNAPSHOT false // ISEOV: snapshot the state at checkpoints and load it at startup
+#endif
+#ifndef STATE_DIGEST
+#define STATE_DIGEST false // keep a digest of the state and send checkpoints carrying it
+#endif
+#ifndef COW_SNAPSHOT
+#define COW_SNAPSHOT false // publish a copy-on-write snapshot of the state after every batch
+#endif
+#ifndef MERKLE_STATE
+#define MERKLE_STATE false // keep a Merkle tree of the state, its root recorded in every block
+#endif
+#ifndef YCSB_SCAN_RATIO
+#define YCSB_SCAN_RATIO 0 // percentage of YCSB requests that scan a range of records
+#endif
+#ifndef YCSB_INCREMENT_RATIO
+#define YCSB_INCREMENT_RATIO 0 // percentage of YCSB writes that add to a column instead of setting it, not with LARGER_TXN
+#endif
+#ifndef YCSB_MAX_SCAN_LEN
+#define YCSB_MAX_SCAN_LEN 100 // records read by a YCSB scan, drawn uniformly from 1 up to this
+#endif
+#ifndef YCSB_PAYLOAD_SIZE
+#define YCSB_PAYLOAD_SIZE 1556 // with LARGER_TXN, bytes of a YCSB request, the value its update writes
+#endif
+// State stores several threads can use at once on distinct keys, as the
+// parallel execution features need. EXT_DB values are set in database.h.
+#define CONCURRENT_SAFE_STORE (EXT_DB == MEMORY_DENSE || EXT_DB == MEMORY_CONCURRENT || EXT_DB == MEMORY_INDEX || (EXT_DB == MEMORY && IS_TABLE_DEVIDE))
+
 class mem_alloc;
 class Stats;
 class SimManager;
@@ -62,6 +146,8 @@ class Client_txn;
 class CommitCertificateMessage;
 class ClientResponseMessage;
 class RingBFTCommit;
+class HotKeyManager;
+class InflightWrites;
 
 typedef uint32_t UInt32;
 typedef int32_t SInt32;
@@ -91,6 +177,12 @@ extern TxnTable txn_tables;
 extern QWorkQueue work_queue;
 extern MessageQueue msg_queue;
 extern Client_txn client_man;
+#if HOT_ESCROW
+extern HotKeyManager hot_keys;
+#endif
+#if DEFER_CONFLICTS
+extern InflightWrites inflight_writes;
+#endif
 #if NET_BROADCAST
 extern std::array<bool,PRICONSENSUS_SIZE> priconsensus;
 #endif
@@ -183,6 +275,9 @@ extern UInt64 g_synth_table_size;
 extern UInt32 g_req_per_query;
 extern UInt32 g_ycsb_column;
 extern UInt32 g_ycsb_write_ratio;
+extern UInt32 g_ycsb_scan_ratio;
+extern UInt32 g_ycsb_increment_ratio;
+extern UInt32 g_ycsb_max_scan_len;
 extern bool g_strict_ppt;
 extern UInt32 g_field_per_tuple;
 extern UInt32 g_init_parallelism;
@@ -191,6 +286,7 @@ extern double g_mpr;
 extern double g_mpitem;
 
 extern DataBase *db;
+std::string state_snapshot_path();
 
 // Replication
 extern UInt32 g_repl_type;
@@ -294,14 +390,6 @@ enum access_t
         printf("[%s : %d] " str, __FILE__, __LINE__, args); \
     }
 
-// principal index structure. The workload may decide to use a different
-// index structure for specific purposes. (e.g. non-primary key access should use hash)
-#if (INDEX_STRUCT == IDX_BTREE)
-#define INDEX index_btree
-#else // IDX_HASH
-#define INDEX IndexHash
-#endif
-
 /************************************************/
 // constants
 /************************************************/
@@ -560,6 +648,8 @@ enum YCSBType
 {
     YCSB_READ = 0,
     YCSB_UPDATE = 1,
+    YCSB_SCAN = 2, // reads scan_len records from key
+    YCSB_INCREMENT = 3, // adds value to a column, without reading the record
 };
 
 
@@ -0,0 +1,59 @@
+#include "hot_keys.h"
+#include "database.h"
+#include <algorithm>
+
+#if HOT_ESCROW
+#if !BANKING_SMART_CONTRACT || !ISEOV || !CHECK_CONFILICT || RE_EXECUTE
+#error "HOT_ESCROW needs BANKING_SMART_CONTRACT and ISEOV with CHECK_CONFILICT, without RE_EXECUTE"
+#endif
+#if PARALLEL_VALIDATE || PARTITIONED_EXECUTE || PARALLEL_SIMULATE
+#error "HOT_ESCROW runs the txns of a batch one at a time: escrow shards are past the key space the state stores share between threads"
+#endif
+#if SB_READ_TX
+#error "HOT_ESCROW does not support SB_READ_TX"
+#endif
+#if !CONCURRENT_SAFE_STORE && EXT_DB != MEMORY_LOG
+#error "HOT_ESCROW needs a state store whose keys past the accounts can be inserted while the primary simulates (EXT_DB == MEMORY_DENSE, MEMORY_LOG, MEMORY_CONCURRENT, MEMORY_INDEX, or MEMORY with IS_TABLE_DEVIDE)"
+#endif
+#if MERKLE_STATE
+#error "HOT_ESCROW cannot be used with MERKLE_STATE: escrow shards are past the keys the Merkle tree covers"
+#endif
+#if HOT_ESCROW_SHARDS < 2
+#error "HOT_ESCROW_SHARDS must be at least 2"
+#endif
+
+void HotKeyManager::record_abort(uint64_t thd_id, const RWSet &readSet)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    // Only the primary takes the counts. A replica that stopped being the
+    // primary drops the ones it kept.
+    if (g_node_id != get_current_view(thd_id))
+    {
+        aborts.clear();
+        return;
+    }
+    for (const RWEntry &item : readSet)
+    {
+        // Shards of split accounts are not counted.
+        if (item.first < g_account_num)
+        {
+            aborts[item.first]++;
+        }
+    }
+}
+
+void HotKeyManager::take_splits(vector<uint64_t> &accounts)
+{
+    accounts.clear();
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto &item : aborts)
+    {
+        if (item.second >= HOT_ESCROW_ABORTS && split.size() < HOT_ESCROW_MAX && split.insert(item.first).second)
+        {
+            accounts.push_back(item.first);
+        }
+    }
+    aborts.clear();
+    sort(accounts.begin(), accounts.end());
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef _HOT_KEYS_H_
+#define _HOT_KEYS_H_
+
+#include "global.h"
+#include <mutex>
+#include <unordered_set>
+
+/*
+   Finds the banking accounts that make txns fail validation, for
+   HOT_ESCROW. On the primary, the execute thread counts every failed txn
+   against the accounts it read. The primary, when it builds a batch, takes
+   the accounts counted at least HOT_ESCROW_ABORTS times since it last
+   looked and sends them with the batch, whose replicas split them into
+   escrow shards before running its txns. An account is split once, and at most HOT_ESCROW_MAX
+   are.
+*/
+class HotKeyManager
+{
+public:
+    // Count an abort against the accounts of readSet, on the primary only.
+    void record_abort(uint64_t thd_id, const RWSet &readSet);
+
+    // Accounts to split with the next batch, in key order.
+    void take_splits(vector<uint64_t> &accounts);
+
+private:
+    std::mutex mtx;
+    unordered_map<uint64_t, uint32_t> aborts; // since the last take_splits
+    std::unordered_set<uint64_t> split;
+};
+
+#endif
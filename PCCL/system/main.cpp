@@ -56,7 +56,14 @@ int main(int argc, char *argv[])
     fflush(stdout);
     db->Open(string("db-") + to_string(g_node_id));
 #if ISEOV
-    db->Init(std::to_string(10000));
+    // A snapshot left by an earlier run replaces the initial state.
+    if (!(STATE_SNAPSHOT && db->LoadSnapshot(state_snapshot_path())))
+    {
+        db->Init(std::to_string(10000));
+#if STATE_SNAPSHOT
+        db->SaveSnapshot(state_snapshot_path());
+#endif
+    }
     sleep(2);
 #endif
     
@@ -154,6 +161,12 @@ int main(int argc, char *argv[])
     printf("Initializing Chain... ");
     fflush(stdout);
     BlockChain = new BChain();
+#if MERKLE_STATE && ENABLE_CHAIN
+    // Blocks record the root of the state after their batch.
+    db->SetStateRootListener([](uint64_t txn_id, const std::string &root) {
+        BlockChain->set_state_root(txn_id, root);
+    });
+#endif
     printf("Done\n");
 
     //test_v3:add Array
@@ -369,6 +382,8 @@ int main(int argc, char *argv[])
 
     for (uint64_t i = 0; i < all_thd_cnt; i++)
         pthread_join(p_thds[i], NULL);
+    for (uint64_t i = 0; i < wthd_cnt; i++)
+        worker_thds[i].release_helpers();
 
     endtime = get_server_clock();
 
@@ -426,13 +441,14 @@ void clean(){
      delete input_thds;
      delete output_thds;
      delete simulation;
-     delete BlockChain;
  #if TIMER_ON
      delete server_timer;
  #endif
  #if EXT_DB == SQL || EXT_DB == SQL_PERSISTENT
      db->Close("");
- #elif EXT_DB == MEMORY
+ #elif EXT_DB == MEMORY || EXT_DB == MEMORY_DENSE || EXT_DB == MEMORY_ROW || EXT_DB == MEMORY_LOG || EXT_DB == MEMORY_CONCURRENT || EXT_DB == MEMORY_INDEX
      db->Close("");
  #endif
+     // After the store, whose Merkle tree may still record a root.
+     delete BlockChain;
  }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef _OVERLAY_H_
+#define _OVERLAY_H_
+
+#include "global.h"
+
+/*
+   Access to the state store through an Overlay of not yet committed writes.
+
+   Every integer key has a version in the store, 0 if it was never written,
+   and a write made on top of version v gives version v + 1. Overlay entries
+   follow the same rule, so the versions the primary predicts through its
+   speculateSet are the ones the replicas find at validation time.
+
+   With VERSION_VALIDATE a read set records the version of each key it
+   reads instead of its value, and validation compares versions. A key that
+   was written since it was read always fails, even if it was set back to
+   the value that was read.
+*/
+
+// What a read set records for a read.
+static inline uint64_t read_stamp(uint64_t value, uint64_t version)
+{
+#if VERSION_VALIDATE
+    return version;
+#else
+    return value;
+#endif
+}
+
+// Value and version of key, dflt and 0 if the key was never written.
+static inline uint64_t state_get(Overlay &overlay, uint64_t key, uint64_t dflt, uint64_t &version)
+{
+    auto it = overlay.find(key);
+    if (it == overlay.end())
+    {
+        return db->Get(key, dflt, version);
+    }
+    version = it->second.version;
+    return it->second.value;
+}
+
+// Write value on top of the version that was read. A value of bytes comes
+// with buf, value being its digest.
+static inline void overlay_put(Overlay &overlay, uint64_t key, uint64_t value, uint64_t version, ValueBuf *buf = NULL)
+{
+    overlay[key] = OverlayEntry{value, version + 1, ValueRef(buf)};
+}
+
+#endif
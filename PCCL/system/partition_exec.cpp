@@ -0,0 +1,176 @@
+#include "partition_exec.h"
+#include "txn.h"
+#include "message.h"
+#include "batch_order.h"
+#include <thread>
+
+#if PARTITIONED_EXECUTE
+#if !ISEOV || RE_EXECUTE || !CHECK_CONFILICT
+#error "PARTITIONED_EXECUTE needs ISEOV and CHECK_CONFILICT without RE_EXECUTE"
+#endif
+#if PARALLEL_VALIDATE
+#error "PARTITIONED_EXECUTE and PARALLEL_VALIDATE are two ways to run a batch in parallel, choose one"
+#endif
+#if PARTITION_CNT < 1 || PARTITION_CNT > 64
+#error "PARTITION_CNT must be between 1 and 64"
+#endif
+
+void PartitionedExecutor::init(uint64_t part_cnt)
+{
+    // Partitions are ranges of rows, so that the columns of a YCSB row
+    // stay together. A banking account is a row of one column.
+#if BANKING_SMART_CONTRACT
+    uint64_t rows = g_account_num;
+#else
+    uint64_t rows = g_synth_table_size;
+#endif
+    rows_per_part = max((rows + part_cnt - 1) / part_cnt, (uint64_t)1);
+
+    queues.resize(part_cnt);
+    workers.resize(part_cnt - 1);
+    for (uint64_t i = 0; i + 1 < part_cnt; i++)
+    {
+        WorkerArg *arg = new WorkerArg{this, i};
+        pthread_create(&workers[i], NULL, worker_main, (void *)arg);
+    }
+}
+
+uint64_t PartitionedExecutor::partition_of(uint64_t key)
+{
+#if BANKING_SMART_CONTRACT
+    uint64_t row = key;
+#else
+    uint64_t row = key / g_ycsb_column;
+#endif
+    return min(row / rows_per_part, (uint64_t)queues.size() - 1);
+}
+
+void *PartitionedExecutor::worker_main(void *arg)
+{
+    PartitionedExecutor *exec = ((WorkerArg *)arg)->exec;
+    uint64_t part = ((WorkerArg *)arg)->part;
+    delete (WorkerArg *)arg;
+    uint64_t gen = 0;
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(exec->mtx);
+        exec->cv.wait(lock, [exec, gen] { return exec->batch_gen != gen; });
+        gen = exec->batch_gen;
+        lock.unlock();
+
+        exec->work(part);
+
+        lock.lock();
+        bool last = --exec->remaining == 0;
+        lock.unlock();
+        if (last)
+        {
+            exec->cv.notify_all();
+        }
+    }
+    return NULL;
+}
+
+uint64_t PartitionedExecutor::run(vector<TxnManager *> &txns, BatchRequests *breq, vector<uint8_t> &valid)
+{
+    uint64_t txn_cnt = txns.size();
+    vector<RWSet> &readSet = breq->readSet;
+    vector<RWSet> &writeSet = breq->writeSet;
+    this->txns = &txns;
+    this->readSet = &readSet;
+    this->writeSet = &writeSet;
+    this->valid = &valid;
+    valid.assign(txn_cnt, 0);
+    if (txn_cnt > txn_cap)
+    {
+        arrived.reset(new std::atomic<uint32_t>[txn_cnt]);
+        finished.reset(new std::atomic<bool>[txn_cnt]);
+        txn_cap = txn_cnt;
+    }
+
+    for (vector<uint32_t> &queue : queues)
+    {
+        queue.clear();
+    }
+    part_cnt_of.resize(txn_cnt);
+    uint64_t multi_cnt = 0;
+    for (uint64_t i = 0; i < txn_cnt; i++)
+    {
+        uint64_t parts = 0;
+        for (const RWEntry &item : readSet[i])
+        {
+            parts |= (uint64_t)1 << partition_of(item.first);
+        }
+        for (const RWEntry &item : writeSet[i])
+        {
+            parts |= (uint64_t)1 << partition_of(item.first);
+        }
+        // The primary may have left keys of the request out of the sets.
+        footprint.clear();
+        request_footprint(breq->requestMsg[i], footprint, true);
+        for (uint64_t key : footprint)
+        {
+            parts |= (uint64_t)1 << partition_of(key);
+        }
+        if (parts == 0)
+        {
+            // A txn touching no key still has to be validated once.
+            parts = 1;
+        }
+        part_cnt_of[i] = __builtin_popcountll(parts);
+        for (uint64_t p = 0; p < queues.size(); p++)
+        {
+            if (parts & ((uint64_t)1 << p))
+            {
+                queues[p].push_back(i);
+            }
+        }
+        multi_cnt += part_cnt_of[i] > 1;
+        arrived[i] = 0;
+        finished[i] = false;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    batch_gen++;
+    remaining = queues.size();
+    lock.unlock();
+    cv.notify_all();
+
+    work(queues.size() - 1);
+
+    lock.lock();
+    remaining--;
+    cv.wait(lock, [this] { return remaining == 0; });
+    return multi_cnt;
+}
+
+void PartitionedExecutor::work(uint64_t part)
+{
+    for (uint32_t txn : queues[part])
+    {
+        if (part_cnt_of[txn] == 1)
+        {
+            process(txn);
+        }
+        else if (arrived[txn].fetch_add(1) + 1 == part_cnt_of[txn])
+        {
+            // The other partitions of the txn wait for it.
+            process(txn);
+            finished[txn].store(true, std::memory_order_release);
+        }
+        else
+        {
+            while (!finished[txn].load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+void PartitionedExecutor::process(uint32_t txn)
+{
+    TxnManager *tman = (*txns)[txn];
+    (*valid)[txn] = tman->validate_and_commit((*readSet)[txn], (*writeSet)[txn]) == RCOK;
+}
+#endif
@@ -0,0 +1,74 @@
+#ifndef _PARTITION_EXEC_H_
+#define _PARTITION_EXEC_H_
+
+#include "global.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+
+class TxnManager;
+class BatchRequests;
+
+/*
+   Validates and commits the transactions of a batch with the key space
+   split in ranges, each owned by one thread. The read and write sets
+   computed by the primary tell the partitions a txn touches, as in Calvin,
+   together with the keys of its request, which validation touches whatever
+   the primary shipped.
+   Each thread goes through the txns touching its partition in batch order:
+   a txn of one partition runs at once, a txn of several partitions runs
+   once every one of their threads has reached it, on the last thread to
+   arrive while the others wait. Two txns touching a same key are thus run
+   in batch order, and the outcome is the one of the serial batch.
+
+   The calling (execute) thread owns the last partition.
+*/
+class PartitionedExecutor
+{
+public:
+    void init(uint64_t part_cnt);
+    uint64_t get_part_cnt() { return queues.size(); }
+
+    // Partition owning key.
+    uint64_t partition_of(uint64_t key);
+
+    /*
+       Validate and commit txns[0..n) of batch breq. On return valid[i]
+       tells if txns[i] passed validation. Returns the number of txns
+       touching more than one partition.
+    */
+    uint64_t run(vector<TxnManager *> &txns, BatchRequests *breq, vector<uint8_t> &valid);
+
+private:
+    struct WorkerArg
+    {
+        PartitionedExecutor *exec;
+        uint64_t part;
+    };
+    static void *worker_main(void *arg);
+    void work(uint64_t part);
+    void process(uint32_t txn);
+
+    vector<pthread_t> workers;
+    uint64_t rows_per_part; // rows of the key space in a partition
+
+    // The batch being run.
+    vector<TxnManager *> *txns;
+    vector<RWSet> *readSet;
+    vector<RWSet> *writeSet;
+    vector<uint8_t> *valid;
+    vector<vector<uint32_t>> queues; // txns touching each partition, in batch order
+    vector<uint32_t> part_cnt_of;    // partitions touched by each txn
+    std::unique_ptr<std::atomic<uint32_t>[]> arrived; // threads that reached a txn
+    std::unique_ptr<std::atomic<bool>[]> finished;
+    uint64_t txn_cap = 0;
+    vector<uint64_t> footprint;
+
+    // Every thread takes part in every batch, protected by mtx.
+    uint64_t batch_gen = 0;
+    uint64_t remaining = 0; // partitions not done with the batch
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+#endif
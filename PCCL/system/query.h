@@ -18,14 +18,17 @@ public:
     virtual void release() = 0;
 #if ISEOV
 #if PRE_EX
-    virtual uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet) = 0;
+    virtual uint64_t simulate(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet) = 0;
 #else
-    virtual uint64_t simulate(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet) = 0;
+    virtual uint64_t simulate(RWSet &readSet, RWSet &writeSet) = 0;
 #endif
 #if RE_EXECUTE
-    virtual uint64_t v_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet) = 0;
+    virtual uint64_t v_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet) = 0;
+    #if PARTIAL_RE_EXECUTE
+    virtual uint64_t re_execute(Overlay &mergeSet) = 0;
+    #endif
 #else
-    virtual uint64_t v_and_c(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet) = 0;
+    virtual uint64_t v_and_c(RWSet &readSet, RWSet &writeSet) = 0;
 #endif
 #endif
 };
@@ -157,7 +157,15 @@ void TxnManager::init(uint64_t pool_id, Workload *h_wl)
     prep_rsp_cnt = 2 * g_min_invalid_nodes;
     commit_rsp_cnt = prep_rsp_cnt + 1;
 #endif
+#if STATE_DIGEST
+    // As many matching checkpoints as a commit, its own included.
+    chkpt_cnt = commit_rsp_cnt;
+    own_chkpt = false;
+    peer_digests.clear();
+    chkpt_senders.clear();
+#else
     chkpt_cnt = 1;
+#endif
     chkpt_flag = false;
 
 #if RING_BFT
@@ -232,7 +240,15 @@ void TxnManager::release(uint64_t pool_id)
     prep_rsp_cnt = 2 * g_min_invalid_nodes;
     commit_rsp_cnt = prep_rsp_cnt + 1;
 #endif
+#if STATE_DIGEST
+    // As many matching checkpoints as a commit, its own included.
+    chkpt_cnt = commit_rsp_cnt;
+    own_chkpt = false;
+    peer_digests.clear();
+    chkpt_senders.clear();
+#else
     chkpt_cnt = 1;
+#endif
     chkpt_flag = false;
     release_all_messages(tid);
 
@@ -434,6 +450,58 @@ uint64_t TxnManager::get_chkpt_cnt()
     return chkpt_cnt;
 }
 
+#if STATE_DIGEST
+uint64_t TxnManager::match_chkpt(CheckpointMessage *ckmsg)
+{
+    if (!chkpt_senders.insert(ckmsg->return_node).second)
+    {
+        return 0;
+    }
+
+    if (ckmsg->return_node == g_node_id)
+    {
+        own_chkpt = true;
+        chkpt_digest = ckmsg->digest;
+        uint64_t matched = 1;
+        for (const auto &peer : peer_digests)
+        {
+            if (peer.second == chkpt_digest)
+            {
+                matched++;
+            }
+            else
+            {
+                log_chkpt_mismatch(ckmsg->txn_id, peer.first, peer.second);
+            }
+        }
+        peer_digests.clear();
+        return matched;
+    }
+
+    // The others may be ahead of this replica, keep theirs until its own
+    // digest is known.
+    if (!own_chkpt)
+    {
+        peer_digests.push_back(make_pair(ckmsg->return_node, ckmsg->digest));
+        return 0;
+    }
+    if (ckmsg->digest == chkpt_digest)
+    {
+        return 1;
+    }
+    log_chkpt_mismatch(ckmsg->txn_id, ckmsg->return_node, ckmsg->digest);
+    return 0;
+}
+
+// Report a checkpoint that does not count: without enough matching ones,
+// the txn mans up to the checkpoint are never released.
+void TxnManager::log_chkpt_mismatch(uint64_t txn_id, uint64_t node, const StateDigest &digest)
+{
+    cerr << "Checkpoint " << txn_id << ": node " << node << " has digest " << digest.toString()
+         << ", this replica has " << chkpt_digest.toString() << endl;
+}
+#endif
+
 /* Helper functions for PBFT. */
 void TxnManager::set_prepared()
 {
@@ -688,23 +756,28 @@ void TxnManager::send_checkpoint_msgs()
     Message *msg = Message::create_message(this, PBFT_CHKPT_MSG);
     CheckpointMessage *ckmsg = (CheckpointMessage *)msg;
 
-//     vector<uint64_t> dest;
-//     for (uint64_t i = 0; i < g_node_cnt; i++)
-//     {
-// #if RING_BFT || SHARPER
-//         if (!is_in_same_shard(i, g_node_id))
-//         {
-//             continue;
-//         }
-// #endif
-//         if (i == g_node_id)
-//         {
-//             continue;
-//         }
-//         dest.push_back(i);
-//     }
-
-//     msg_queue.enqueue(get_thd_id(), ckmsg, dest);
-//     dest.clear();
-    work_queue.enqueue(get_thd_id(), ckmsg, false);
+    // The others compare their digest with this one. The copy kept for
+    // this replica carries the same digest.
+    CheckpointMessage *own = (CheckpointMessage *)Message::create_message(this, PBFT_CHKPT_MSG);
+    own->digest = ckmsg->digest;
+
+    vector<uint64_t> dest;
+    for (uint64_t i = 0; i < g_node_cnt; i++)
+    {
+#if RING_BFT || SHARPER
+        if (!is_in_same_shard(i, g_node_id))
+        {
+            continue;
+        }
+#endif
+        if (i == g_node_id)
+        {
+            continue;
+        }
+        dest.push_back(i);
+    }
+
+    msg_queue.enqueue(get_thd_id(), ckmsg, dest);
+    dest.clear();
+    work_queue.enqueue(get_thd_id(), own, false);
 }
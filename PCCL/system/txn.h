@@ -91,17 +91,25 @@ public:
     Thread *h_thd;
     Workload *h_wl;
 
-    virtual RC run_txn() = 0;
+    // Execute the txn on state: the database, or the view of it given to
+    // the txn by a parallel execution (see BlockSTM).
+    virtual RC run_txn(DataBase *state) = 0;
+    RC run_txn() { return run_txn(db); }
 #if ISEOV
     #if PRE_EX
-    virtual RC simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &speculateSet) = 0;
+    virtual RC simulate_txn(RWSet &readSet, RWSet &writeSet, Overlay &speculateSet) = 0;
     #else
-    virtual RC simulate_txn(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet) = 0;
+    virtual RC simulate_txn(RWSet &readSet, RWSet &writeSet) = 0;
     #endif
 #if RE_EXECUTE
-    virtual RC validate_and_merge(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet, unordered_map<uint64_t,uint64_t> &mergeSet) = 0; 
+    virtual RC validate_and_merge(RWSet &readSet, RWSet &writeSet, Overlay &mergeSet) = 0; 
+    #if PARTIAL_RE_EXECUTE
+    // Execute the txn reading through and writing into mergeSet. Returns
+    // RCOK if it commits.
+    virtual RC re_execute_txn(Overlay &mergeSet) = 0;
+    #endif
 #else
-    virtual RC validate_and_commit(map<uint64_t,uint64_t> &readSet, map<uint64_t,uint64_t> &writeSet) = 0;
+    virtual RC validate_and_commit(RWSet &readSet, RWSet &writeSet) = 0;
 #endif
 #endif
     void register_thread(Thread *h_thd);
@@ -215,6 +223,17 @@ public:
     uint64_t decr_chkpt_cnt();
     uint64_t get_chkpt_cnt();
     void send_checkpoint_msgs();
+#if STATE_DIGEST
+    // Checkpoints agreeing with the digest of this replica, among those
+    // counted for the first time by taking ckmsg. Each node counts once.
+    uint64_t match_chkpt(CheckpointMessage *ckmsg);
+    void log_chkpt_mismatch(uint64_t txn_id, uint64_t node, const StateDigest &digest);
+
+    bool own_chkpt = false;
+    StateDigest chkpt_digest; // of this replica, once own_chkpt
+    vector<pair<uint64_t, StateDigest>> peer_digests; // by node, arrived before own_chkpt
+    set<uint64_t> chkpt_senders;
+#endif
 
     TxnStats txn_stats;
 
@@ -13,6 +13,39 @@
 #include "message.h"
 #include "timer.h"
 #include "chain.h"
+#include "overlay.h"
+#include "hot_keys.h"
+#include "smart_contract.h"
+#if STATE_SNAPSHOT && COW_SNAPSHOT
+#include <thread>
+#include <atomic>
+#endif
+
+#if STATE_SNAPSHOT && COW_SNAPSHOT
+/*
+   Write snap to the state snapshot file from a helper thread, so that the
+   execute thread does not wait for the disk. A checkpoint reached while
+   the previous one is still being written is skipped.
+*/
+static void save_state_snapshot(StateSnapshot *snap)
+{
+    static std::atomic<bool> saving(false);
+    if (snap == NULL)
+    {
+        return;
+    }
+    if (saving.exchange(true))
+    {
+        snap->Release();
+        return;
+    }
+    std::thread([snap]() {
+        snap->Save(state_snapshot_path());
+        snap->Release();
+        saving = false;
+    }).detach();
+}
+#endif
 
 WorkerThread::~WorkerThread() {
      if(txn_man){
@@ -21,6 +54,22 @@ WorkerThread::~WorkerThread() {
      }
 }
 
+/**
+ * Stops the helper threads of this worker, which may still read the store.
+ * Called once the worker thread returned, before the store is closed.
+ */
+void WorkerThread::release_helpers()
+{
+#if PARALLEL_SIMULATE
+    delete simulator;
+    simulator = NULL;
+#endif
+#if PARALLEL_VALIDATE
+    delete validator;
+    validator = NULL;
+#endif
+}
+
 void WorkerThread::send_key()
 {
     // Send everyone the public key.
@@ -129,7 +178,13 @@ void WorkerThread::process(Message *msg)
         rc = process_pbft_chkpt_msg(msg);
         break;
     case EXECUTE_MSG:
+#if PARALLEL_VALIDATE || PARTITIONED_EXECUTE
+        rc = process_execute_msg_parallel(msg);
+#elif BLOCK_STM
+        rc = process_execute_msg_stm(msg);
+#else
         rc = process_execute_msg(msg);
+#endif
         break;
 #if VIEW_CHANGES
     case VIEW_CHANGE:
@@ -719,6 +774,9 @@ RC WorkerThread::run()
 
         if (!msg)
         {
+            #if DEFER_CONFLICTS
+            propose_held_batch();
+            #endif
             #if SEMA_TEST
             sem_post(&worker_queue_semaphore[thd_id]);
             #else
@@ -829,7 +887,10 @@ RC WorkerThread::run()
             }
             if(msg->rtype == PBFT_CHKPT_MSG){
                 //printf("test_v4:Err:msg->rtype == PBFT_CHKPT_MSG\n");
+#if !STATE_DIGEST
+                // Checkpoints are only sent with STATE_DIGEST.
                 assert(0);
+#endif
                 g_checkpointing_lock.lock();
                 txn_chkpt_holding[thd_id % 2] = msg->txn_id;
                 is_chkpt_holding[thd_id % 2] = true;
@@ -1011,6 +1072,7 @@ void WorkerThread::init_txn_man(YCSBClientQueryMessage *clqry)
 
     //YCSBQuery *query = (YCSBQuery *)(txn_man->query);
     YCSBQuery *qry = new YCSBQuery();
+    qry->init();
 
     for (uint64_t i = 0; i < clqry->requests.size(); i++)
     {
@@ -1018,8 +1080,11 @@ void WorkerThread::init_txn_man(YCSBClientQueryMessage *clqry)
         req->key = clqry->requests[i]->key;
         req->value = clqry->requests[i]->value;
         req->column = clqry->requests[i]->column;
+        req->scan_len = clqry->requests[i]->scan_len;
         req->type = clqry->requests[i]->type;
-        qry->init();
+#if LARGER_TXN
+        req->payload = value_ref(clqry->requests[i]->payload);
+#endif
         qry->requests.add(req);
     }
 
@@ -1094,6 +1159,8 @@ RC WorkerThread::process_execute_msg(Message *msg)
 
     // Execute transactions in a shot
     uint64_t i;
+    // The updates of the batch are committed to the database together.
+    db->BeginBatch();
     #if ISEOV
         uint64_t count = 0;
         TxnManager *tman_end = get_transaction_manager(emsg->net_id, emsg->end_index, msg->batch_id);
@@ -1101,8 +1168,25 @@ RC WorkerThread::process_execute_msg(Message *msg)
         // vector<map<uint64_t,uint64_t>> *read_set = tman_end->get_readSet_vec();
         // vector<map<uint64_t,uint64_t>> *write_set = tman_end->get_writeSet_vec();
         #if RE_EXECUTE
-        unordered_map<uint64_t,uint64_t> *mergeSet = new std::unordered_map<uint64_t,uint64_t>();
+        Overlay *mergeSet = new Overlay();
         uint64_t valid_count = 0;
+        #if PARTIAL_RE_EXECUTE
+        batch_valid.assign(emsg->end_index - emsg->index + 1, 0);
+        #endif
+        #endif
+        #if HOT_ESCROW
+        // The accounts the primary split with this batch are split before
+        // its txns run.
+        if (!breq->escrowSplits.empty())
+        {
+            Overlay splits;
+            for (uint64_t id : breq->escrowSplits)
+            {
+                escrow_split(id, splits);
+            }
+            db->ApplyWriteSet(splits);
+            INC_STATS(get_thd_id(), escrow_split_cnt, breq->escrowSplits.size());
+        }
         #endif
     #endif
 
@@ -1135,6 +1219,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         }
         else{
             valid_count ++;
+            #if PARTIAL_RE_EXECUTE
+            batch_valid[count] = 1;
+            #endif
             //INC_STATS(get_thd_id(), valid_txn_cnt, 1);
         }
         tman->commit();
@@ -1144,6 +1231,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         if(tman->validate_and_commit(breq->readSet[count], breq->writeSet[count]) != RCOK){
             tman->aborted = true;
             INC_STATS(get_thd_id(), invalid_txn_cnt, 1);
+            #if HOT_ESCROW
+            hot_keys.record_abort(get_thd_id(), breq->readSet[count]);
+            #endif
         }
         else{
             INC_STATS(get_thd_id(), valid_txn_cnt, 1);
@@ -1191,6 +1281,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         }
         else{
             valid_count ++;
+            #if PARTIAL_RE_EXECUTE
+            batch_valid[count] = 1;
+            #endif
             //INC_STATS(get_thd_id(), valid_txn_cnt, 1);
         }
         tman->commit();
@@ -1200,6 +1293,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         if(tman->validate_and_commit(breq->readSet[count], breq->writeSet[count]) != RCOK){
             tman->aborted = true;
             INC_STATS(get_thd_id(), invalid_txn_cnt, 1);
+            #if HOT_ESCROW
+            hot_keys.record_abort(get_thd_id(), breq->readSet[count]);
+            #endif
         }
         else{
             INC_STATS(get_thd_id(), valid_txn_cnt, 1);
@@ -1252,6 +1348,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         }
         else{
             valid_count ++;
+            #if PARTIAL_RE_EXECUTE
+            batch_valid[count] = 1;
+            #endif
             //INC_STATS(get_thd_id(), valid_txn_cnt, 1);
         }
         txn_man->commit();
@@ -1261,6 +1360,9 @@ RC WorkerThread::process_execute_msg(Message *msg)
         if(txn_man->validate_and_commit(breq->readSet[count], breq->writeSet[count]) != RCOK){
             txn_man->aborted = true;
             INC_STATS(get_thd_id(), invalid_txn_cnt, 1);
+            #if HOT_ESCROW
+            hot_keys.record_abort(get_thd_id(), breq->readSet[count]);
+            #endif
         }
         else{
             INC_STATS(get_thd_id(), valid_txn_cnt, 1);
@@ -1282,8 +1384,19 @@ RC WorkerThread::process_execute_msg(Message *msg)
     #endif
 
     #if RE_EXECUTE
+    #if PARTIAL_RE_EXECUTE
+        // Only redo the txns that failed validation and their dependents.
+        if(valid_count < get_batch_size())
+        {
+            uint64_t redo_count = re_execute_dependents(emsg, breq, *mergeSet, valid_count);
+            INC_STATS(get_thd_id(), re_execute_txn_cnt, redo_count);
+        }
+        db->ApplyWriteSet(*mergeSet);
+        INC_STATS(get_thd_id(), valid_txn_cnt, valid_count);
+        INC_STATS(get_thd_id(), invalid_txn_cnt, get_batch_size() - valid_count);
+    Overlay().swap(*mergeSet);
     //re_execute all txn
-    #if ABORT_BATCH
+    #elif ABORT_BATCH
         if(is_re_execute){
             //DEBUG_V1("test_v6:re-execute tx\n");
             for (i = emsg->index; i <= emsg->end_index; i++)
@@ -1310,15 +1423,12 @@ RC WorkerThread::process_execute_msg(Message *msg)
             else
             {
                 //DEBUG_V1("test_v6:commit merge, valid_count = %ld\n", valid_count);
-                for(auto item:*mergeSet)
-                {
-                    db->Put(std::to_string(item.first), std::to_string(item.second));
-                }
+                db->ApplyWriteSet(*mergeSet);
                 INC_STATS(get_thd_id(), valid_txn_cnt, valid_count);
             }
         }
 
-    unordered_map<uint64_t,uint64_t> ().swap(*mergeSet);
+    Overlay().swap(*mergeSet);
     #else
         if(valid_count < (g_merge_percent  * get_batch_size()) / 100)
         {
@@ -1333,19 +1443,17 @@ RC WorkerThread::process_execute_msg(Message *msg)
         else
         {
             DEBUG_V1("test_v6:commit merge, valid_count = %ld\n", valid_count);
-            for(auto item:*mergeSet)
-            {
-                db->Put(std::to_string(item.first), std::to_string(item.second));
-            }
+            db->ApplyWriteSet(*mergeSet);
             INC_STATS(get_thd_id(), valid_txn_cnt, valid_count);
         }
-    unordered_map<uint64_t,uint64_t> ().swap(*mergeSet);
+    Overlay().swap(*mergeSet);
     #endif
     #endif
 
     // Commit the results.
     //txn_man->commit();
-    
+    finish_executed_batch(emsg);
+
 
     crsp->copy_from_txn(txn_man);
     //cout << "test_v3:send:crsp->copy_from_txn(txn_man) = " << crsp->txn_id << " batch_id = "<< crsp->batch_id << "\n";
@@ -1360,9 +1468,273 @@ RC WorkerThread::process_execute_msg(Message *msg)
     INC_STATS(_thd_id, tput_msg, 1);
     INC_STATS(_thd_id, msg_cl_out, 1);
 
+    // Setting the next expected prepare message id.
+    set_expectedExecuteCount(msg->txn_id);
+
+    // End the execute counter.
+    INC_STATS(get_thd_id(), time_execute, get_sys_clock() - ctime);
+    return RCOK;
+}
+// #endif //!MULTI_ON
+
+/**
+ * End of the execution of a batch, common to every way of executing it.
+ *
+ * Commits the updates made since db->BeginBatch, publishes the snapshot and
+ * the state root of the batch, and sends checkpoints and saves the state
+ * when due. txn_man must be the last transaction of the batch.
+ *
+ * @param emsg Execute message of the batch.
+ */
+void WorkerThread::finish_executed_batch(ExecuteMessage *emsg)
+{
+    db->CommitBatch();
+#if COW_SNAPSHOT
+    db->PublishSnapshot(txn_man->get_txn_id());
+#endif
+#if MERKLE_STATE
+    // The root of the block is computed by the thread of the tree.
+    db->CommitStateRoot(txn_man->get_txn_id());
+#endif
+#if DEFER_CONFLICTS
+    retire_inflight_writes(emsg);
+#endif
+
     // Check and Send checkpoint messages.
     //test_v4:disable_checkpoints
     //send_checkpoints(txn_man->get_txn_id());
+#if STATE_DIGEST
+    send_checkpoints(txn_man->get_txn_id());
+#endif
+#if STATE_SNAPSHOT
+    if ((txn_man->get_txn_id() + 1) % txn_per_chkpt() == 0)
+    {
+#if COW_SNAPSHOT
+        save_state_snapshot(db->AcquireSnapshot());
+#else
+        db->SaveSnapshot(state_snapshot_path());
+#endif
+    }
+#endif
+}
+
+#if DEFER_CONFLICTS
+/**
+ * Drops the writes of a committed batch from the writes in flight, so that
+ * the requests reading them are no longer held back, and counts the requests
+ * held back before the batch that passed validation.
+ *
+ * @param emsg Execute message of the batch.
+ */
+void WorkerThread::retire_inflight_writes(ExecuteMessage *emsg)
+{
+    vector<uint32_t> deferred;
+    if (emsg->net_id != g_net_id || !inflight_writes.retire(emsg->end_index, deferred))
+    {
+        return;
+    }
+    for (uint32_t pos : deferred)
+    {
+        TxnManager *tman = get_transaction_manager(emsg->net_id, emsg->index + pos, emsg->batch_id);
+        if (!tman->aborted)
+        {
+            INC_STATS(get_thd_id(), defer_committed_cnt, 1);
+        }
+    }
+}
+#endif
+
+#if PARTIAL_RE_EXECUTE
+#if !ISEOV || !RE_EXECUTE || !CHECK_CONFILICT
+#error "PARTIAL_RE_EXECUTE needs ISEOV, CHECK_CONFILICT and RE_EXECUTE"
+#endif
+/**
+ * Re-execute the transactions of a batch that failed validate_and_merge,
+ * together with all the transactions that transitively depend on them.
+ *
+ * A transaction that is not redone reads the same values as during 
+ * validation, so its writes are the ones of the write set computed by the 
+ * primary. mergeSet is rebuilt in batch order from these write sets and from
+ * the re-executed transactions.
+ *
+ * @param emsg Execute message of the batch.
+ * @param breq Batch carrying the read/write sets of the transactions.
+ * @param mergeSet Merged writes of the valid transactions, replaced by the 
+ *                 writes of the whole batch.
+ * @param valid_count Receives the number of transactions that commit.
+ * @ret number of re-executed transactions.
+ */
+uint64_t WorkerThread::re_execute_dependents(ExecuteMessage *emsg, BatchRequests *breq, Overlay &mergeSet,
+                                             uint64_t &valid_count)
+{
+    uint64_t txn_cnt = emsg->end_index - emsg->index + 1;
+    batch_graph.build(breq, txn_cnt);
+
+    // Edges only go forward in the batch, so a single pass marks all the
+    // transitive dependents.
+    batch_redo.assign(txn_cnt, 0);
+    for (uint64_t j = 0; j < txn_cnt; j++)
+    {
+        if (!batch_valid[j])
+        {
+            batch_redo[j] = 1;
+        }
+        if (batch_redo[j])
+        {
+            for (uint32_t s : batch_graph.successors(j))
+            {
+                batch_redo[s] = 1;
+            }
+        }
+    }
+
+    uint64_t redo_count = 0;
+    valid_count = 0;
+    mergeSet.clear();
+    for (uint64_t j = 0; j < txn_cnt; j++)
+    {
+        if (batch_redo[j])
+        {
+            // A redone txn that commits is no longer aborted.
+            TxnManager *tman = get_transaction_manager(emsg->net_id, emsg->index + j, emsg->batch_id);
+            tman->aborted = tman->re_execute_txn(mergeSet) != RCOK;
+            batch_valid[j] = !tman->aborted;
+            valid_count += batch_valid[j];
+            redo_count++;
+        }
+        else
+        {
+            for (const auto &item : breq->writeSet[j])
+            {
+                // A delta is added to the value merged so far.
+                uint64_t version;
+                uint64_t value = state_get(mergeSet, item.first, 0, version);
+                overlay_put(mergeSet, item.first, item.delta ? value + item.second : item.second, version, item.buf);
+            }
+            valid_count++;
+        }
+    }
+    return redo_count;
+}
+#endif
+
+#if PARALLEL_VALIDATE || PARTITIONED_EXECUTE
+/**
+ * Execute transactions and send client response, validating independent 
+ * transactions of a batch in parallel.
+ *
+ * Same contract as process_execute_msg. The read/write sets shipped by the primary
+ * are turned into a dependency graph and the transactions are validated and 
+ * committed by a pool of helper threads in an order compatible with the batch 
+ * order, so the final state is the same as with serial validation. With
+ * PARTITIONED_EXECUTE the sets instead assign each transaction to the
+ * partitions of the keys it touches, each validated by its own thread (see
+ * PartitionedExecutor). Statistics, txn man bookkeeping and the client
+ * response are then handled in batch order.
+ *
+ * @param msg Execute message that notifies execution of a batch.
+ * @ret RC
+ */
+RC WorkerThread::process_execute_msg_parallel(Message *msg)
+{
+    uint64_t ctime = get_sys_clock();
+
+    Message *rsp = Message::create_message(CL_RSP);
+    ClientResponseMessage *crsp = (ClientResponseMessage *)rsp;
+    crsp->init();
+
+    ExecuteMessage *emsg = (ExecuteMessage *)msg;
+    crsp->set_net_id(emsg->net_id);
+
+#if PARTITIONED_EXECUTE
+    if (partitioner == NULL)
+    {
+        partitioner = new PartitionedExecutor();
+        partitioner->init(PARTITION_CNT);
+    }
+#else
+    if (validator == NULL)
+    {
+        validator = new ParallelValidator();
+        validator->init(PARALLEL_VALIDATE_THD_CNT);
+    }
+#endif
+
+    TxnManager *tman_end = get_transaction_manager(emsg->net_id, emsg->end_index, msg->batch_id);
+    BatchRequests *breq = tman_end->batchreq;
+
+    // Collect the txn managers of the batch. As in process_execute_msg, the 
+    // managers of the last transactions must not be held by another thread.
+    batch_tmans.clear();
+    for (uint64_t i = emsg->index; i <= emsg->end_index; i++)
+    {
+        TxnManager *tman = get_transaction_manager(emsg->net_id, i, msg->batch_id);
+        if (i >= emsg->end_index - 4)
+        {
+            unset_ready_txn(tman);
+        }
+        batch_tmans.push_back(tman);
+    }
+
+    // The updates of the batch are committed to the database together.
+    db->BeginBatch();
+#if PARTITIONED_EXECUTE
+    uint64_t multi_cnt = partitioner->run(batch_tmans, breq, batch_valid);
+    INC_STATS(get_thd_id(), cross_partition_txn_cnt, multi_cnt);
+#else
+    validator->run(batch_tmans, breq, batch_valid);
+#endif
+
+    for (uint64_t count = 0; count < batch_tmans.size(); count++)
+    {
+        uint64_t i = emsg->index + count;
+        TxnManager *tman = batch_tmans[count];
+
+        if(emsg->net_id == g_net_id){
+            inc_next_index();
+        }
+
+#if ENABLE_CHAIN
+        if (i == emsg->end_index)
+        {
+            // Add the block to the blockchain.
+            BlockChain->add_block(tman);
+        }
+#endif
+
+        if (!batch_valid[count])
+        {
+            tman->aborted = true;
+            INC_STATS(get_thd_id(), invalid_txn_cnt, 1);
+        }
+        else
+        {
+            INC_STATS(get_thd_id(), valid_txn_cnt, 1);
+        }
+        tman->commit();
+
+        crsp->copy_from_txn(tman);
+        INC_STATS(get_thd_id(), txn_cnt, 1);
+
+        // Making the txn man of (**95 - **98) available.
+        if (i >= emsg->end_index - 4 && i < emsg->end_index)
+        {
+            bool ready = tman->set_ready();
+            assert(ready);
+        }
+    }
+
+    // Last Transaction of the batch.
+    txn_man = batch_tmans.back();
+    finish_executed_batch(emsg);
+
+    vector<uint64_t> dest;
+    dest.push_back(txn_man->client_id);
+    msg_queue.enqueue(get_thd_id(), crsp, dest);
+    dest.clear();
+
+    INC_STATS(_thd_id, tput_msg, 1);
+    INC_STATS(_thd_id, msg_cl_out, 1);
 
     // Setting the next expected prepare message id.
     set_expectedExecuteCount(msg->txn_id);
@@ -1371,12 +1743,114 @@ RC WorkerThread::process_execute_msg(Message *msg)
     INC_STATS(get_thd_id(), time_execute, get_sys_clock() - ctime);
     return RCOK;
 }
-// #endif //!MULTI_ON
+#endif
+
+#if BLOCK_STM
+/**
+ * Execute transactions and send client response, running the transactions
+ * of a batch in parallel.
+ *
+ * Same contract as process_execute_msg. The transactions are executed by a
+ * BlockSTM on a pool of helper threads against a multi-version memory, and
+ * only those whose reads were invalidated by an earlier transaction of the
+ * batch run again, so the final state is the same as with serial execution.
+ * Statistics, txn man bookkeeping and the client response are then handled
+ * in batch order.
+ *
+ * @param msg Execute message that notifies execution of a batch.
+ * @ret RC
+ */
+RC WorkerThread::process_execute_msg_stm(Message *msg)
+{
+    uint64_t ctime = get_sys_clock();
+
+    Message *rsp = Message::create_message(CL_RSP);
+    ClientResponseMessage *crsp = (ClientResponseMessage *)rsp;
+    crsp->init();
+
+    ExecuteMessage *emsg = (ExecuteMessage *)msg;
+    crsp->set_net_id(emsg->net_id);
+
+    if (stm == NULL)
+    {
+        stm = new BlockSTM();
+        stm->init(BLOCK_STM_THD_CNT);
+    }
+
+    // Collect the txn managers of the batch. As in process_execute_msg, the 
+    // managers of the last transactions must not be held by another thread.
+    stm_tmans.clear();
+    for (uint64_t i = emsg->index; i <= emsg->end_index; i++)
+    {
+        TxnManager *tman = get_transaction_manager(emsg->net_id, i, msg->batch_id);
+        if (i >= emsg->end_index - 4)
+        {
+            unset_ready_txn(tman);
+        }
+        stm_tmans.push_back(tman);
+    }
+
+    // The updates of the batch are committed to the database together.
+    db->BeginBatch();
+    uint64_t redo_count = stm->run(stm_tmans);
+    INC_STATS(get_thd_id(), stm_re_execute_cnt, redo_count);
+
+    for (uint64_t count = 0; count < stm_tmans.size(); count++)
+    {
+        uint64_t i = emsg->index + count;
+        TxnManager *tman = stm_tmans[count];
+
+        if(emsg->net_id == g_net_id){
+            inc_next_index();
+        }
+
+#if ENABLE_CHAIN
+        if (i == emsg->end_index)
+        {
+            // Add the block to the blockchain.
+            BlockChain->add_block(tman);
+        }
+#endif
+
+        tman->commit();
+
+        crsp->copy_from_txn(tman);
+        INC_STATS(get_thd_id(), txn_cnt, 1);
+
+        // Making the txn man of (**95 - **98) available.
+        if (i >= emsg->end_index - 4 && i < emsg->end_index)
+        {
+            bool ready = tman->set_ready();
+            assert(ready);
+        }
+    }
+
+    // Last Transaction of the batch.
+    txn_man = stm_tmans.back();
+    finish_executed_batch(emsg);
+
+    vector<uint64_t> dest;
+    dest.push_back(txn_man->client_id);
+    msg_queue.enqueue(get_thd_id(), crsp, dest);
+    dest.clear();
+
+    INC_STATS(_thd_id, tput_msg, 1);
+    INC_STATS(_thd_id, msg_cl_out, 1);
+
+    // Setting the next expected prepare message id.
+    set_expectedExecuteCount(msg->txn_id);
+
+    // End the execute counter.
+    INC_STATS(get_thd_id(), time_execute, get_sys_clock() - ctime);
+    return RCOK;
+}
+#endif
+
 /**
- * This function helps in periodically sending out CheckpointMessage. At present these
- * messages are including just including information about first and last txn of the 
- * batch but later we should include a digest. Further, a checkpoint is only sent after
- * transaction id is a multiple of a config.h parameter.
+ * This function helps in periodically sending out CheckpointMessage. With STATE_DIGEST
+ * these messages carry the digest of the state after the batch, and a checkpoint is
+ * only marked once enough replicas sent the same digest. Further, a checkpoint is only
+ * sent after transaction id is a multiple of a config.h parameter.
  *
  * @param txn_id Transaction identifier of the last transaction in the batch..
  * @ret RC
@@ -1385,6 +1859,11 @@ void WorkerThread::send_checkpoints(uint64_t txn_id)
 {
     if ((txn_id + 1) % txn_per_chkpt() == 0)
     {
+#if STATE_DIGEST
+        // The digest of the state is kept up to date by the store, so the
+        // message takes it as is.
+        txn_man->send_checkpoint_msgs();
+#endif
         // TxnManager *tman =
         //     txn_tables[0]->get_transaction_manager(get_thd_id(), txn_id, 0);
         // tman->send_checkpoint_msgs();
@@ -1417,7 +1896,17 @@ RC WorkerThread::process_pbft_chkpt_msg(Message *msg)
     }
     else
     {
+#if STATE_DIGEST
+        // Only the checkpoints with the digest of this replica count.
+        uint64_t matched = txn_man->match_chkpt(ckmsg);
+        uint64_t num_chkpt = txn_man->get_chkpt_cnt();
+        for (; matched > 0 && num_chkpt > 0; matched--)
+        {
+            num_chkpt = txn_man->decr_chkpt_cnt();
+        }
+#else
         uint64_t num_chkpt = txn_man->decr_chkpt_cnt();
+#endif
         // If sufficient number of messages received, then set the flag.
         if (num_chkpt == 0)
         {
@@ -1610,6 +2099,10 @@ void WorkerThread::create_and_send_batchreq(ClientQueryBatch *msg, uint64_t tid)
     //cout << "test_v1:create_message(BATCH_REQ)\n";
     BatchRequests *breq = (BatchRequests *)bmsg;
     breq->init(get_thd_id());
+#if BATCH_REORDER
+    // Fix the execution order of the batch before it is simulated and hashed.
+    reorderer.reorder(msg);
+#endif
 #if PRE_ORDER
     breq->add_state(msg);
 #endif
@@ -1628,8 +2121,25 @@ void WorkerThread::create_and_send_batchreq(ClientQueryBatch *msg, uint64_t tid)
 
     // String of transactions in a batch to generate hash.
     string batchStr;
+#if PARALLEL_SIMULATE
+    if (simulator == NULL)
+    {
+        simulator = new ParallelSimulator();
+        simulator->init(PARALLEL_SIMULATE_THD_CNT);
+    }
+    sim_tmans.clear();
+#elif ISEOV && PRE_EX
+    speculateSet.clear();
+#endif
+#if HOT_ESCROW
+    // Accounts found hot since the last batch are split with this one.
+    hot_keys.take_splits(breq->escrowSplits);
 #if PRE_EX
-    unordered_map<uint64_t,uint64_t> *speculateSet = new std::unordered_map<uint64_t,uint64_t>();
+    for (uint64_t id : breq->escrowSplits)
+    {
+        escrow_split(id, speculateSet);
+    }
+#endif
 #endif
 
     // Allocate transaction manager for all the requests in batch.
@@ -1664,8 +2174,11 @@ void WorkerThread::create_and_send_batchreq(ClientQueryBatch *msg, uint64_t tid)
         //cout << "test_v1:copy_from_txn(txn_man, msg->cqrySet[i]\n";
     #if ISEOV
         // cout << "test_v5:create_and_send_batchreq::before_simulate\n";
-        #if PRE_EX
-        txn_man->simulate_txn(breq->readSet[i], breq->writeSet[i], *speculateSet);
+        #if PARALLEL_SIMULATE
+        // Simulated together with the rest of the batch below.
+        sim_tmans.push_back(txn_man);
+        #elif PRE_EX
+        txn_man->simulate_txn(breq->readSet[i], breq->writeSet[i], speculateSet);
         #else
         txn_man->simulate_txn(breq->readSet[i], breq->writeSet[i]);
         #endif
@@ -1694,12 +2207,30 @@ void WorkerThread::create_and_send_batchreq(ClientQueryBatch *msg, uint64_t tid)
     #endif
 
 
+    #if !PARALLEL_SIMULATE
         // Reset this txn manager.
         bool ready = txn_man->set_ready();
         assert(ready);
+    #endif
     }
     //cout << "test_v1:out of loop\n";
 
+#if PARALLEL_SIMULATE
+    simulator->run(msg, sim_tmans, breq->readSet, breq->writeSet);
+    for (TxnManager *tman : sim_tmans)
+    {
+        // Reset this txn manager.
+        bool ready = tman->set_ready();
+        assert(ready);
+    }
+#endif
+
+#if DEFER_CONFLICTS
+    // Requests reading what this batch writes are held back until it is
+    // committed.
+    inflight_writes.add(txn_man->get_txn_id(), breq, deferrer.deferred);
+#endif
+
     // Now we need to unset the txn_man again for the last txn of batch.
     unset_ready_txn(txn_man);
 
@@ -4,6 +4,11 @@
 #include "global.h"
 #include "message.h"
 #include "crypto.h"
+#include "conflict_graph.h"
+#include "block_stm.h"
+#include "partition_exec.h"
+#include "batch_order.h"
+#include "contention.h"
 
 class Workload;
 class Message;
@@ -16,6 +21,7 @@ public:
     void setup();
     void send_key();
     RC process_key_exchange(Message *msg);
+    void release_helpers();
 
     void process(Message *msg);
     TxnManager *get_transaction_manager(uint64_t net_id, uint64_t txn_id, uint64_t batch_id);
@@ -42,6 +48,10 @@ public:
     bool validate_msg(Message *msg);
     bool checkMsg(Message *msg);
     RC process_client_batch(Message *msg);
+#if DEFER_CONFLICTS
+    void propose_held_batch();
+    void retire_inflight_writes(ExecuteMessage *emsg);
+#endif
     RC process_batch(Message *msg);
     RC process_broadcast_batch(Message *msg);
     void send_checkpoints(uint64_t txn_id);
@@ -56,6 +66,17 @@ public:
     void send_execute_msg();
     void send_broadcast_batch_msg();
     RC process_execute_msg(Message *msg);
+    void finish_executed_batch(ExecuteMessage *emsg);
+#endif
+#if PARALLEL_VALIDATE || PARTITIONED_EXECUTE
+    RC process_execute_msg_parallel(Message *msg);
+#endif
+#if BLOCK_STM
+    RC process_execute_msg_stm(Message *msg);
+#endif
+#if PARTIAL_RE_EXECUTE
+    uint64_t re_execute_dependents(ExecuteMessage *emsg, BatchRequests *breq, Overlay &mergeSet,
+                                   uint64_t &valid_count);
 #endif
 
 #if TIMER_ON
@@ -108,6 +129,39 @@ private:
     uint64_t _thd_txn_id;
     ts_t _curr_ts;
     TxnManager *txn_man;
+#if BATCH_REORDER
+    BatchReorderer reorderer;
+#endif
+#if DEFER_CONFLICTS
+    ConflictDeferrer deferrer;
+#endif
+#if ISEOV && PRE_EX
+    Overlay speculateSet; // reused by every batch
+#endif
+#if PARALLEL_SIMULATE
+    ParallelSimulator *simulator = NULL;
+    vector<TxnManager *> sim_tmans;
+#endif
+#if PARALLEL_VALIDATE
+    ParallelValidator *validator = NULL;
+#endif
+#if PARTITIONED_EXECUTE
+    PartitionedExecutor *partitioner = NULL;
+#endif
+#if PARALLEL_VALIDATE || PARTITIONED_EXECUTE
+    vector<TxnManager *> batch_tmans;
+#endif
+#if BLOCK_STM
+    BlockSTM *stm = NULL;
+    vector<TxnManager *> stm_tmans;
+#endif
+#if PARALLEL_VALIDATE || PARTIAL_RE_EXECUTE || PARTITIONED_EXECUTE
+    vector<uint8_t> batch_valid;
+#endif
+#if PARTIAL_RE_EXECUTE
+    ConflictGraph batch_graph;
+    vector<uint8_t> batch_redo;
+#endif
 };
 
 #endif
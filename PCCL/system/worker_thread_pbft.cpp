@@ -63,12 +63,56 @@ RC WorkerThread::process_client_batch(Message *msg)
     //fail_primary(msg, 10 * BILLION);
 #endif
 
+#if DEFER_CONFLICTS
+    // The batch held before is proposed first. This one waits for the next
+    // arrival only if it has requests to hold back.
+    ClientQueryBatch *ready = NULL;
+    bool held = deferrer.arrive(clbtch, get_thd_id(), ready);
+    txn_man = NULL;
+    if (ready != NULL)
+    {
+        create_and_send_batchreq(ready, ready->txn_id);
+        Message::release_message(ready);
+        if (!held)
+        {
+            // The txn man of this batch is made ready by the caller.
+            bool ready_txn = txn_man->set_ready();
+            assert(ready_txn);
+        }
+    }
+    if (!held)
+    {
+        // None of its requests were held back before.
+        deferrer.deferred.clear();
+        create_and_send_batchreq(clbtch, clbtch->txn_id);
+    }
+#else
     // Initialize all transaction mangers and Send BatchRequests message.
     create_and_send_batchreq(clbtch, clbtch->txn_id);
+#endif
 
     return RCOK;
 }
 
+#if DEFER_CONFLICTS
+/**
+ * Proposes the client batch held by this thread, if any, when no other
+ * batch arrived to trade requests with.
+ */
+void WorkerThread::propose_held_batch()
+{
+    ClientQueryBatch *ready = deferrer.flush();
+    if (ready == NULL)
+    {
+        return;
+    }
+    create_and_send_batchreq(ready, ready->txn_id);
+    bool ready_txn = txn_man->set_ready();
+    assert(ready_txn);
+    Message::release_message(ready);
+}
+#endif
+
 /**
  * Process incoming BatchRequests message from the Primary.
  *
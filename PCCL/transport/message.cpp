@@ -660,6 +660,45 @@ string BankingSmartContractMessage::getString()
 	return message;
 }
 #else
+#if LARGER_TXN
+// A request is sent field by field, as its payload pointer is local. The
+// payload follows, as its length and bytes.
+static uint64_t request_size(ycsb_request *req)
+{
+	uint64_t size = sizeof(req->key) + sizeof(req->value) + sizeof(req->column) + sizeof(req->scan_len) + sizeof(req->type);
+	return size + sizeof(uint32_t) + (req->payload == NULL ? 0 : req->payload->len);
+}
+
+static void request_to_buf(char *buf, uint64_t &ptr, ycsb_request *req)
+{
+	COPY_BUF(buf, req->key, ptr);
+	COPY_BUF(buf, req->value, ptr);
+	COPY_BUF(buf, req->column, ptr);
+	COPY_BUF(buf, req->scan_len, ptr);
+	COPY_BUF(buf, req->type, ptr);
+	uint32_t len = req->payload == NULL ? 0 : req->payload->len;
+	COPY_BUF(buf, len, ptr);
+	if (len > 0)
+	{
+		COPY_BUF_SIZE(buf, req->payload->data, ptr, len);
+	}
+}
+
+// The bytes are copied once out of the message, then shared.
+static void request_from_buf(char *buf, uint64_t &ptr, ycsb_request *req)
+{
+	COPY_VAL(req->key, buf, ptr);
+	COPY_VAL(req->value, buf, ptr);
+	COPY_VAL(req->column, buf, ptr);
+	COPY_VAL(req->scan_len, buf, ptr);
+	COPY_VAL(req->type, buf, ptr);
+	uint32_t len;
+	COPY_VAL(len, buf, ptr);
+	req->payload = len == 0 ? NULL : value_alloc(&buf[ptr], len);
+	ptr += len;
+}
+#endif
+
 void YCSBClientQueryMessage::init()
 {
 }
@@ -681,6 +720,7 @@ void YCSBClientQueryMessage::release()
 		for (uint64_t i = 0; i < requests.size(); i++)
 		{
 			DEBUG_M("YCSBClientQueryMessage::release ycsb_request free\n");
+			requests[i]->release();
 			mem_allocator.free(requests[i], sizeof(ycsb_request));
 #if PRE_ORDER
 			mem_allocator.free(requests_writeset[i], sizeof(ycsb_request_writeset));
@@ -697,7 +737,14 @@ uint64_t YCSBClientQueryMessage::get_size()
 	size += sizeof(RemReqType);
 	size += sizeof(client_startts);
 	size += sizeof(size_t);
+#if LARGER_TXN
+	for (uint64_t i = 0; i < requests.size(); i++)
+	{
+		size += request_size(requests[i]);
+	}
+#else
 	size += sizeof(ycsb_request) * requests.size();
+#endif
 #if PRE_ORDER
 	size += sizeof(ycsb_request_writeset) * requests_writeset.size();
 #endif
@@ -770,7 +817,11 @@ void YCSBClientQueryMessage::copy_from_buf(char *buf)
 	{
 		DEBUG_M("YCSBClientQueryMessage::copy ycsb_request alloc\n");
 		ycsb_request *req = (ycsb_request *)mem_allocator.alloc(sizeof(ycsb_request));
+#if LARGER_TXN
+		request_from_buf(buf, ptr, req);
+#else
 		COPY_VAL(*req, buf, ptr);
+#endif
 		assert(req->key < g_synth_table_size);
 		requests.add(req);
 	}
@@ -802,7 +853,11 @@ void YCSBClientQueryMessage::copy_to_buf(char *buf)
 	{
 		ycsb_request *req = requests[i];
 		assert(req->key < g_synth_table_size);
+#if LARGER_TXN
+		request_to_buf(buf, ptr, req);
+#else
 		COPY_BUF(buf, *req, ptr);
+#endif
 	}
 #if PRE_ORDER
 	for (uint64_t i = 0; i < requests_writeset.size(); i++)
@@ -828,6 +883,14 @@ string YCSBClientQueryMessage::getRequestString()
 		message += " ";
 		message += requests[i]->value;
 		message += " ";
+#if LARGER_TXN
+		// The payload is covered through its digest.
+		if (requests[i]->payload != NULL)
+		{
+			message += std::to_string(requests[i]->payload->digest);
+			message += " ";
+		}
+#endif
 	}
 #if PRE_ORDER
 	for (uint64_t i = 0; i < requests_writeset.size(); i++)
@@ -879,7 +942,14 @@ uint64_t YCSBQueryMessage::get_size()
 {
 	uint64_t size = QueryMessage::get_size();
 	size += sizeof(size_t);
+#if LARGER_TXN
+	for (uint64_t i = 0; i < requests.size(); i++)
+	{
+		size += request_size(requests[i]);
+	}
+#else
 	size += sizeof(ycsb_request) * requests.size();
+#endif
 	return size;
 }
 
@@ -909,7 +979,11 @@ void YCSBQueryMessage::copy_from_buf(char *buf)
 	{
 		DEBUG_M("YCSBQueryMessage::copy ycsb_request alloc\n");
 		ycsb_request *req = (ycsb_request *)mem_allocator.alloc(sizeof(ycsb_request));
+#if LARGER_TXN
+		request_from_buf(buf, ptr, req);
+#else
 		COPY_VAL(*req, buf, ptr);
+#endif
 		ASSERT(req->key < g_synth_table_size);
 		requests.add(req);
 	}
@@ -925,7 +999,11 @@ void YCSBQueryMessage::copy_to_buf(char *buf)
 	for (uint64_t i = 0; i < requests.size(); i++)
 	{
 		ycsb_request *req = requests[i];
+#if LARGER_TXN
+		request_to_buf(buf, ptr, req);
+#else
 		COPY_BUF(buf, *req, ptr);
+#endif
 	}
 	assert(ptr == get_size());
 }
@@ -1657,6 +1735,10 @@ bool ClientQueryBatch::validate()
 
 /**************************************************/
 
+// Length sent in place of the byte length of a write that is a delta, which
+// never has bytes.
+static const uint32_t WRITE_DELTA_LEN = UINT32_MAX;
+
 uint64_t BatchRequests::get_size()
 {
 	uint64_t size = Message::mget_size();
@@ -1686,10 +1768,18 @@ uint64_t BatchRequests::get_size()
 	for (uint i = 0; i < get_batch_size(); i++)
 	{
 		//DEBUG_V1("test_v5:readSet[%d].size() = %ld\n", i, readSet[i].size());
+		size += 2 * sizeof(uint32_t); // read and write set sizes
 		size += 2 * sizeof(uint64_t) * readSet[i].size();
-		size += 2 * sizeof(uint64_t) * writeSet[i].size();
+		size += (2 * sizeof(uint64_t) + sizeof(uint32_t)) * writeSet[i].size();
+		for (const auto &item : writeSet[i])
+		{
+			size += item.buf == NULL ? 0 : item.buf->len;
+		}
 	}
 #endif
+#if HOT_ESCROW
+	size += sizeof(uint32_t) + sizeof(uint64_t) * escrowSplits.size();
+#endif
 #if PRE_ORDER
 	size += 2 * sizeof(uint64_t) * inputState.size();
 	size += 2 * sizeof(uint64_t) * outputState.size();
@@ -1832,16 +1922,18 @@ void BatchRequests::release()
 	}
 	requestMsg.clear();
 #if ISEOV
+	// Keep the sets and their buffers around, copy_from_buf reuses them.
 	for(auto &item:readSet)
 	{
-		map<uint64_t,uint64_t>().swap(item);
+		item.clear();
 	}
 	for(auto &item:writeSet)
 	{
-		map<uint64_t,uint64_t>().swap(item);
+		item.clear();
 	}
-	vector <map<uint64_t,uint64_t>>().swap(readSet);
-	vector <map<uint64_t,uint64_t>>().swap(writeSet);
+#endif
+#if HOT_ESCROW
+	escrowSplits.clear();
 #endif
 #if PRE_ORDER
 	map<uint64_t,uint64_t>().swap(outputState);
@@ -1896,62 +1988,38 @@ void BatchRequests::copy_from_buf(char *buf)
 	{
 		uint64_t key = 0;
 		uint64_t value = 0;
-		uint64_t readSet_size = 1;
-	#if BANKING_SMART_CONTRACT
-		if (requestMsg[i]->type == 0)
-		{	
-			readSet_size = 2;
-		}
-	#else
-		uint64_t writeSet_size = 0;
-		if (requestMsg[i]->requests[0]->type == YCSB_READ)
-		{	
-			readSet_size = g_ycsb_column;
-			writeSet_size = 0;
-		}
-		else {
-			readSet_size = g_ycsb_column;
-			writeSet_size = 1;
-		}
+		uint32_t readSet_size = 0;
+		uint32_t writeSet_size = 0;
+		COPY_VAL(readSet_size, buf, ptr);
+		COPY_VAL(writeSet_size, buf, ptr);
+		readSet[i].reserve(readSet_size);
+		writeSet[i].reserve(writeSet_size);
 
-	#endif
-	
-	#if BANKING_SMART_CONTRACT
 		for(uint64_t j = 0; j < readSet_size; j++)
 		{
 			COPY_VAL(key, buf, ptr);
 			COPY_VAL(value, buf, ptr);
 			//DEBUG_V1("test_v5:copy_from_buf::read[%d]key == %ld, value == %ld\n",i , key, value);
-			readSet[i][key] = value;
-			//DEBUG("test_v5:BatchRequests::copy_from_buf::readset[%d] = %ld, %ld\n", i, key, value);
-		}
-		for(uint64_t j = 0; j < readSet_size; j++)
-		{
-			COPY_VAL(key, buf, ptr);
-			COPY_VAL(value, buf, ptr);
-			writeSet[i][key] = value;
-			//DEBUG_V1("test_v5:copy_from_buf::write[%d]key == %ld, value == %ld\n",i , key, value);
-			//DEBUG("test_v5:BatchRequests::copy_from_buf::writeset[%d] = %ld, %ld\n", i, key, value);
-		}
-	#else
-		for(uint64_t j = 0; j < readSet_size; j++)
-		{
-			COPY_VAL(key, buf, ptr);
-			COPY_VAL(value, buf, ptr);
-			//DEBUG_V1("test_v5:copy_from_buf::read[%d]key == %ld, value == %ld\n",i , key, value);
-			readSet[i][key] = value;
-			//DEBUG("test_v5:BatchRequests::copy_from_buf::readset[%d] = %ld, %ld\n", i, key, value);
+			readSet[i].push_back(key, value);
 		}
 		for(uint64_t j = 0; j < writeSet_size; j++)
-		{	
+		{
+			uint32_t len = 0;
 			COPY_VAL(key, buf, ptr);
 			COPY_VAL(value, buf, ptr);
-			writeSet[i][key] = value;
+			COPY_VAL(len, buf, ptr);
 			//DEBUG_V1("test_v5:copy_from_buf::write[%d]key == %ld, value == %ld\n",i , key, value);
-			//DEBUG("test_v5:BatchRequests::copy_from_buf::writeset[%d] = %ld, %ld\n", i, key, value);
+			if (len == 0 || len == WRITE_DELTA_LEN)
+			{
+				writeSet[i].push_back(key, value, NULL, len == WRITE_DELTA_LEN);
+				continue;
+			}
+			// The bytes are copied once out of the message, then shared.
+			ValueBuf *bytes = value_alloc(&buf[ptr], len);
+			ptr += len;
+			writeSet[i].push_back(key, bytes->digest, bytes);
+			value_unref(bytes);
 		}
-
-	#endif
     	
 		// DEBUG("test_v5:BatchRequests::copy_from_buf::add_an_rw[%d],type = %d\n", i, requestMsg[i]->type);
     	//     for(auto item:this->readSet[i]){
@@ -1963,6 +2031,15 @@ void BatchRequests::copy_from_buf(char *buf)
     	
 	}
 #endif
+#if HOT_ESCROW
+	uint32_t split_cnt = 0;
+	COPY_VAL(split_cnt, buf, ptr);
+	escrowSplits.resize(split_cnt);
+	for (uint32_t i = 0; i < split_cnt; i++)
+	{
+		COPY_VAL(escrowSplits[i], buf, ptr);
+	}
+#endif
 
 #if PRE_ORDER
 	uint64_t key = 0;
@@ -2033,11 +2110,11 @@ void BatchRequests::copy_to_buf(char *buf)
 #if ISEOV
 	for (uint i = 0; i < get_batch_size(); i++)
 	{
-		// uint64_t readSet_size = 1;
-		// if (requestMsg[i]->type == BSC_TRANSFER) readSet_size = 2;
-		// else readSet_size = 1;
-		// uint64_t count = 0;
-		for(auto item:readSet[i])
+		uint32_t readSet_size = readSet[i].size();
+		uint32_t writeSet_size = writeSet[i].size();
+		COPY_BUF(buf, readSet_size, ptr);
+		COPY_BUF(buf, writeSet_size, ptr);
+		for(const auto &item:readSet[i])
 		{
 			//count ++;
 			COPY_BUF(buf, item.first, ptr);
@@ -2049,11 +2126,16 @@ void BatchRequests::copy_to_buf(char *buf)
 		// 	DEBUG("count != readSet_size");
 		// 	assert(0);
 		// }
-		// for(const auto &item:writeSet[i])
-		for(auto item:writeSet[i])
+		for(const auto &item:writeSet[i])
 		{
+			uint32_t len = item.delta ? WRITE_DELTA_LEN : item.buf == NULL ? 0 : item.buf->len;
 			COPY_BUF(buf, item.first, ptr);
 			COPY_BUF(buf, item.second, ptr);
+			COPY_BUF(buf, len, ptr);
+			if (item.buf != NULL)
+			{
+				COPY_BUF_SIZE(buf, item.buf->data, ptr, len);
+			}
 			//DEBUG_V1("test_v5:copy_to_buf::write[%d]key == %ld, value == %ld\n",i , item.first, item.second);
 			//DEBUG("test_v5:BatchRequests::copy_to_buf::write[%d] = %ld, %ld\n", i, item.first, item.second);
 		}
@@ -2078,6 +2160,14 @@ void BatchRequests::copy_to_buf(char *buf)
     	//     }
 	}
 #endif
+#if HOT_ESCROW
+	uint32_t split_cnt = escrowSplits.size();
+	COPY_BUF(buf, split_cnt, ptr);
+	for (uint64_t id : escrowSplits)
+	{
+		COPY_BUF(buf, id, ptr);
+	}
+#endif
 
 #if PRE_ORDER
 	COPY_BUF(buf, inputState_size, ptr);
@@ -2130,6 +2220,14 @@ string BatchRequests::getString(uint64_t sender)
 	}
 	message += hash;
 
+#if HOT_ESCROW
+	for (uint64_t id : escrowSplits)
+	{
+		message += to_string(id);
+		message += " ";
+	}
+#endif
+
 #if PRE_ORDER
 	for(auto item:inputState){
         message += to_string(item.first);
@@ -2345,6 +2443,7 @@ uint64_t CheckpointMessage::get_size()
 	size += sizeof(index);
 	size += sizeof(return_node);
 	size += sizeof(end_index);
+	size += sizeof(digest);
 
 	return size;
 }
@@ -2357,6 +2456,7 @@ void CheckpointMessage::copy_from_txn(TxnManager *txn)
 	this->index = curr_next_index() - txn_per_chkpt();
 	this->return_node = g_node_id;
 	this->end_index = curr_next_index();
+	db->Digest(this->digest);
 
 	// Now implemted in msg_queue::enqueue
 	//this->sign();
@@ -2378,6 +2478,7 @@ void CheckpointMessage::copy_from_buf(char *buf)
 	COPY_VAL(index, buf, ptr);
 	COPY_VAL(return_node, buf, ptr);
 	COPY_VAL(end_index, buf, ptr);
+	COPY_VAL(digest, buf, ptr);
 
 	assert(ptr == get_size());
 }
@@ -2391,6 +2492,7 @@ void CheckpointMessage::copy_to_buf(char *buf)
 	COPY_BUF(buf, index, ptr);
 	COPY_BUF(buf, return_node, ptr);
 	COPY_BUF(buf, end_index, ptr);
+	COPY_BUF(buf, digest, ptr);
 
 	assert(ptr == get_size());
 }
@@ -2427,7 +2529,8 @@ string CheckpointMessage::toString()
 {
 	return std::to_string(this->index) + '_' +
 		   std::to_string(this->end_index) + '_' +
-		   std::to_string(this->return_node); //still needs digest of state
+		   std::to_string(this->return_node) + '_' +
+		   this->digest.toString();
 }
 
 //is message valid
@@ -375,8 +375,11 @@ public:
 #endif
 
 #if ISEOV
-    vector<map<uint64_t,uint64_t>> readSet;
-    vector<map<uint64_t,uint64_t>> writeSet;
+    vector<RWSet> readSet;
+    vector<RWSet> writeSet;
+#endif
+#if HOT_ESCROW
+    vector<uint64_t> escrowSplits; // accounts split before the txns run
 #endif
 #if PRE_ORDER
     uint64_t inputState_size;
@@ -435,6 +438,7 @@ public:
     uint64_t index;       // sequence number of last request
     uint64_t return_node; //id of node that sent this message
     uint64_t end_index;
+    StateDigest digest;   // state after the checkpoint, if STATE_DIGEST
 };
 
 // Message Creation methods.
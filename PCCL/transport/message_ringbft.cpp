@@ -75,6 +75,9 @@ void CommitCertificateMessage::copy_from_txn(TxnManager *txn)
             ycsb_request *req = (ycsb_request *)mem_allocator.alloc(sizeof(ycsb_request));
             req->key = yquery->requests[i]->key;
             req->value = yquery->requests[i]->value;
+#if LARGER_TXN
+            req->payload = value_ref(yquery->requests[i]->payload);
+#endif
             yqry->requests.add(req);
         }
         this->requestMsg[idx] = yqry;